@@ -0,0 +1,69 @@
+/**
+ * @file CodeGenerator.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Generates a self-contained C++ header with a problem-specific solver for a configured MPC
+ *
+ *    The generated header has no dependencies and does no dynamic allocation. All problem data is 
+ *    baked in as constants:
+ *      - calculateGradient(x0, Y_d, q): unrolled nonzeros of the gradient maps
+ *      - calculateX(U, x0, X), calculateY(X, Y): unrolled nonzeros of the prediction matrices
+ *      - solve(x0, Y_d, workspace, U): ADMM iterations on the input bounds, the KKT matrix 
+ *        Cholesky factor is precomputed and the triangular solves are unrolled. Returns the
+ *        iterations run
+ *
+ *    The variables are scaled with D = diag(A_qp)^(-1/2). rho, sigma, alpha, the tolerances and the
+ *    termination check interval are taken from the MPC solver settings. solve() stops when the primal
+ *    and dual residuals of the scaled problem are within the tolerances or after admm_iterations. 
+ *    With fixed_iterations it always runs admm_iterations, for a constant execution time.
+ *    Only MPCs without state constraints are supported (b_ieq depends on x0).
+ */
+#ifndef CODE_GENERATOR_HPP_
+#define CODE_GENERATOR_HPP_
+
+#include <ostream>
+#include <string>
+
+#include "LinMpcEigen.hpp"
+
+namespace LinMpcEigen {
+
+struct CodeGenOptions {
+  std::string namespace_name = "generated_mpc"; // may be nested ("a::b")
+  uint32_t admm_iterations = 100; // maximum ADMM iterations per solve, the Workspace warm starts the next solve
+  bool fixed_iterations = false;  // no termination checks, every solve runs admm_iterations
+};
+
+class CodeGenerator {
+public:
+  // mpc needs to be initialized (initializeSolver())
+  CodeGenerator(const MPC &mpc, const CodeGenOptions &options = CodeGenOptions());
+
+  void generate(std::ostream &stream) const;
+  void generateToFile(const std::string &file_path) const;
+
+private:
+  CodeGenOptions options_;
+  uint32_t n_x_, n_u_, n_y_, N_, n_var_;
+  bool bounded_;
+  double rho_, sigma_, alpha_;
+  double absolute_tolerance_, relative_tolerance_;
+  uint32_t check_termination_; // 0 - no termination checks
+
+  VecNd input_scaling_; // D
+  MatNd gradient_x0_map_, gradient_Y_d_map_; // scaled: D * map
+  MatNd hessian_; // scaled: D * A_qp * D
+  SparseMat A_mpc_, B_mpc_, C_mpc_;
+  VecNd lower_bound_, upper_bound_; // scaled
+  MatNd kkt_factor_; // L, L * L^T = D * A_qp * D (+ (sigma + rho) * I if bounded)
+
+  void generateGradient(std::ostream &stream) const;
+  void generatePrediction(std::ostream &stream) const;
+  void generateKktSolve(std::ostream &stream) const;
+  void generateResiduals(std::ostream &stream) const;
+  void generateSolve(std::ostream &stream) const;
+};
+
+} // namespace LinMpcEigen
+
+#endif //CODE_GENERATOR_HPP_
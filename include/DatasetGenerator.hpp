@@ -0,0 +1,120 @@
+/**
+ * @file DatasetGenerator.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Offline dataset generation for approximate MPC policies
+ *
+ *    Samples (x0, Y_d) parameter points, solves the MPC for every point
+ *    and streams (x0, Y_d, U*, status) records to a chunked binary file.
+ *
+ *    Samples are generated and solved one chunk at a time (bounded memory).
+ *    Inside a chunk the samples are ordered into a nearest-neighbour chain
+ *    that is split into one segment per worker thread. The first sample
+ *    of a segment is solved with a new solver, every other one is warm
+ *    started from the solution of the previous, nearby sample, so the
+ *    records do not depend on thread scheduling. Chunk k is sampled
+ *    with a random generator seeded with (seed, k), which makes the file
+ *    resumable: complete chunks are kept, an incomplete last chunk is
+ *    dropped and generation continues from the first missing chunk.
+ *
+ *    File layout (native endianness):
+ *      DatasetFileHeader
+ *      chunks:
+ *        DatasetChunkHeader
+ *        n_records * { x0 (n_x doubles), Y_d (N * n_y doubles),
+ *                      U (N * n_u doubles), status (int32) }
+ *        uint32 chunk trailer (DATASET_CHUNK_TRAILER)
+ */
+#ifndef DATASET_GENERATOR_HPP_
+#define DATASET_GENERATOR_HPP_
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LinMpcEigen.hpp"
+
+namespace LinMpcEigen {
+
+static constexpr uint32_t DATASET_FILE_VERSION = 1;
+static constexpr uint32_t DATASET_CHUNK_MAGIC = 0x4B4E4843;   // "CHNK"
+static constexpr uint32_t DATASET_CHUNK_TRAILER = 0x454E4F44; // "DONE"
+
+struct DatasetFileHeader {
+  char magic[8];        // "LMPCDSET"
+  uint32_t version;
+  uint32_t n_x, n_u, n_y;
+  uint32_t horizon;
+  uint32_t chunk_size;  // records per chunk (the last chunk can be shorter)
+  uint64_t n_samples;
+  uint64_t seed;
+};
+
+struct DatasetChunkHeader {
+  uint32_t magic;
+  uint32_t n_records;
+  uint64_t chunk_index;
+};
+
+struct DatasetRecord {
+  VecNd x0, Y_d, U;
+  int32_t status; // OSQP status
+};
+
+// fills x0 (n_x) and Y_d (N * n_y) with one parameter sample
+using ParameterSampler = std::function< void(std::mt19937_64 &rng, VecNd &x0, VecNd &Y_d) >;
+
+// x0 uniform in [x0_lower, x0_upper], constant output reference uniform in [y_d_lower, y_d_upper]
+ParameterSampler makeBoxParameterSampler( const VecNd &x0_lower, const VecNd &x0_upper,
+                                          const VecNd &y_d_lower, const VecNd &y_d_upper,
+                                          uint32_t horizon );
+
+struct DatasetSpec {
+  uint64_t n_samples = 0;
+  uint32_t chunk_size = 1024;
+  uint64_t seed = 0;
+  uint32_t n_threads = 0; // 0 - std::thread::hardware_concurrency()
+  bool resume = true;     // continue an existing file instead of overwriting it
+};
+
+class DatasetGenerator {
+public:
+  DatasetGenerator( const LinearSystem &linear_system, uint32_t horizon, 
+                    const MpcFactory &mpc_factory, const ParameterSampler &sampler );
+
+  // returns the number of chunks that were generated by this call
+  uint64_t run(const std::string &file_path, const DatasetSpec &spec) const;
+
+private:
+  LinearSystem linear_system_;
+  uint32_t N_;
+  MpcFactory mpc_factory_;
+  ParameterSampler sampler_;
+
+  DatasetFileHeader makeHeader(const DatasetSpec &spec) const;
+  uint64_t recordBytes() const;
+  
+  // number of complete chunks in an existing file, truncates an incomplete last chunk
+  uint64_t resumeFile(const std::string &file_path, const DatasetFileHeader &header) const;
+};
+
+class DatasetReader {
+public:
+  explicit DatasetReader(const std::string &file_path);
+
+  const DatasetFileHeader &header() const;
+
+  // reads the next complete chunk, returns false at the end of the file
+  bool readChunk(std::vector<DatasetRecord> &records);
+
+private:
+  std::ifstream file_;
+  DatasetFileHeader header_;
+};
+
+// orders the columns of samples into a greedy nearest-neighbour chain
+std::vector<uint32_t> nearestNeighbourOrder(const MatNd &samples);
+}
+#endif //DATASET_GENERATOR_HPP_
@@ -0,0 +1,94 @@
+/**
+ * @file DistributedMpc.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Distributed MPC for coupled subsystems using consensus ADMM
+ *
+ *    Every subsystem i has its own MPC with decision vector U_i and a
+ *    local coupling vector:
+ *
+ *      c_i = E_i * U_i + F_i * x0_i
+ *
+ *    whose entries are tied to entries of a global coupling vector z
+ *    (c_i(r) = z(g_i(r))). An interconnection "input v of subsystem i
+ *    equals output y of subsystem j" is described by selecting v in E_i
+ *    and the predicted y in (E_j, F_j) = (C_mpc * A_mpc, C_mpc * B_mpc)
+ *    rows of subsystem j, both mapped to the same global indices.
+ *
+ *    Every tick runs scaled consensus ADMM iterations:
+ *
+ *      U_i  = argmin  f_i(U_i) + rho/2 * ||c_i(U_i) - z_i + lambda_i||^2   (parallel)
+ *      z    = average of (c_i + lambda_i) over all entries tied to z
+ *      lambda_i += c_i - z_i
+ *
+ *    until the primal and dual residual norms are below the tolerance or
+ *    the iteration cap is reached. The quadratic term rho/2 * ||E_i U_i||^2
+ *    is added to the local Hessians once, so the ADMM iterations only
+ *    update the local gradients and every local solver stays warm.
+ */
+#ifndef DISTRIBUTED_MPC_HPP_
+#define DISTRIBUTED_MPC_HPP_
+
+#include <vector>
+
+#include "LinMpcEigen.hpp"
+#include "ThreadPool.hpp"
+
+namespace LinMpcEigen {
+
+struct CouplingSpec {
+  SparseMat coupling_matrix;          // E_i, (n_c x N * n_u)
+  SparseMat coupling_x0_map;          // F_i, (n_c x n_x), empty - zero
+  std::vector<uint32_t> global_indices; // g_i, n_c indices into z
+};
+
+struct DistributedSolveInfo {
+  uint32_t iterations = 0;
+  double primal_residual = 0.0;
+  double dual_residual = 0.0;
+  bool converged = false;
+};
+
+class DistributedMPC {
+public:
+  DistributedMPC( std::vector< std::unique_ptr<MPC> > subsystem_mpcs,
+                  const std::vector<CouplingSpec> &couplings, uint32_t n_global,
+                  double rho, double tolerance = 1e-4, uint32_t max_iterations = 50,
+                  uint32_t n_threads = 0 );
+
+  void initializeSolver();
+  void updateSolver(const std::vector<VecNd> &Y_d, const std::vector<VecNd> &x0);
+
+  // runs the ADMM iterations of one tick, returns the local solutions U_i
+  std::vector<VecNd> solve();
+
+  const DistributedSolveInfo &getSolveInfo() const;
+  const VecNd &getCouplingVariables() const; // z
+  uint32_t getNumberOfSubsystems() const;
+  MPC &getSubsystemMPC(uint32_t i);
+
+private:
+  std::vector< std::unique_ptr<MPC> > subsystem_mpcs_;
+  std::vector<CouplingSpec> couplings_;
+  uint32_t n_global_;
+
+  double rho_;
+  double tolerance_;
+  uint32_t max_iterations_;
+
+  ThreadPool thread_pool_;
+
+  VecNd z_;
+  VecNd z_count_; // number of local entries tied to every entry of z
+  std::vector<VecNd> lambda_;          // scaled dual variables
+  std::vector<VecNd> coupling_offset_; // F_i * x0_i
+  std::vector<VecNd> coupling_value_;  // c_i
+  std::vector<VecNd> U_;
+
+  DistributedSolveInfo solve_info_;
+
+  void checkCouplingDimensions() const;
+  VecNd gatherGlobal(uint32_t i) const; // z_i
+};
+}
+#endif //DISTRIBUTED_MPC_HPP_
@@ -0,0 +1,94 @@
+/**
+ * @file FlightRecorder.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Fixed-capacity ring buffer of the most recent solves
+ *
+ *    record() is called by the control thread (single producer). It copies
+ *    x0 and the first control move into preallocated storage, it does not
+ *    allocate, lock or do I/O. Every slot carries a sequence number
+ *    (seqlock), so snapshot() and dump() can run concurrently on any other
+ *    thread and skip the slots that are overwritten while being copied.
+ *
+ *    With a fault dump prefix, record() of a fault status only wakes a
+ *    background thread, which writes the buffer to <prefix>_<tick>.bin.
+ *
+ *    Dump file format (native endianness):
+ *      char[4] "LMFR", uint32 version, uint32 n_x, uint32 n_u, uint64 n_records
+ *      n_records x { uint64 tick, int64 time [ns, steady clock], int32 status, uint32 iterations,
+ *                    double latency [s], double x0[n_x], double u0[n_u] }
+ */
+#ifndef FLIGHT_RECORDER_HPP_
+#define FLIGHT_RECORDER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace LinMpcEigen {
+
+struct FlightRecord {
+  uint64_t tick = 0;    // index of the solve since the recorder was created
+  int64_t time = 0;     // [ns], steady clock
+  int status = 0;       // OSQP status
+  uint32_t iterations = 0;
+  double latency = 0.0; // solve time [s]
+  Eigen::VectorXd x0;
+  Eigen::VectorXd u0;   // first control move
+};
+
+class FlightRecorder {
+public:
+  FlightRecorder(uint32_t capacity, uint32_t n_x, uint32_t n_u, const std::string &fault_dump_prefix = "");
+  ~FlightRecorder();
+
+  FlightRecorder(const FlightRecorder &) = delete;
+  FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+  // control thread only, x0 needs n_x and u0 at least n_u entries
+  void record(const double *x0, const double *u0, int status, uint32_t iterations, double latency);
+
+  // records in chronological order, oldest first
+  std::vector<FlightRecord> snapshot() const;
+  void dump(const std::string &file_path) const;
+  static std::vector<FlightRecord> loadDump(const std::string &file_path);
+
+  uint32_t capacity() const;
+  uint64_t getTickCount() const;
+  uint64_t getFaultCount() const;
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> sequence{0}; // tick + 1 when complete, 0 while written
+    uint64_t tick;
+    int64_t time;
+    int status;
+    uint32_t iterations;
+    double latency;
+  };
+
+  void faultDumpLoop();
+  static bool isFault(int status);
+
+  uint32_t capacity_, n_x_, n_u_;
+  std::unique_ptr<Slot[]> slots_;
+  std::vector<double> data_; // x0 and u0 of every slot, (n_x + n_u) * capacity
+  std::atomic<uint64_t> next_tick_{0};
+
+  std::string fault_dump_prefix_;
+  std::atomic<uint64_t> fault_count_{0};
+  std::atomic<uint64_t> last_fault_tick_{0};
+  uint64_t dumped_fault_count_ = 0;
+  std::thread fault_dump_thread_;
+  std::mutex fault_mutex_;
+  std::condition_variable fault_cv_;
+  std::atomic<bool> stop_{false};
+};
+}
+#endif //FLIGHT_RECORDER_HPP_
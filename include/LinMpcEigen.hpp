@@ -54,11 +54,17 @@
 
 #include <iostream>
 #include <chrono>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 
 #include "OsqpEigenOptimization.hpp"
+#include "MixedPrecisionQp.hpp"
+#include "RealTime.hpp"
+#include "FlightRecorder.hpp"
+#include "Metrics.hpp"
 
 typedef Eigen::VectorXd VecNd;
 typedef Eigen::MatrixXd MatNd;
@@ -72,61 +78,208 @@ MatNd matrixPow(const MatNd &input_mat, uint32_t power);
 SparseMat matrixPow(const SparseMat &input_mat, uint32_t power);
 SparseMat cocatenateMatrices(SparseMat mat_upper, SparseMat mat_lower);
 
+enum class MatrixStructure {
+  GENERAL,
+  DIAGONAL,       // square, nonzeros only on the diagonal (includes scaled identity)
+  SELECTION,      // every row has a single 1, M * x picks entries of x
+  BLOCK_DIAGONAL, // square, nonzeros only in the diagonal blocks of size block_size
+  BANDED          // square, nonzeros only within bandwidth of the diagonal
+};
+
+struct MatrixStructureInfo {
+  MatrixStructure type = MatrixStructure::GENERAL;
+  VecNd diagonal;                        // DIAGONAL
+  std::vector<uint32_t> selected_columns; // SELECTION, column picked by each row
+  uint32_t block_size = 0;               // BLOCK_DIAGONAL
+  uint32_t bandwidth = 0;                // BANDED
+};
+
+// BLOCK_DIAGONAL and BANDED are informative, sparse products already keep their fill-in low
+MatrixStructureInfo detectMatrixStructure(const SparseMat &matrix);
+// matrix * input, with a row gather for SELECTION and a coefficient-wise product for DIAGONAL
+MatNd applyStructuredMatrix(const SparseMat &matrix, const MatrixStructureInfo &structure, const MatNd &input);
+SparseMat applyStructuredMatrix(const SparseMat &matrix, const MatrixStructureInfo &structure, const SparseMat &input);
+
 struct LinearSystem {
   LinearSystem( const SparseMat &A, const SparseMat &B, 
                 const SparseMat &C, const SparseMat &D );
 
   //throws an error if the system is ill defined
   void checkMatrixDimensions() const;
+  // detects the structure of A, B and C, called by the constructor, call again after changing the matrices
+  void detectStructure();
+
+  // x(k+1) = A * x(k) + B * u(k) and y(k) = C * x(k) with the structure specific kernels
+  VecNd stepState(const VecNd &x, const VecNd &u) const;
+  VecNd output(const VecNd &x) const;
   
   //system dynamics
   SparseMat A, B, C, D;
   uint32_t n_x; // x vector dimension
   uint32_t n_u; // u vector dimension
   uint32_t n_y; // y vector dimension
+
+  MatrixStructureInfo A_structure, B_structure, C_structure;
+};
+
+// Sets the prediction matrices of a linear system over the horizon:
+//    X = A_mpc * U + B_mpc * x0,   Y = C_mpc * X
+// A_mpc, B_mpc and C_mpc need to be empty matrices of the correct size
+void setupPredictionMatrices( const LinearSystem &linear_system, uint32_t horizon,
+                              SparseMat &A_mpc, SparseMat &B_mpc, SparseMat &C_mpc );
+// C_mpc * M for M with horizon * n_x rows, a row gather for a selection C
+SparseMat applyOutputMatrix(const LinearSystem &linear_system, uint32_t horizon, const SparseMat &M);
+// X = A_mpc * U + B_mpc * x0 by the recursion x(k+1) = A * x(k) + B * u(k), O(N) instead of O(N^2)
+VecNd rolloutStates(const LinearSystem &linear_system, const VecNd &U, const VecNd &x0);
+// Y = C_mpc * X
+VecNd outputSequence(const LinearSystem &linear_system, const VecNd &X);
+// Into X and Y without allocation if they already have the size, for control and logging threads
+void rolloutStates(const LinearSystem &linear_system, const VecNd &U, const VecNd &x0, VecNd &X);
+void outputSequence(const LinearSystem &linear_system, const VecNd &X, VecNd &Y);
+
+// QP solver used by the MPC
+enum class QpBackend {
+  OSQP,
+  MIXED_PRECISION, // MixedPrecisionQpSolver, single precision factorization with double precision refinement
+  RICCATI          // MixedPrecisionQpSolver with a RiccatiKktSolver, MPC without state constraints or proximal term
 };
 
+// Derivatives of an MPC solution U, see MPC::calculateSensitivities()
+struct MpcSensitivities {
+  MatNd dU_dweights; // N * n_u x number of weights, one column per entry of weight_names
+  // "Q", "R" (MPC I) or "W_y" and "w_u(i,j)", "w_x(i,j)" for the nonzeros of w_u and w_x (MPC II)
+  std::vector<std::string> weight_names;
+  MatNd dU_du_lower_bound, dU_du_upper_bound; // N * n_u x n_u
+  MatNd dU_dx_lower_bound, dU_dx_upper_bound; // N * n_u x n_x
+  MatNd dU_dx0;  // N * n_u x n_x
+  MatNd dU_dY_d; // N * n_u x N * n_y
+  uint32_t n_active_bounds = 0;      // input bounds active at U
+  uint32_t n_active_constraints = 0; // state constraints active at U
+};
+
+// formulation policies, see PolicyMpc.hpp
+struct OutputTrackingCost;
+struct WeightedCost;
+struct StateBounds;
+class MpcPolicy;
+
 class MPC {
 public:
   MPC(const LinearSystem &linear_system, uint32_t horizon,
       const VecNd &Y_d, const VecNd &x0, double Q, double R,
-      double solver_time_limit = 0.0); 
+      double solver_time_limit = 0.0,
+      const OsqpSettings &solver_settings = OsqpSettings()); 
   
   MPC(const LinearSystem &linear_system, uint32_t horizon, 
       const VecNd &Y_d, const VecNd &x0, double Q, double R,
       const VecNd &u_lower_bound, const VecNd &u_upper_bound,
-      double solver_time_limit = 0.0);
+      double solver_time_limit = 0.0,
+      const OsqpSettings &solver_settings = OsqpSettings());
 
   MPC(const LinearSystem &linear_system, uint32_t horizon, 
       const VecNd &Y_d, const VecNd &x0, double W_y, 
       const SparseMat &w_u, const SparseMat &w_x,
-      double solver_time_limit = 0.0); 
+      double solver_time_limit = 0.0,
+      const OsqpSettings &solver_settings = OsqpSettings()); 
 
   MPC(const LinearSystem &linear_system, uint32_t horizon, 
       const VecNd &Y_d, const VecNd &x0, double W_y, 
       const SparseMat &w_u, const SparseMat &w_x,
       const VecNd &u_lower_bound, const VecNd &u_upper_bound,
-      double solver_time_limit = 0.0);
+      double solver_time_limit = 0.0,
+      const OsqpSettings &solver_settings = OsqpSettings());
 
   MPC(const LinearSystem &linear_system, uint32_t horizon, 
       const VecNd &Y_d, const VecNd &x0, double W_y, 
       const SparseMat &w_u, const SparseMat &w_x,
       const VecNd &u_lower_bound, const VecNd &u_upper_bound,
       const VecNd &x_lower_bound, const VecNd &x_upper_bound,
-      double solver_time_limit = 0.0 );
+      double solver_time_limit = 0.0,
+      const OsqpSettings &solver_settings = OsqpSettings() );
+  ~MPC();
   
   void setYd(const VecNd &Y_d_in); // set Y_d from an Eigen vector Nd
+  void setX0(const VecNd &x0_in);   // used by the next initializeSolver(), updateSolver() sets both
+
+  void setSolverSettings(const OsqpSettings &solver_settings); // used by the next initializeSolver()
+  const OsqpSettings &getSolverSettings() const;
+  // Fixed diagonal preconditioning computed from the prediction structure (Markov parameters) 
+  // instead of OSQP's Ruiz scaling, used by the next initializeSolver()
+  void setStructuredScaling(bool enable);
+  // used by the next initializeSolver(), MIXED_PRECISION and RICCATI use the ADMM parameters of the solver settings
+  void setQpBackend(QpBackend qp_backend);
 
   void initializeSolver();
   void updateSolver(const VecNd &Y_d_in, const VecNd &x0);
+
+  // Adds rho/2 * ||E * U||^2 to the cost function, call before initializeSolver()
+  void setProximalTerm(const SparseMat &E, double rho);
+  // Solver gradient = b_qp(Y_d, x0) + gradient_offset, without reinitializing the solver.
+  // The offset is dropped by the next updateSolver() call
+  void updateGradientOffset(const VecNd &gradient_offset);
   
   VecNd calculateX(const VecNd &U_in) const;
   VecNd calculateY(const VecNd &U_in) const;
+  void calculateX(const VecNd &U_in, VecNd &X) const; // no allocation if X has the size N * n_x
   std::vector< std::vector<double> > extractU(const VecNd &U_in) const; 
   std::vector< std::vector<double> > extractX(const VecNd &U_in) const; 
   std::vector< std::vector<double> > extractY(const VecNd &U_in) const; 
 
+  void setWarmStart(const VecNd &U_warm_start); // call after updateSolver, before solve
   VecNd solve() const;
+  // Budget-adaptive solve (OSQP backend), see OsqpEigenOpt::solveProblemWithinBudget(). 
+  // The residuals are those of the solver problem (scaled if structured scaling is enabled)
+  VecNd solveWithinBudget(double time_budget, OsqpSolveInfo &solve_info) const;
+  int getSolverStatus() const; // OSQP status of the last solve
+  uint32_t getSolverIterations() const; // ADMM iterations of the last solve
+  // Real-time mode, call after initializeSolver() on the thread that will call solve(). Locks the
+  // process memory, prefaults the MPC matrices and the solver workspace (warm-up solve) and sets the
+  // affinity and SCHED_FIFO priority of the calling thread, see RealTime.hpp.
+  // The warm-up solve of the current Y_d and x0 is not undone: the next solve is warm started from its 
+  // iterate (and OSQP's adapted rho), and it is counted in the metrics and the flight recorder
+  RealTimeReport enableRealTimeMode(const RealTimeSettings &settings);
+
+  // Binary checkpoint of the construction parameters, solver configuration, current Y_d and x0 and the
+  // last solver iterate (primal, dual and rho, OSQP backend). restore() rebuilds the MPC, initializes 
+  // the solver if the checkpointed one was initialized and warm starts it from the iterate.
+  // A gradient offset (updateGradientOffset()) is not part of the checkpoint
+  std::string checkpoint() const;
+  static std::unique_ptr<MPC> restore(const std::string &checkpoint);
+  void checkpointToFile(const std::string &file_path) const;
+  static std::unique_ptr<MPC> restoreFromFile(const std::string &file_path);
+
+  // Records x0, the first control move, status, iterations and latency of the last `capacity` solves, 
+  // see FlightRecorder.hpp. With a fault_dump_prefix, solves that fail are followed by a dump to
+  // <fault_dump_prefix>_<tick>.bin, written by a background thread
+  void enableFlightRecorder(uint32_t capacity, const std::string &fault_dump_prefix = "");
+  // counters and latency histograms of updateSolver(), setWarmStart() and solve(), see Metrics.hpp
+  MpcMetrics &getMetrics();
+  const MpcMetrics &getMetrics() const;
+  const FlightRecorder *getFlightRecorder() const; // nullptr if not enabled
+  void dumpFlightRecorder(const std::string &file_path) const;
+
+  uint32_t getHorizon() const;
+  const LinearSystem &getLinearSystem() const;
+  // QP problem and b_qp = gradient_x0_map * x0 + gradient_Y_d_map * Y_d, require initializeSolver()
+  const SparseQpProblem &getQpProblem() const;
+  const MatNd &getGradientX0Map() const;
+  const MatNd &getGradientYdMap() const;
+  // X = A_mpc * U + B_mpc * x0,   Y = C_mpc * X
+  void getPredictionMatrices(SparseMat &A_mpc, SparseMat &B_mpc, SparseMat &C_mpc) const;
+
+  // Batch evaluation, each column of the input matrices is one scenario.
+  // The gradient and the unconstrained solutions require initializeSolver() to be called first
+  MatNd calculateGradientBatch(const MatNd &Y_d_batch, const MatNd &x0_batch) const;
+  MatNd solveUnconstrainedBatch(const MatNd &Y_d_batch, const MatNd &x0_batch);
+  MatNd calculateXBatch(const MatNd &U_batch, const MatNd &x0_batch) const;
+  MatNd calculateYBatch(const MatNd &U_batch, const MatNd &x0_batch) const;
+
+  // Sensitivities of the solution U of the current Y_d and x0 to the weights, bounds, x0 and Y_d.
+  // Differentiates the KKT conditions of the constraints active at U (slack <= active_tolerance,
+  // relative to bounds larger than 1, keep it above the solver tolerances). The reduced KKT matrix
+  // is factorized once and solved for all parameters. Derivatives are one-sided where a constraint
+  // is only weakly active. Requires initializeSolver()
+  MpcSensitivities calculateSensitivities(const VecNd &U, double active_tolerance = 1e-5) const;
 
 private:
   LinearSystem linear_system_; // linear_system
@@ -139,7 +292,6 @@ private:
 
   double W_y_;
   SparseMat w_u_, w_x_;
-  SparseMat W_u_, W_x_;
 
   VecNd u_lower_bound_, u_upper_bound_,
         x_lower_bound_, x_upper_bound_;
@@ -149,15 +301,17 @@ private:
 
   std::unique_ptr<SparseQpProblem> qp_problem_;
 
-  // matrices stored in memory for faster QP problem update
-  SparseMat C_A_; // C_mpc * A_mpc
-  SparseMat C_B_; // C_mpc * B_mpc
-  
-  SparseMat Q_C_A_T_;
-  SparseMat Q_C_A_T_C_B_;
-  
-  MatNd W_x_A_; // W_x * A_mpc
-  MatNd W_x_B_; // W_x * B_mpc
+  // cost and constraint policies of mpc_type_, created by the constructor. initializeSolver() builds
+  // the matrices they store in memory for faster QP problem update
+  std::unique_ptr<MpcPolicy> policy_;
+
+  // b_qp = gradient_x0_map_ * x0 + gradient_Y_d_map_ * Y_d
+  MatNd gradient_x0_map_;
+  MatNd gradient_Y_d_map_;
+
+  // dense factorization of A_qp, computed on the first unconstrained batch solve
+  Eigen::LDLT<MatNd> hessian_ldlt_;
+  bool hessian_factorized_ = false;
 
   enum mpc_type
   {
@@ -170,28 +324,50 @@ private:
 
   mpc_type mpc_type_;
 
-  void setWeightMatrices();
-
   //Sets A_mpc, B_mpc, C_mpc
   void setupMpcDynamics();
-  // MPC1
-  void setupQpMPC1(); 
-  void updateQpMPC1();
-  void setupQpMPC2();
-  void updateQpMPC2();
-  void updateQpMPC2_2();
-  void setupQpConstrainedMPC1(); 
-  void setupQpConstrainedMPC2(); 
-  void setupQpConstrainedMPC2_2(); 
+  const SparseMat &outputInputMatrix() const; // C_mpc * A_mpc of the cost policy
+
+  void setupGradientMaps();
+  void createSolver();
+  void updateSolverData();
+  void setupStructuredScaling();
+  std::unique_ptr<KktSolver> createRiccatiKktSolver() const;
+  SparseQpProblem scaleQpProblem() const;
+  // metrics and flight recorder
+  void recordSolve(const VecNd &U, int status, uint32_t iterations, double latency, bool warm_started) const;
 
   void checkMatrixDimensions() const; 
+  void checkBatchDimensions(const MatNd &x0_batch, uint32_t batch_rows, 
+                            uint32_t expected_rows, const char *batch_name) const;
   void checkBoundsDimensions() const; 
   void checkWeightDimensions() const;
   void checkStateBoundsDimensions() const; 
 
+  QpBackend qp_backend_ = QpBackend::OSQP;
   std::unique_ptr<OsqpEigenOpt> osqp_eigen_opt_;
+  std::unique_ptr<MixedPrecisionQpSolver> mixed_precision_opt_;
+  std::unique_ptr<FlightRecorder> flight_recorder_;
+  std::unique_ptr<MpcMetrics> metrics_ = std::make_unique<MpcMetrics>();
 
   double solver_time_limit_ = 0;
+  OsqpSettings solver_settings_;
+
+  SparseMat proximal_E_;
+  double proximal_rho_ = 0.0;
+
+  // U = input_scaling_ .* U_solver, constraint_scaling_ scales the rows of A_ieq
+  bool structured_scaling_ = false;
+  VecNd input_scaling_;
+  VecNd constraint_scaling_;
 };
+
+// MPC::enableRealTimeMode() of controllers served by their own threads (MultiRateExecutor, MpcService).
+// The process memory is configured once, the calling thread is not pinned or prioritized
+RealTimeReport enableRealTimeMode(const std::vector<MPC *> &controllers, const RealTimeSettings &settings);
+
+// builds a MPC for the given system, used by the parallel tools to create one MPC per worker thread
+using MpcFactory = std::function< std::unique_ptr<MPC>(const LinearSystem &linear_system, 
+                                                       const VecNd &Y_d, const VecNd &x0) >;
 }
 #endif //LINMPCEIGEN_H_
\ No newline at end of file
@@ -0,0 +1,101 @@
+/**
+ * @file Metrics.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Solver health metrics of MPC controllers
+ *
+ *    Every MPC keeps a MpcMetrics object (MPC::getMetrics()) with atomic
+ *    counters, gauges and latency histograms, updated by updateSolver(),
+ *    setWarmStart() and solve(). Updating them costs a few relaxed atomic
+ *    operations, reading them is safe from any thread.
+ *
+ *    MetricsExporter renders the metrics of registered controllers in the
+ *    Prometheus text exposition format, to a string, to a file (written to
+ *    a temporary file and renamed, for the node exporter textfile collector)
+ *    or to every client connecting to a Unix socket.
+ */
+#ifndef METRICS_HPP_
+#define METRICS_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace LinMpcEigen {
+
+// lock-free histogram of latencies in seconds
+class LatencySummary {
+public:
+  static constexpr uint32_t n_buckets = 15;
+  static const std::array<double, n_buckets> bucket_bounds; // upper bounds [s], +Inf is implicit
+
+  void observe(double seconds);
+
+  uint64_t getCount() const;
+  double getSum() const; // [s]
+  double getMax() const; // [s]
+  uint64_t getBucketCount(uint32_t bucket) const; // observations <= bucket_bounds[bucket], cumulative
+
+private:
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_ns_{0};
+  std::atomic<uint64_t> max_ns_{0};
+  std::array<std::atomic<uint64_t>, n_buckets> buckets_{}; // non-cumulative
+};
+
+struct MpcMetrics {
+  std::atomic<uint64_t> solves{0};
+  std::atomic<uint64_t> failures{0};        // status other than solved / solved inaccurate
+  std::atomic<uint64_t> infeasible{0};      // primal or dual infeasible (also inaccurate)
+  std::atomic<uint64_t> time_limit_hits{0};
+  std::atomic<uint64_t> iterations{0};      // sum over all solves
+  std::atomic<uint64_t> updates{0};
+  std::atomic<uint64_t> warm_starts{0};     // solves started from a previous or a set iterate
+  std::atomic<uint64_t> skipped_solves{0};  // releases skipped by the MultiRateExecutor
+  std::atomic<int> last_status{0};
+  std::atomic<uint32_t> last_iterations{0};
+  LatencySummary update_latency;
+  LatencySummary solve_latency;
+
+  void recordSolve(int status, uint32_t solve_iterations, double latency, bool warm_started);
+  void recordUpdate(double latency);
+  double getWarmStartRatio() const; // warm_starts / solves
+  double getSkipRatio() const;      // skipped_solves / (solves + skipped_solves)
+};
+
+class MetricsExporter {
+public:
+  MetricsExporter() = default;
+  ~MetricsExporter();
+
+  MetricsExporter(const MetricsExporter &) = delete;
+  MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+  // the metrics need to outlive the exporter, the name is used as the "controller" label
+  void add(const std::string &controller_name, const MpcMetrics &metrics);
+
+  void render(std::ostream &stream) const;
+  std::string render() const;
+  void writeToFile(const std::string &file_path) const;
+
+  // background thread answering every connection with render(), replaces an existing socket file
+  void serveUnixSocket(const std::string &socket_path);
+  void stopServing();
+
+private:
+  void serveLoop(int socket_fd);
+
+  std::vector< std::pair<std::string, const MpcMetrics *> > controllers_;
+  mutable std::mutex mutex_;
+
+  std::thread server_;
+  std::string socket_path_;
+  std::atomic<bool> stop_{false};
+};
+}
+#endif //METRICS_HPP_
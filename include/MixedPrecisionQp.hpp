@@ -0,0 +1,106 @@
+/**
+ * @file MixedPrecisionQp.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Mixed-precision ADMM QP solver
+ *
+ *    Solves the same QP as OsqpEigenOpt:
+ *
+ *      min 	1 / 2 * x^T * A_qp * x + b_qp^T * x
+ *       x
+ *
+ *      s.t.	A_eq * x + b_eq = 0
+ *            A_ieq * x + b_ieq <= 0
+ *            lower_bound <= x <= upper_bound
+ *
+ *    with the OSQP ADMM iteration. The reduced KKT matrix
+ *
+ *      K = A_qp + sigma * I + A^T * diag(rho) * A
+ *
+ *    is factorized in single precision. The solver iterates in single
+ *    precision until single_precision_tolerance is reached or after
+ *    single_precision_max_iteration iterations, and then continues in
+ *    double precision for up to max_iteration iterations of the settings.
+ *    In the double precision phase,
+ *    every linear solve with the single precision factorization is
+ *    followed by refinement_steps residual corrections against the
+ *    double precision K, so the final accuracy is that of a double
+ *    precision solve while the factorization and most iterations run
+ *    at single precision cost.
+ *
+ *    As in OSQP, the problem is Ruiz scaled (settings.scaling iterations)
+ *    and rho is adapted to the residual ratio every adaptive_rho_interval
+ *    iterations if settings.adaptive_rho, refactorizing K. There is no
+ *    infeasibility detection and no polishing.
+ *
+ *    For bounds-only QPs a structure exploiting KktSolver (RiccatiKktSolver)
+ *    can replace the sparse factorization. The iterations then run in double
+ *    precision only.
+ */
+#ifndef MIXED_PRECISION_QP_HPP_
+#define MIXED_PRECISION_QP_HPP_
+
+#include <memory>
+#include <Eigen/SparseCholesky>
+
+#include "OsqpEigenOptimization.hpp"
+#include "RiccatiKktSolver.hpp"
+
+using VecNf = Eigen::VectorXf;
+using SparseMatf = Eigen::SparseMatrix<float>;
+
+class MixedPrecisionQpSolver 
+{
+public:
+  MixedPrecisionQpSolver( const SparseQpProblem &qp_problem, const OsqpSettings &settings,
+                          double time_limit = 0.0, uint32_t refinement_steps = 2,
+                          double single_precision_tolerance = 1e-3, 
+                          uint32_t single_precision_max_iteration = 1000 );
+  MixedPrecisionQpSolver( const SparseQpProblem &qp_problem, const OsqpSettings &settings,
+                          std::unique_ptr<KktSolver> kkt_solver, double time_limit = 0.0 );
+
+  void updateGradient(const VecNd &b_qp);
+  void updateGradientAndIeqConstraint(const VecNd &b_qp, const VecNd &b_ieq);
+  void setPrimalWarmStart(const VecNd &primal_variable);
+
+  VecNd solveProblem();
+  int getStatus() const; // OSQP status codes
+  uint32_t getIterations() const;
+  bool isWarmStarted() const; // the next solve starts from the last iterate or a set warm start
+
+private:
+  OsqpSettings settings_;
+  double time_limit_;
+  uint32_t refinement_steps_;
+  double single_precision_tolerance_;
+  uint32_t single_precision_max_iteration_;
+
+  uint32_t n_; // number of optimization variables
+  uint32_t m_; // number of constraints
+
+  double inf = 1e100;
+
+  SparseMat P_, A_, K_;
+  SparseMatf P_f_, A_f_;
+  VecNd q_, lower_bound_, upper_bound_, rho_; // scaled problem data
+
+  // Ruiz scaling, x = D * x_s, the cost is scaled by cost_scaling_
+  VecNd D_, E_;
+  double cost_scaling_ = 1.0;
+
+  Eigen::SimplicialLDLT<SparseMatf> K_f_ldlt_;
+  std::unique_ptr<KktSolver> kkt_solver_;
+
+  VecNd x_, z_, y_; // ADMM iterate of the scaled problem, kept as warm start
+  bool has_iterate_ = false; // solved or warm started since construction
+
+  int status_ = OSQP_UNSOLVED;
+  uint32_t iterations_ = 0;
+
+  void setupConstraints(const SparseQpProblem &qp_problem);
+  void scaleProblem();
+  void factorize(); // K for the current rho
+  VecNd refinedSolve(const VecNd &rhs) const;
+};
+
+#endif //MIXED_PRECISION_QP_HPP_
@@ -0,0 +1,103 @@
+/**
+ * @file MonteCarlo.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Parallel Monte Carlo robustness harness
+ *
+ *    Runs closed-loop simulations of a MPC controller against randomly
+ *    perturbed versions of a nominal linear system:
+ *
+ *      x(k+1) = (A + dA) * x(k) + (B + dB) * u(k) + w(k)
+ *
+ *    where dA, dB are relative perturbations of the nonzero entries of
+ *    A and B, and w(k) is process noise. The controller is always built
+ *    on the nominal system and sees x(k) + v(k) (measurement noise).
+ *
+ *    Scenarios are distributed over a thread pool, every worker owns its
+ *    own MPC object created by the user supplied MpcFactory. Scenario i is
+ *    simulated with a random generator seeded with (seed, i) and starts
+ *    from a freshly initialized solver (no warm start carried over from
+ *    the previous scenario of the worker), so results do not depend on
+ *    the number of threads.
+ */
+#ifndef MONTE_CARLO_HPP_
+#define MONTE_CARLO_HPP_
+
+#include <vector>
+
+#include "LinMpcEigen.hpp"
+
+namespace LinMpcEigen {
+
+struct PerturbationDistribution {
+  double A_relative_std = 0.0; // std of the relative perturbation of each nonzero of A
+  double B_relative_std = 0.0; // std of the relative perturbation of each nonzero of B
+  VecNd process_noise_std;     // n_x vector, empty - no process noise
+  VecNd measurement_noise_std; // n_x vector, empty - no measurement noise
+};
+
+struct ScenarioSpec {
+  uint32_t n_scenarios = 1;
+  uint32_t n_steps = 1;  // closed-loop steps per scenario
+  VecNd x0;              // initial state
+  VecNd Y_d_full;        // output reference, (n_steps + N) * n_y vector
+  
+  // bounds used for constraint violation statistics, empty - not checked
+  VecNd u_lower_bound, u_upper_bound;
+  VecNd x_lower_bound, x_upper_bound;
+  double violation_tolerance = 1e-4;
+
+  uint64_t seed = 0;
+  uint32_t n_threads = 0; // 0 - std::thread::hardware_concurrency()
+};
+
+struct ScenarioResult {
+  double tracking_rmse = 0.0;
+  double tracking_max_error = 0.0;
+  uint32_t n_constraint_violations = 0;
+  double max_constraint_violation = 0.0;
+  uint32_t n_solver_failures = 0; // solves not ending with OSQP_SOLVED
+  std::vector<double> solve_times; // seconds, updateSolver + solve, per step
+};
+
+struct MonteCarloStatistics {
+  std::vector<ScenarioResult> scenarios;
+
+  double tracking_rmse_mean = 0.0;
+  double tracking_rmse_max = 0.0;
+  double tracking_max_error = 0.0;
+
+  uint32_t n_violating_scenarios = 0;
+  uint64_t n_constraint_violations = 0;
+  double max_constraint_violation = 0.0;
+
+  uint64_t n_solves = 0;
+  uint64_t n_solver_failures = 0;
+
+  // solver timing over all steps of all scenarios [s]
+  double solve_time_mean = 0.0;
+  double solve_time_p50 = 0.0;
+  double solve_time_p99 = 0.0;
+  double solve_time_max = 0.0;
+};
+
+std::ostream& operator<< (std::ostream& stream, const MonteCarloStatistics& stats);
+
+class MonteCarloHarness {
+public:
+  MonteCarloHarness(const LinearSystem &nominal_system, 
+                    const PerturbationDistribution &perturbation,
+                    const MpcFactory &mpc_factory);
+
+  MonteCarloStatistics run(const ScenarioSpec &spec) const;
+
+private:
+  LinearSystem nominal_system_;
+  PerturbationDistribution perturbation_;
+  MpcFactory mpc_factory_;
+
+  void checkSpecDimensions(const ScenarioSpec &spec, uint32_t horizon) const;
+  ScenarioResult runScenario(uint32_t scenario_index, const ScenarioSpec &spec, MPC &mpc) const;
+};
+}
+#endif //MONTE_CARLO_HPP_
@@ -0,0 +1,114 @@
+/**
+ * @file MpcBuilder.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Declarative MPC formulation
+ *
+ *    Cost terms and constraints are declared on a MpcBuilder, build() assembles the QP in one pass.
+ *    Every cost term is a weighted residual that is affine in U and in the parameters 
+ *    p = [x0; Y_d; u_prev]:
+ *
+ *      r_i = S_i * U + T_i * p,    cost = sum ||r_i||^2
+ *
+ *    The residuals are stacked into S and T, so A_qp = S^T * S and the gradient map b_qp = S^T * T * p 
+ *    are one sparse product each. Constraints are stacked the same way, b_ieq = H * p + h.
+ *
+ *    The update plan lists which parameters enter the gradient and the constraints, 
+ *    ComposedMPC::updateSolver() evaluates only those parts.
+ */
+#ifndef MPC_BUILDER_HPP_
+#define MPC_BUILDER_HPP_
+
+#include "LinMpcEigen.hpp"
+
+namespace LinMpcEigen {
+
+// parameter dependent parts of the QP updated on every updateSolver() call
+struct MpcUpdatePlan {
+  bool gradient_x0 = false;
+  bool gradient_Y_d = false;
+  bool gradient_u_prev = false;
+  bool constraints_x0 = false; // b_ieq depends on x0
+};
+
+class ComposedMPC {
+public:
+  // u_prev - input applied in the previous step, only used by an input rate penalty (zero if empty)
+  void updateSolver(const VecNd &Y_d, const VecNd &x0, const VecNd &u_prev = VecNd());
+  VecNd solve() const;
+  int getSolverStatus() const;
+
+  VecNd calculateX(const VecNd &U_in) const;
+  VecNd calculateY(const VecNd &U_in) const;
+
+  const SparseQpProblem &getQpProblem() const;
+  const MpcUpdatePlan &getUpdatePlan() const;
+
+private:
+  friend class MpcBuilder;
+  ComposedMPC(const LinearSystem &linear_system, uint32_t horizon);
+
+  LinearSystem linear_system_;
+  uint32_t N_;
+  VecNd x0_;
+
+  SparseMat A_mpc_, B_mpc_, C_mpc_;
+
+  // b_qp = gradient_x0_map_ * x0 + gradient_Y_d_map_ * Y_d + gradient_u_prev_map_ * u_prev
+  SparseMat gradient_x0_map_, gradient_Y_d_map_, gradient_u_prev_map_;
+  // b_ieq = constraint_x0_map_ * x0 + constraint_offset_
+  SparseMat constraint_x0_map_;
+  VecNd constraint_offset_;
+  MpcUpdatePlan update_plan_;
+
+  std::unique_ptr<SparseQpProblem> qp_problem_;
+  std::unique_ptr<OsqpEigenOpt> osqp_eigen_opt_;
+
+  void checkParameterDimensions(const VecNd &Y_d, const VecNd &x0, const VecNd &u_prev) const;
+  VecNd parameterGradient(const VecNd &Y_d, const VecNd &x0, const VecNd &u_prev) const;
+};
+
+class MpcBuilder {
+public:
+  MpcBuilder(const LinearSystem &linear_system, uint32_t horizon);
+
+  // cost terms, k = 0..N-1 for inputs and outputs, k = 1..N for states
+  MpcBuilder &addOutputTracking(const SparseMat &w_y);    // sum ||w_y * (y(k) - y_d(k))||^2
+  MpcBuilder &addInputEffort(const SparseMat &w_u);       // sum ||w_u * u(k)||^2
+  MpcBuilder &addStatePenalty(const SparseMat &w_x);      // sum ||w_x * x(k)||^2
+  MpcBuilder &addInputRatePenalty(const SparseMat &w_du); // sum ||w_du * (u(k) - u(k-1))||^2, u(-1) = u_prev
+
+  // constraints, infinite state bounds are dropped
+  MpcBuilder &addInputBounds(const VecNd &u_lower_bound, const VecNd &u_upper_bound);
+  MpcBuilder &addStateBounds(const VecNd &x_lower_bound, const VecNd &x_upper_bound);
+  MpcBuilder &addInputConstraint(const SparseMat &G, const VecNd &h); // G * U + h <= 0
+
+  MpcBuilder &setSolverSettings(const OsqpSettings &solver_settings, double solver_time_limit = 0.0);
+
+  // assembles the QP and initializes the solver
+  std::unique_ptr<ComposedMPC> build(const VecNd &Y_d, const VecNd &x0, const VecNd &u_prev = VecNd()) const;
+
+private:
+  LinearSystem linear_system_;
+  uint32_t N_;
+
+  SparseMat A_mpc_, B_mpc_, C_mpc_;
+
+  // stacked cost residuals r = S * U + T * [x0; Y_d; u_prev]
+  std::vector<SparseMat> residual_S_, residual_T_;
+  // stacked inequality constraints A_ieq * U + H * x0 + h <= 0
+  std::vector<SparseMat> constraint_A_, constraint_H_;
+  std::vector<VecNd> constraint_h_;
+
+  VecNd u_lower_bound_, u_upper_bound_;
+
+  OsqpSettings solver_settings_;
+  double solver_time_limit_ = 0.0;
+
+  uint32_t numberOfParameters() const;
+  void checkWeight(const SparseMat &weight, uint32_t cols, const char *name) const;
+};
+
+} // namespace LinMpcEigen
+
+#endif //MPC_BUILDER_HPP_
@@ -0,0 +1,153 @@
+/**
+ * @file MpcService.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Shared-memory MPC service for several processes on one machine
+ *
+ *    MpcService hosts initialized MPC controllers in one process and
+ *    publishes them in a POSIX shared memory segment (shm_open). Every
+ *    controller has a fixed number of request slots, each holding x0, Y_d,
+ *    the solution U and a state word. Clients (MpcServiceClient) map the
+ *    same segment, claim a slot, write x0 and Y_d in place, submit it and
+ *    read U in place. Nothing is serialized or sent through a socket.
+ *    Waiting on both sides uses process-shared futexes (Linux), so an idle
+ *    service and a waiting client do not spin. Each controller is served
+ *    by its own thread, pinned to its cores, with the real-time settings
+ *    applied in one place.
+ *
+ *    Slot states: FREE -> CLAIMED (client) -> PENDING (client submit)
+ *                 -> SOLVING -> DONE (service) -> FREE (client release)
+ *
+ *    A slot records the pid of the client that claimed it. The service
+ *    checks the owners of claimed and served slots every 100 ms while idle
+ *    (kill(pid, 0)) and frees the slots of clients that exited without
+ *    release(). Clients see a service that died through its pid in the
+ *    segment header. The checks need the service and all clients in one
+ *    PID namespace, and a slot of a dead client whose pid has already been
+ *    reused stays claimed until that process exits.
+ */
+#ifndef MPC_SERVICE_HPP_
+#define MPC_SERVICE_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LinMpcEigen.hpp"
+#include "RealTime.hpp"
+
+namespace LinMpcEigen {
+
+// status of a request that failed in the service (exception in updateSolver() / solve())
+const int MPC_SERVICE_ERROR = -1000;
+
+class MpcService {
+public:
+  // shm_name: "/name" of the shared memory segment
+  explicit MpcService(const std::string &shm_name, uint32_t slots_per_controller = 4);
+  ~MpcService(); // stops the service and removes the segment
+
+  MpcService(const MpcService &) = delete;
+  MpcService &operator=(const MpcService &) = delete;
+
+  // initialized MPC, cpu_cores: allowed cores of the serving thread (empty - settings.cpu_cores)
+  uint32_t addController( const std::string &name, std::unique_ptr<MPC> mpc,
+                          const std::vector<int> &cpu_cores = {} );
+  // real-time settings applied by start(), see MultiRateExecutor::setRealTimeSettings()
+  void setRealTimeSettings(const RealTimeSettings &settings);
+
+  void start(); // creates the segment and starts serving
+  void stop();  // pending requests are not served, waiting clients time out
+  bool isRunning() const;
+
+  uint32_t getNumControllers() const;
+  uint64_t getServedRequests(uint32_t controller_id) const;
+  RealTimeReport getRealTimeReport() const;
+  const MPC &getController(uint32_t controller_id) const;
+
+private:
+  struct Controller {
+    std::string name;
+    std::unique_ptr<MPC> mpc;
+    std::vector<int> cpu_cores;
+    VecNd x0, Y_d;
+    std::thread thread;
+  };
+
+  void serveLoop(uint32_t controller_id);
+  void reclaimAbandonedSlots(uint32_t controller_id); // slots claimed by clients that died
+  void checkId(uint32_t controller_id) const;
+
+  std::string shm_name_;
+  uint32_t slots_per_controller_;
+  std::vector<Controller> controllers_;
+
+  char *segment_ = nullptr;
+  size_t segment_size_ = 0;
+  std::atomic<bool> running_{false};
+
+  bool real_time_ = false;
+  RealTimeSettings real_time_settings_;
+  RealTimeReport real_time_report_;
+  mutable std::mutex report_mutex_;
+};
+
+// Slot of a controller claimed by a client. x0 and Y_d are written and U is read directly
+// in the shared memory, the maps are valid until release()
+class MpcServiceRequest {
+public:
+  bool valid() const { return state_ != nullptr; }
+  Eigen::Map<VecNd> x0() { return Eigen::Map<VecNd>(x0_, n_x_); }
+  Eigen::Map<VecNd> Y_d() { return Eigen::Map<VecNd>(Y_d_, n_Y_); }
+  Eigen::Map<const VecNd> U() const { return Eigen::Map<const VecNd>(U_, n_U_); }
+
+private:
+  friend class MpcServiceClient;
+
+  std::atomic<uint32_t> *state_ = nullptr;
+  std::atomic<int32_t> *owner_ = nullptr;
+  int32_t *status_ = nullptr;
+  std::atomic<uint32_t> *doorbell_ = nullptr;
+  double *x0_ = nullptr, *Y_d_ = nullptr, *U_ = nullptr;
+  uint32_t n_x_ = 0, n_Y_ = 0, n_U_ = 0;
+};
+
+class MpcServiceClient {
+public:
+  // throws if the segment does not exist or the service is not running yet
+  explicit MpcServiceClient(const std::string &shm_name);
+  ~MpcServiceClient();
+
+  MpcServiceClient(const MpcServiceClient &) = delete;
+  MpcServiceClient &operator=(const MpcServiceClient &) = delete;
+
+  uint32_t findController(const std::string &name) const; // throws if unknown
+  uint32_t getNumControllers() const;
+  uint32_t getStateSize(uint32_t controller_id) const;     // n_x
+  uint32_t getReferenceSize(uint32_t controller_id) const; // horizon * n_y
+  uint32_t getSolutionSize(uint32_t controller_id) const;  // horizon * n_u
+  bool isServiceRunning() const;
+
+  // claims a free slot, invalid request if all slots of the controller are in use
+  MpcServiceRequest acquire(uint32_t controller_id);
+  void submit(MpcServiceRequest &request);
+  // true if the request was served within timeout [s], U() and status() are valid then
+  bool wait(MpcServiceRequest &request, double timeout);
+  int status(const MpcServiceRequest &request) const; // OSQP status or MPC_SERVICE_ERROR
+  void release(MpcServiceRequest &request);
+
+  // acquire, copy, submit, wait and release, throws on timeout or if no slot is free
+  VecNd solve(uint32_t controller_id, const VecNd &x0, const VecNd &Y_d, double timeout = 1.0);
+
+private:
+  const void *descriptor(uint32_t controller_id) const;
+
+  char *segment_ = nullptr;
+  size_t segment_size_ = 0;
+};
+}
+#endif //MPC_SERVICE_HPP_
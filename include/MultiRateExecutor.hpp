@@ -0,0 +1,143 @@
+/**
+ * @file MultiRateExecutor.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Rate-monotonic executor for several MPC controllers running at
+ *    different periods in one process
+ *
+ *    Every controller is released periodically. A release runs
+ *
+ *      update(mpc)   - user callback, reads the measurements and calls mpc.updateSolver(...)
+ *      U = mpc.solve()
+ *      apply(U)      - user callback, sends the control input
+ *
+ *    on a pool of worker threads. Ready jobs are started in rate-monotonic
+ *    order (shorter period - higher priority). Solves are not preemptible,
+ *    so the pool keeps workers in reserve for the faster controllers:
+ *    the controller with priority rank r (0 - fastest) only starts while
+ *    fewer than n_workers - min(r, n_workers - 1) workers are busy. With
+ *    n_workers >= 2 the fastest controller always finds a free worker, in
+ *    general the n_workers - 1 fastest controllers are never blocked by
+ *    slower solves.
+ *
+ *    A release that finds the previous job of the same controller still
+ *    queued or running is skipped and counted as a deadline miss.
+ *
+ *    In real-time mode (setRealTimeSettings()) start() locks and prefaults
+ *    the memory of all controllers, pins the threads to the configured cores
+ *    and runs them with SCHED_FIFO. A worker runs a job at the priority
+ *    settings.priority + (number of controllers - 1 - rank), so controllers
+ *    sharing a core are also preempted in rate-monotonic order. Idle workers
+ *    wait at the highest job priority and the scheduler thread runs above
+ *    all jobs.
+ */
+#ifndef MULTI_RATE_EXECUTOR_HPP_
+#define MULTI_RATE_EXECUTOR_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LinMpcEigen.hpp"
+#include "RealTime.hpp"
+
+namespace LinMpcEigen {
+
+struct ControllerSpec {
+  std::string name;
+  double period = 0.0;   // [s]
+  double deadline = 0.0; // relative to the release [s], 0 - equal to the period
+  std::function<void(MPC &mpc)> update;     // called before every solve
+  std::function<void(const VecNd &U)> apply; // called with every solution, can be empty
+};
+
+struct ControllerStats {
+  uint64_t releases = 0;
+  uint64_t completions = 0;
+  uint64_t deadline_misses = 0;     // late completions and skipped releases
+  uint64_t skipped_releases = 0;    // previous job still queued or running
+  double worst_response_time = 0.0; // release to completion [s]
+  double mean_execution_time = 0.0; // update + solve + apply [s]
+  double utilization = 0.0;         // execution time / time since start()
+};
+
+class MultiRateExecutor {
+public:
+  explicit MultiRateExecutor(uint32_t n_workers = 2);
+  ~MultiRateExecutor();
+
+  MultiRateExecutor(const MultiRateExecutor &) = delete;
+  MultiRateExecutor &operator=(const MultiRateExecutor &) = delete;
+
+  // The MPC needs to be initialized (initializeSolver()). Returns the controller id,
+  // controllers can only be added while the executor is stopped
+  uint32_t addController(std::unique_ptr<MPC> mpc, const ControllerSpec &spec);
+
+  // used by the next start()
+  void setRealTimeSettings(const RealTimeSettings &settings);
+  void disableRealTimeMode();
+  // everything the last start() could not lock, pin or prioritize
+  RealTimeReport getRealTimeReport() const;
+
+  // first releases of all controllers at start()
+  void start();
+  // waits for the running jobs, rethrows the first exception thrown by a job
+  void stop();
+  bool isRunning() const;
+
+  uint32_t size() const;
+  uint32_t getPriorityRank(uint32_t controller_id) const; // 0 - highest priority
+  ControllerStats getStats(uint32_t controller_id) const;
+  double getTotalUtilization() const; // sum of the controller utilizations
+  // only while the executor is stopped
+  MPC &getController(uint32_t controller_id);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Controller {
+    std::unique_ptr<MPC> mpc;
+    ControllerSpec spec;
+    uint32_t rank = 0;
+    bool pending = false; // queued or running
+    Clock::time_point next_release, job_release;
+    double execution_time = 0.0; // total [s]
+    ControllerStats stats;
+  };
+
+  void schedulerLoop();
+  void workerLoop();
+  // highest priority pending controller that may start now, -1 if there is none
+  int selectJob() const;
+  void runJob(Controller &controller);
+  void checkId(uint32_t controller_id) const;
+  void configureThread(int priority);
+  int jobPriority(const Controller &controller) const;
+
+  std::vector<Controller> controllers_;
+  uint32_t n_workers_;
+  uint32_t busy_workers_ = 0;
+  std::vector<uint32_t> ready_; // controllers released and not started yet
+
+  std::thread scheduler_;
+  std::vector<std::thread> workers_;
+  mutable std::mutex mutex_;
+  std::condition_variable scheduler_cv_;
+  std::condition_variable work_cv_;
+  bool running_ = false;
+  Clock::time_point start_time_, stop_time_;
+
+  bool real_time_ = false;
+  RealTimeSettings real_time_settings_;
+  RealTimeReport real_time_report_;
+
+  std::exception_ptr exception_;
+};
+}
+#endif //MULTI_RATE_EXECUTOR_HPP_
@@ -17,6 +17,7 @@
 #define OSQP_EIGEN_OPTIMIZATION_HPP_
 
 #include <iostream>
+#include <string>
 #include <vector>
 #include <OsqpEigen/OsqpEigen.h>
 
@@ -25,32 +26,105 @@
 using VecNd = Eigen::VectorXd;
 using MatNd = Eigen::MatrixXd;
 
+// OSQP solver settings, the default values are the settings used by the library so far
+struct OsqpSettings {
+  double alpha = 1.0;               // ADMM relaxation parameter
+  double rho = 0.1;                 // ADMM step size (initial value if adaptive_rho)
+  double sigma = 1e-6;              // ADMM regularization parameter
+  double absolute_tolerance = 1e-6;
+  double relative_tolerance = 1e-6;
+  uint32_t max_iteration = 10000;
+  bool adaptive_rho = true;
+  uint32_t adaptive_rho_interval = 5; // 0 - automatic
+  uint32_t scaling = 10;            // Ruiz scaling iterations, 0 - no scaling
+  bool polish = false;              // solution polishing
+  uint32_t polish_refine_iter = 3;
+  uint32_t check_termination = 25;  // termination check interval, 0 - never
+  bool warm_start = true;
+  linsys_solver_type linear_system_solver = QDLDL_SOLVER;
+  bool verbosity = false;
+
+  // named profiles
+  static OsqpSettings lowLatency();   // 1e-3 tolerances, frequent termination checks
+  static OsqpSettings highAccuracy(); // tight tolerances and polishing
+  static OsqpSettings embedded();     // 1e-3 tolerances, fixed rho and a low iteration cap
+  // "default", "low-latency", "high-accuracy" or "embedded"
+  static OsqpSettings fromProfile(const std::string &profile_name);
+
+  // "key = value" text format, keys are the member names, missing keys keep their default values
+  void save(std::ostream &stream) const;
+  static OsqpSettings load(std::istream &stream);
+  void saveToFile(const std::string &file_path) const;
+  static OsqpSettings loadFromFile(const std::string &file_path);
+};
+
+// result of OsqpEigenOpt::solveProblemWithinBudget()
+struct OsqpSolveInfo {
+  int status = OSQP_UNSOLVED;   // OSQP_SOLVED if the settings tolerances were reached, 
+                                // OSQP_SOLVED_INACCURATE if only a looser tolerance was reached
+  double tolerance = 0.0;       // tolerance reached by the returned iterate, 0 if no pass converged
+  double primal_residual = 0.0; // residuals of the returned iterate
+  double dual_residual = 0.0;
+  uint32_t iterations = 0;      // sum over all passes
+  uint32_t passes = 0;
+  double solve_time = 0.0;      // [s]
+};
+
 class OsqpEigenOpt 
 {    
 public:
   OsqpEigenOpt( );
   OsqpEigenOpt(	const SparseQpProblem &sparse_qp_problem, 
                 double time_limit = 0.0, bool verbosity = false );
+  OsqpEigenOpt(	const SparseQpProblem &sparse_qp_problem, 
+                double time_limit, const OsqpSettings &settings );
 
   void initializeSolver(const SparseQpProblem &sparse_qp_problem, 
                         double time_limit, bool verbosity );
+  void initializeSolver(const SparseQpProblem &sparse_qp_problem, 
+                        double time_limit, const OsqpSettings &settings );
 
   void setGradientAndInit(VecNd &b_qp); 
   void setGradientIeqConstraintAndInit(VecNd &b_qp, VecNd &b_ieq); 
+  // in-place updates, keep the solver workspace (scaling, factorization) and warm start
+  void updateGradient(const VecNd &b_qp);
+  void updateGradientAndIeqConstraint(const VecNd &b_qp, const VecNd &b_ieq);
 
+  void setPrimalWarmStart(const VecNd &primal_variable); // call after the last update, before solving
+  // last solution (primal, dual) and the current, possibly adapted, rho, empty vectors before the first solve
+  void getIterate(VecNd &primal_variable, VecNd &dual_variable, double &rho) const;
+  // warm starts the next solve from an iterate returned by getIterate() for the same problem
+  void setIterate(const VecNd &primal_variable, const VecNd &dual_variable, double rho);
   VecNd solveProblem();
+  // Solves with loose tolerances first, then tightens them by tightening_factor while the time budget 
+  // [s] lasts, down to the settings tolerances. Every pass is warm started from the previous one. 
+  // Returns the most accurate iterate reached within the budget. If the budget expires before the first
+  // pass, returns the primal iterate the next solve would start from (a set warm start, the last solution
+  // or zeros after initialization) with the status OSQP_TIME_LIMIT_REACHED.
+  VecNd solveProblemWithinBudget( double time_budget, OsqpSolveInfo &solve_info,
+                                  double initial_tolerance = 1e-2, double tightening_factor = 0.1 );
 
   bool checkFeasibility(); 
+  int getStatus() const; // OSQP status of the last solve (OSQP_SOLVED, ...)
+  uint32_t getIterations() const; // ADMM iterations of the last solve
+  // true if the next solve starts from the last iterate or a set warm start instead of zero
+  bool isWarmStarted() const;
 
 private:
   OsqpEigen::Solver solver_;
 
   double alpha_;
+  double time_limit_ = 0.0;
+  double absolute_tolerance_ = 1e-6;
+  double relative_tolerance_ = 1e-6;
 
   uint32_t n_; //number of optimization variables
   uint32_t m_; //number of constraints
 
   double inf = 1e100;
+  bool has_iterate_ = false; // solved or warm started since the last initialization
+  VecNd warm_start_primal_;  // set by the last warm start, used by the next solve if warm_start_pending_
+  bool warm_start_pending_ = false;
 
   VecNd b_qp_, lower_bound_, upper_bound_;
   SparseMat linearConstraintsMatrix_;
@@ -0,0 +1,58 @@
+/**
+ * @file PerfCounters.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Hardware performance counters of the calling thread (Linux perf_event_open)
+ *
+ *    Counts CPU cycles, instructions, cache misses and branch misses in
+ *    user space between start() and stop(). The counters are opened as one
+ *    group (the first available counter leads it), so they are scheduled together and
+ *    ratios such as IPC are taken over the same window. When the PMU is
+ *    multiplexed, the counts are scaled by time_enabled / time_running.
+ *    A counter that is not supported (no PMU in a VM, perf_event_paranoid,
+ *    seccomp, non-Linux systems) is reported as not available while the
+ *    others keep counting.
+ */
+#ifndef PERF_COUNTERS_HPP_
+#define PERF_COUNTERS_HPP_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace LinMpcEigen {
+
+struct PerfCounterValues {
+  enum Counter { CYCLES = 0, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, N_COUNTERS };
+
+  std::array<uint64_t, N_COUNTERS> values{};
+  std::array<bool, N_COUNTERS> available{};
+
+  // instructions per cycle, 0 if cycles or instructions are not available
+  double ipc() const;
+};
+
+class PerfCounters {
+public:
+  PerfCounters();
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  bool isAvailable(PerfCounterValues::Counter counter) const;
+  bool anyAvailable() const;
+  const std::string &getError() const; // why counters are not available, empty if all are
+
+  void start();
+  PerfCounterValues stop();
+
+private:
+  std::array<int, PerfCounterValues::N_COUNTERS> fds_;
+  // counter groups, the first counter of a group is its leader
+  std::vector< std::vector<uint32_t> > groups_;
+  std::string error_;
+};
+}
+#endif //PERF_COUNTERS_HPP_
@@ -0,0 +1,424 @@
+/**
+ * @file PolicyMpc.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Cost and constraint policies of the MPC formulations
+ *
+ *    The policies are the single implementation of the condensed QP of every formulation. 
+ *    PolicyMPC<CostPolicy, ConstraintPolicy> composes them at compile time, each instantiation stores
+ *    only the data of its own policies and its update code is inlined. The runtime MPC class creates the
+ *    MpcPolicyPair of its mpc_type in the constructor and delegates the QP setup and update to it:
+ *
+ *      MPC1                      OutputTrackingCost
+ *      MPC1_BOUND_CONSTRAINED    OutputTrackingCost, InputBounds
+ *      MPC2                      WeightedCost
+ *      MPC2_BOUND_CONSTRAINED    WeightedCost, InputBounds
+ *      MPC2_BOUND_CONSTRAINED_2  WeightedCost, StateBounds of x[1] only (no input bounds)
+ *
+ *    A cost policy provides:
+ *      void setup(const LinearSystem &linear_system, uint32_t horizon, const SparseMat &A_mpc, const SparseMat &B_mpc);
+ *      SparseMat hessian() const;
+ *      VecNd gradient(const VecNd &Y_d, const VecNd &x0) const;
+ *      MatNd gradientX0Map() const;   // b_qp = gradientX0Map() * x0 + gradientYdMap() * Y_d
+ *      MatNd gradientYdMap() const;
+ *
+ *    A constraint policy provides:
+ *      static constexpr bool x0_dependent;   // true if b_ieq depends on x0
+ *      void setup(const SparseMat &A_mpc, const SparseMat &B_mpc, const VecNd &x0, SparseQpProblem &qp_problem);
+ *      VecNd inequalityOffset(const VecNd &x0) const;   // b_ieq, used if x0_dependent
+ *
+ *    New formulations are added as new policies, without touching the existing ones:
+ *
+ *      PolicyMPC<WeightedCost, CombinedConstraints<InputBounds, StateBounds>> mpc(
+ *        system, N, Y_d, x0, WeightedCost(W_y, w_u, w_x), 
+ *        CombinedConstraints<InputBounds, StateBounds>(InputBounds(u_lb, u_ub), StateBounds(x_lb, x_ub)) );
+ */
+#ifndef POLICY_MPC_HPP_
+#define POLICY_MPC_HPP_
+
+#include "LinMpcEigen.hpp"
+
+namespace LinMpcEigen {
+
+// -------------- cost policies -----------------
+
+// MPC I: Q * ||Y - Y_d||^2 + R * ||U||^2
+struct OutputTrackingCost {
+  OutputTrackingCost(double Q, double R) : Q(Q), R(R) {}
+
+  void setup(const LinearSystem &linear_system, uint32_t horizon, const SparseMat &A_mpc, const SparseMat &B_mpc) 
+  {
+    C_A = applyOutputMatrix(linear_system, horizon, A_mpc);
+    C_B = applyOutputMatrix(linear_system, horizon, B_mpc);
+    Q_C_A_T = Q * SparseMat(C_A.transpose());
+    Q_C_A_T_C_B = Q_C_A_T * C_B;
+  }
+  SparseMat hessian() const 
+  {
+    SparseMat identity(C_A.cols(), C_A.cols());
+    identity.setIdentity();
+    return Q * (C_A).transpose() * (C_A) + R * identity;
+  }
+  VecNd gradient(const VecNd &Y_d, const VecNd &x0) const 
+  {
+    return Q_C_A_T_C_B * x0 - Q_C_A_T * Y_d;
+  }
+  MatNd gradientX0Map() const { return MatNd(Q_C_A_T_C_B); }
+  MatNd gradientYdMap() const { return -MatNd(Q_C_A_T); }
+
+  double Q, R;
+
+  // products stored by setup() for the gradient update
+  SparseMat C_A; // C_mpc * A_mpc
+  SparseMat C_B; // C_mpc * B_mpc
+  SparseMat Q_C_A_T, Q_C_A_T_C_B;
+};
+
+// MPC II: W_y * ||Y - Y_d||^2 + ||W_u * U||^2 + ||W_x * X||^2
+struct WeightedCost {
+  WeightedCost(double W_y, const SparseMat &w_u, const SparseMat &w_x) : W_y(W_y), w_u(w_u), w_x(w_x) {}
+
+  void setup(const LinearSystem &linear_system, uint32_t horizon, const SparseMat &A_mpc, const SparseMat &B_mpc) 
+  {
+    uint32_t n_u = linear_system.n_u;
+    uint32_t n_x = linear_system.n_x;
+    if ((uint32_t)w_u.rows() != n_u || (uint32_t)w_u.cols() != n_u || 
+        (uint32_t)w_x.rows() != n_x || (uint32_t)w_x.cols() != n_x) 
+      throw std::runtime_error("WeightedCost: w_u needs to be n_u x n_u and w_x needs to be n_x x n_x");
+
+    SparseMat W_x(horizon * n_x, horizon * n_x);
+    W_u = SparseMat(horizon * n_u, horizon * n_u);
+    for (uint32_t i = 0; i < horizon; i++) 
+    {
+      setSparseBlock(W_u, w_u, n_u * i, n_u * i);
+      setSparseBlock(W_x, w_x, n_x * i, n_x * i);
+    }
+    C_A = applyOutputMatrix(linear_system, horizon, A_mpc);
+    C_B = applyOutputMatrix(linear_system, horizon, B_mpc);
+    W_x_A = W_x * A_mpc;
+    W_x_B = W_x * B_mpc;
+  }
+  SparseMat hessian() const 
+  {
+    return W_y * (C_A).transpose() * (C_A) 
+           + W_u.transpose() * W_u 
+           + (W_x_A).transpose() * (W_x_A);
+  }
+  VecNd gradient(const VecNd &Y_d, const VecNd &x0) const 
+  {
+    return ( W_y * (C_B * x0 - Y_d).transpose() * C_A +
+             (W_x_B * x0).transpose() * (W_x_A) 
+             ).transpose();
+  }
+  MatNd gradientX0Map() const { return W_y * MatNd((C_A).transpose() * C_B) + (W_x_A).transpose() * (W_x_B); }
+  MatNd gradientYdMap() const { return -W_y * MatNd((C_A).transpose()); }
+
+  double W_y;
+  SparseMat w_u, w_x;
+
+  // products stored by setup() for the gradient update
+  SparseMat W_u; // blockdiag(w_u)
+  SparseMat C_A; // C_mpc * A_mpc
+  SparseMat C_B; // C_mpc * B_mpc
+  MatNd W_x_A; // W_x * A_mpc
+  MatNd W_x_B; // W_x * B_mpc
+};
+
+// -------------- constraint policies -----------------
+
+struct NoConstraints {
+  static constexpr bool x0_dependent = false;
+
+  void setup(const SparseMat &/*A_mpc*/, const SparseMat &/*B_mpc*/, const VecNd &/*x0*/, 
+             SparseQpProblem &/*qp_problem*/) const {}
+  VecNd inequalityOffset(const VecNd &/*x0*/) const { return VecNd(); }
+};
+
+// u_lower_bound <= u(k) <= u_upper_bound
+struct InputBounds {
+  static constexpr bool x0_dependent = false;
+
+  InputBounds(const VecNd &u_lower_bound, const VecNd &u_upper_bound) 
+    : u_lower_bound(u_lower_bound), u_upper_bound(u_upper_bound) {}
+
+  void setup(const SparseMat &A_mpc, const SparseMat &/*B_mpc*/, const VecNd &/*x0*/, 
+             SparseQpProblem &qp_problem) const 
+  {
+    uint32_t n_u = u_lower_bound.rows();
+    if (n_u == 0 || (uint32_t)u_upper_bound.rows() != n_u || A_mpc.cols() % n_u != 0) 
+      throw std::runtime_error("InputBounds: bounds need to be of size n_u");
+    uint32_t horizon = A_mpc.cols() / n_u;
+    qp_problem.lower_bound = u_lower_bound.colwise().replicate(horizon);
+    qp_problem.upper_bound = u_upper_bound.colwise().replicate(horizon);
+  }
+  VecNd inequalityOffset(const VecNd &/*x0*/) const { return VecNd(); }
+
+  VecNd u_lower_bound, u_upper_bound;
+};
+
+// x_lower_bound(j) <= x_j(k) <= x_upper_bound(j), k = 1..N, as inequality constraints on U for the 
+// state entries j in state_indices (all entries if empty). The bounds have size n_x.
+// The upper bound rows of all stages come first, then the lower bound rows, stage by stage
+struct StateBounds {
+  static constexpr bool x0_dependent = true;
+
+  StateBounds(const VecNd &x_lower_bound, const VecNd &x_upper_bound, 
+              const std::vector<uint32_t> &state_indices = std::vector<uint32_t>()) 
+    : x_lower_bound(x_lower_bound), x_upper_bound(x_upper_bound), state_indices(state_indices) {}
+
+  void setup(const SparseMat &A_mpc, const SparseMat &B_mpc, const VecNd &x0, 
+             SparseQpProblem &qp_problem) 
+  {
+    uint32_t n_x = B_mpc.cols();
+    if ((uint32_t)x_lower_bound.rows() != n_x || (uint32_t)x_upper_bound.rows() != n_x) 
+      throw std::runtime_error("StateBounds: bounds need to be of size n_x");
+    std::vector<uint32_t> entries = state_indices;
+    if (entries.empty()) 
+      for (uint32_t j = 0; j < n_x; j++) 
+        entries.push_back(j);
+    for (uint32_t j : entries) 
+      if (j >= n_x) 
+        throw std::runtime_error("StateBounds: state index out of range");
+
+    uint32_t horizon = B_mpc.rows() / n_x;
+    prediction_rows_.clear();
+    for (uint32_t k = 0; k < horizon; k++) 
+      for (uint32_t j : entries) 
+        prediction_rows_.push_back(k * n_x + j);
+
+    // rows of X = A_mpc * U + B_mpc * x0 that are bounded
+    SparseMat selection(prediction_rows_.size(), B_mpc.rows());
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (uint32_t i = 0; i < prediction_rows_.size(); i++) 
+      triplets.emplace_back(i, prediction_rows_[i], 1.0);
+    selection.setFromTriplets(triplets.begin(), triplets.end());
+    SparseMat A_selected = selection * A_mpc;
+    B_selected_ = selection * B_mpc;
+    x_upper_selected_.resize(prediction_rows_.size());
+    x_lower_selected_.resize(prediction_rows_.size());
+    for (uint32_t i = 0; i < prediction_rows_.size(); i++) 
+    {
+      x_upper_selected_(i) = x_upper_bound(prediction_rows_[i] % n_x);
+      x_lower_selected_(i) = x_lower_bound(prediction_rows_[i] % n_x);
+    }
+
+    // A_mpc * U + B_mpc * x0 - x_ub <= 0,  -A_mpc * U - B_mpc * x0 + x_lb <= 0
+    row_offset_ = qp_problem.A_ieq.rows();
+    qp_problem.A_ieq = cocatenateMatrices(qp_problem.A_ieq, cocatenateMatrices(A_selected, -A_selected));
+    VecNd b_ieq(qp_problem.b_ieq.rows() + 2 * A_selected.rows());
+    b_ieq << qp_problem.b_ieq, inequalityOffset(x0);
+    qp_problem.b_ieq = b_ieq;
+  }
+  VecNd inequalityOffset(const VecNd &x0) const 
+  {
+    VecNd B_x0 = B_selected_ * x0;
+    VecNd b_ieq(2 * B_x0.rows());
+    b_ieq << B_x0 - x_upper_selected_,
+             x_lower_selected_ - B_x0;
+    return b_ieq;
+  }
+
+  // row of A_ieq added by setup() -> row of X = A_mpc * U + B_mpc * x0 (state entry = row % n_x)
+  bool isUpperBoundRow(uint32_t ieq_row) const { return ieq_row - row_offset_ < prediction_rows_.size(); }
+  uint32_t predictionRow(uint32_t ieq_row) const 
+  { 
+    return prediction_rows_[(ieq_row - row_offset_) % prediction_rows_.size()]; 
+  }
+
+  VecNd x_lower_bound, x_upper_bound;
+  std::vector<uint32_t> state_indices;
+
+private:
+  std::vector<uint32_t> prediction_rows_;
+  uint32_t row_offset_ = 0;
+  SparseMat B_selected_;
+  VecNd x_lower_selected_, x_upper_selected_;
+};
+
+// both constraint sets, the inequality constraints of First come before those of Second
+template <class First, class Second>
+struct CombinedConstraints {
+  static constexpr bool x0_dependent = First::x0_dependent || Second::x0_dependent;
+
+  CombinedConstraints(const First &first, const Second &second) : first(first), second(second) {}
+
+  void setup(const SparseMat &A_mpc, const SparseMat &B_mpc, const VecNd &x0, SparseQpProblem &qp_problem) 
+  {
+    first.setup(A_mpc, B_mpc, x0, qp_problem);
+    second.setup(A_mpc, B_mpc, x0, qp_problem);
+  }
+  VecNd inequalityOffset(const VecNd &x0) const 
+  {
+    VecNd offset_first = first.inequalityOffset(x0);
+    VecNd offset_second = second.inequalityOffset(x0);
+    VecNd b_ieq(offset_first.rows() + offset_second.rows());
+    b_ieq << offset_first, offset_second;
+    return b_ieq;
+  }
+
+  First first;
+  Second second;
+};
+
+// -------------- runtime policy pair -----------------
+
+// PolicyAs<T, Policy>::get(policy) is the policy as T if it is one, nullptr otherwise
+template <class T, class Policy>
+struct PolicyAs {
+  static const T *get(const Policy &/*policy*/) { return nullptr; }
+};
+template <class T>
+struct PolicyAs<T, T> {
+  static const T *get(const T &policy) { return &policy; }
+};
+
+// Cost and constraint policies of the runtime MPC behind a virtual interface, chosen once by the
+// MPC constructor. setupQp() builds the QP without equality constraints, updateQp() sets b_qp and,
+// for x0 dependent constraints, b_ieq
+class MpcPolicy {
+public:
+  virtual ~MpcPolicy() = default;
+
+  virtual std::unique_ptr<SparseQpProblem> setupQp(const LinearSystem &linear_system, uint32_t horizon, 
+                                                   const SparseMat &A_mpc, const SparseMat &B_mpc, 
+                                                   const VecNd &Y_d, const VecNd &x0) = 0;
+  virtual void updateQp(const VecNd &Y_d, const VecNd &x0, SparseQpProblem &qp_problem) const = 0;
+  virtual MatNd gradientX0Map() const = 0;
+  virtual MatNd gradientYdMap() const = 0;
+
+  // the policies of the pair for the formulation specific code, nullptr if not part of the pair
+  virtual const OutputTrackingCost *outputTrackingCost() const = 0;
+  virtual const WeightedCost *weightedCost() const = 0;
+  virtual const StateBounds *stateBounds() const = 0;
+};
+
+template <class CostPolicy, class ConstraintPolicy = NoConstraints>
+class MpcPolicyPair : public MpcPolicy {
+public:
+  MpcPolicyPair(const CostPolicy &cost, const ConstraintPolicy &constraints = ConstraintPolicy()) 
+    : cost_(cost), constraints_(constraints) {}
+
+  std::unique_ptr<SparseQpProblem> setupQp(const LinearSystem &linear_system, uint32_t horizon, 
+                                           const SparseMat &A_mpc, const SparseMat &B_mpc, 
+                                           const VecNd &Y_d, const VecNd &x0) override 
+  {
+    uint32_t n_var = horizon * linear_system.n_u;
+    cost_.setup(linear_system, horizon, A_mpc, B_mpc);
+    std::unique_ptr<SparseQpProblem> qp_problem = std::make_unique<SparseQpProblem>( 
+      cost_.hessian(), cost_.gradient(Y_d, x0), SparseMat(0, n_var), VecNd::Zero(0), 
+      SparseMat(0, n_var), VecNd::Zero(0) );
+    constraints_.setup(A_mpc, B_mpc, x0, *qp_problem);
+    return qp_problem;
+  }
+  void updateQp(const VecNd &Y_d, const VecNd &x0, SparseQpProblem &qp_problem) const override 
+  {
+    qp_problem.b_qp = cost_.gradient(Y_d, x0);
+    if (ConstraintPolicy::x0_dependent) 
+      qp_problem.b_ieq = constraints_.inequalityOffset(x0);
+  }
+  MatNd gradientX0Map() const override { return cost_.gradientX0Map(); }
+  MatNd gradientYdMap() const override { return cost_.gradientYdMap(); }
+
+  const OutputTrackingCost *outputTrackingCost() const override 
+  { 
+    return PolicyAs<OutputTrackingCost, CostPolicy>::get(cost_); 
+  }
+  const WeightedCost *weightedCost() const override 
+  { 
+    return PolicyAs<WeightedCost, CostPolicy>::get(cost_); 
+  }
+  const StateBounds *stateBounds() const override 
+  { 
+    return PolicyAs<StateBounds, ConstraintPolicy>::get(constraints_); 
+  }
+
+private:
+  CostPolicy cost_;
+  ConstraintPolicy constraints_;
+};
+
+// -------------- PolicyMPC -----------------
+template <class CostPolicy, class ConstraintPolicy = NoConstraints>
+class PolicyMPC {
+public:
+  PolicyMPC(const LinearSystem &linear_system, uint32_t horizon,
+            const VecNd &Y_d, const VecNd &x0, const CostPolicy &cost, 
+            const ConstraintPolicy &constraints = ConstraintPolicy(),
+            double solver_time_limit = 0.0, const OsqpSettings &solver_settings = OsqpSettings())
+    : linear_system_(linear_system), N_(horizon), Y_d_(Y_d), x0_(x0), 
+    cost_(cost), constraints_(constraints),
+    A_mpc_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_u)),
+    B_mpc_(SparseMat(N_ * linear_system_.n_x, linear_system_.n_x)),
+    C_mpc_(SparseMat(N_ * linear_system_.n_y, N_ * linear_system_.n_x)),
+    solver_time_limit_(solver_time_limit), solver_settings_(solver_settings)
+  {
+    checkDimensions(Y_d_, x0_);
+    setupPredictionMatrices(linear_system_, N_, A_mpc_, B_mpc_, C_mpc_);
+  }
+
+  void initializeSolver() 
+  {
+    uint32_t n_var = N_ * linear_system_.n_u;
+    cost_.setup(linear_system_, N_, A_mpc_, B_mpc_);
+    qp_problem_ = std::make_unique<SparseQpProblem>( cost_.hessian(), cost_.gradient(Y_d_, x0_),
+                                                     SparseMat(0, n_var), VecNd::Zero(0),
+                                                     SparseMat(0, n_var), VecNd::Zero(0) );
+    constraints_.setup(A_mpc_, B_mpc_, x0_, *qp_problem_);
+    osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(*qp_problem_, solver_time_limit_, solver_settings_);
+  }
+
+  void updateSolver(const VecNd &Y_d, const VecNd &x0) 
+  {
+    checkDimensions(Y_d, x0);
+    Y_d_ = Y_d;
+    x0_ = x0;
+    qp_problem_->b_qp = cost_.gradient(Y_d_, x0_);
+    if (ConstraintPolicy::x0_dependent) 
+    {
+      qp_problem_->b_ieq = constraints_.inequalityOffset(x0_);
+      osqp_eigen_opt_->updateGradientAndIeqConstraint(qp_problem_->b_qp, qp_problem_->b_ieq);
+    }
+    else
+      osqp_eigen_opt_->updateGradient(qp_problem_->b_qp);
+  }
+
+  VecNd solve() const { return osqp_eigen_opt_->solveProblem(); }
+  int getSolverStatus() const { return osqp_eigen_opt_->getStatus(); }
+
+  VecNd calculateX(const VecNd &U_in) const { return rolloutStates(linear_system_, U_in, x0_); }
+  VecNd calculateY(const VecNd &U_in) const { return outputSequence(linear_system_, calculateX(U_in)); }
+
+  const CostPolicy &getCost() const { return cost_; }
+  const ConstraintPolicy &getConstraints() const { return constraints_; }
+  const SparseQpProblem &getQpProblem() const { return *qp_problem_; }
+
+private:
+  LinearSystem linear_system_;
+  uint32_t N_;
+  VecNd Y_d_, x0_;
+
+  CostPolicy cost_;
+  ConstraintPolicy constraints_;
+
+  SparseMat A_mpc_, B_mpc_, C_mpc_;
+  std::unique_ptr<SparseQpProblem> qp_problem_;
+  std::unique_ptr<OsqpEigenOpt> osqp_eigen_opt_;
+
+  double solver_time_limit_;
+  OsqpSettings solver_settings_;
+
+  void checkDimensions(const VecNd &Y_d, const VecNd &x0) const 
+  {
+    std::ostringstream msg;
+    if ((uint32_t)Y_d.rows() != N_ * linear_system_.n_y || (uint32_t)x0.rows() != linear_system_.n_x) 
+    {
+      msg << "PolicyMPC: Y_d.rows() = " << Y_d.rows() << ", x0.rows() = " << x0.rows() 
+          << ", need to be = " << N_ * linear_system_.n_y << ", " << linear_system_.n_x << "\n";
+      throw std::runtime_error(msg.str());
+    }
+  }
+};
+
+} // namespace LinMpcEigen
+
+#endif //POLICY_MPC_HPP_
@@ -0,0 +1,79 @@
+/**
+ * @file RealTime.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Real-time execution support (Linux)
+ *
+ *    Avoids the page faults and scheduling delays of the first solves:
+ *      - heap trimming and mmap allocations are disabled (mallopt), so memory
+ *        freed by the library stays mapped
+ *      - a heap reserve and the stack of the calling thread are prefaulted
+ *      - all current and future pages are locked (mlockall), this also faults
+ *        in the OSQP workspace allocated by initializeSolver()
+ *      - threads are pinned to the configured cores and scheduled with SCHED_FIFO
+ *
+ *    Nothing throws, everything that could not be done is listed in the
+ *    RealTimeReport (e.g. missing CAP_IPC_LOCK / CAP_SYS_NICE or RLIMIT_MEMLOCK).
+ */
+#ifndef REAL_TIME_HPP_
+#define REAL_TIME_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+namespace LinMpcEigen {
+
+struct RealTimeSettings {
+  bool lock_memory = true;                 // mlockall(MCL_CURRENT | MCL_FUTURE)
+  size_t heap_reserve_size = 8 << 20;      // [bytes] prefaulted and kept by the allocator
+  size_t stack_prefault_size = 256 << 10;  // [bytes] of the calling thread's stack
+  int priority = 80;                       // SCHED_FIFO priority, 0 - keep the scheduling policy
+  std::vector<int> cpu_cores;              // allowed cores of the solver threads, empty - no pinning
+  bool warm_up_solve = true;               // MPC: one solve to touch the solver workspace, see enableRealTimeMode()
+};
+
+struct RealTimeReport {
+  std::vector<std::string> failures;
+  size_t prefaulted_bytes = 0;
+  bool memory_locked = false;
+
+  bool ok() const { return failures.empty(); }
+  void merge(const RealTimeReport &other);
+};
+
+// process wide memory settings: mallopt, heap reserve, stack prefault and mlockall
+RealTimeReport configureProcessMemory(const RealTimeSettings &settings);
+// affinity and SCHED_FIFO priority of the calling thread, failures are appended to the report
+void configureCurrentThread(int priority, const std::vector<int> &cpu_cores, RealTimeReport &report);
+// SCHED_FIFO priority of the calling thread only
+void setCurrentThreadPriority(int priority, RealTimeReport &report);
+// stack prefault, affinity and priority of a thread that serves controllers (MultiRateExecutor, MpcService)
+void configureServingThread(const RealTimeSettings &settings, int priority, const std::vector<int> &cpu_cores,
+                            RealTimeReport &report);
+
+// touches every page of [data, data + bytes), returns bytes
+size_t prefaultMemory(const void *data, size_t bytes);
+void prefaultStack(size_t bytes);
+
+template <typename Derived>
+size_t prefaultMatrix(const Eigen::PlainObjectBase<Derived> &matrix)
+{
+  return prefaultMemory(matrix.data(), matrix.size() * sizeof(typename Derived::Scalar));
+}
+
+// compressed matrices only, returns 0 for matrices in uncompressed mode
+inline size_t prefaultMatrix(const Eigen::SparseMatrix<double> &matrix)
+{
+  size_t bytes = 0;
+  if (!matrix.isCompressed())
+    return 0;
+  bytes += prefaultMemory(matrix.valuePtr(), matrix.nonZeros() * sizeof(double));
+  bytes += prefaultMemory(matrix.innerIndexPtr(), matrix.nonZeros() * sizeof(int));
+  bytes += prefaultMemory(matrix.outerIndexPtr(), (matrix.outerSize() + 1) * sizeof(int));
+  return bytes;
+}
+}
+#endif //REAL_TIME_HPP_
@@ -0,0 +1,59 @@
+/**
+ * @file RiccatiKktSolver.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Stage-wise solver of the ADMM linear system of the input-bounded MPC QP
+ *
+ *    The condensed MPC Hessian is
+ *
+ *      A_qp = G^T * blockdiag(state_weight) * G + blockdiag(input_weight)
+ *
+ *    where G maps the inputs u_0..u_(N-1) to the states x_1..x_N of x_k+1 = A * x_k + B * u_k, x_0 = 0.
+ *    Solving (A_qp + diag(shift)) * u = f is an unconstrained LQ problem, so it is factorized with a 
+ *    backward Riccati recursion in O(N * (n_x^3 + n_u^3)) using dense n_x and n_u sized blocks, 
+ *    instead of a general sparse LDL^T of the dense N * n_u Hessian. A solve is a backward and 
+ *    a forward sweep in O(N * n_x^2).
+ *
+ *    With a diagonal input scaling U = D * U_s (MPC::setStructuredScaling()), the solved system is 
+ *    D * A_qp * D + diag(shift).
+ */
+#ifndef RICCATI_KKT_SOLVER_HPP_
+#define RICCATI_KKT_SOLVER_HPP_
+
+#include <vector>
+#include <Eigen/Dense>
+
+using VecNd = Eigen::VectorXd;
+using MatNd = Eigen::MatrixXd;
+
+// Solver of the ADMM linear system (A_qp + diag(diagonal_shift)) * x = rhs, used by MixedPrecisionQpSolver
+class KktSolver 
+{
+public:
+  virtual ~KktSolver() = default;
+  virtual void factorize(const VecNd &diagonal_shift) = 0;
+  virtual VecNd solve(const VecNd &rhs) const = 0;
+};
+
+class RiccatiKktSolver : public KktSolver 
+{
+public:
+  RiccatiKktSolver( const MatNd &A, const MatNd &B, uint32_t horizon, 
+                    const MatNd &state_weight, const MatNd &input_weight,
+                    const VecNd &input_scaling = VecNd() );
+
+  void factorize(const VecNd &diagonal_shift) override;
+  VecNd solve(const VecNd &rhs) const override;
+
+private:
+  MatNd A_, B_;
+  uint32_t N_, n_x_, n_u_;
+  MatNd state_weight_, input_weight_;
+  VecNd input_scaling_;
+
+  // u_k = K_k * x_k + k_k
+  std::vector<MatNd> feedback_gains_;
+  std::vector< Eigen::LLT<MatNd> > input_hessian_llt_;
+};
+
+#endif //RICCATI_KKT_SOLVER_HPP_
@@ -0,0 +1,93 @@
+/**
+ * @file ScenarioMpc.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Scenario-based robust MPC
+ *
+ *    For a finite set of model scenarios (A_i, B_i), i = 1..S, with shared
+ *    C and D matrices (checked by the constructor), solves:
+ *
+ *      min  	sum_i 1/S * ( Q * ||Y_i - Y_d||^2 + R * ||U_i||^2 )
+ *      U_1..U_S
+ *
+ *      s.t.	X_i = A_mpc_i * U_i + B_mpc_i * x0
+ *            Y_i = C_mpc * X_i
+ *            u_i(0) = u_1(0)                      (non-anticipativity)
+ *            u_lower_bound <= u_i(k) <= u_upper_bound (optional)
+ *
+ *    The condensed blocks of every scenario are built in parallel from the
+ *    OutputTrackingCost policy (PolicyMpc.hpp) scaled by 1/S and stacked into
+ *    one QP, which is solved with a single OSQP call. The decision vector is
+ *    U = [U_1; ...; U_S].
+ */
+#ifndef SCENARIO_MPC_HPP_
+#define SCENARIO_MPC_HPP_
+
+#include <vector>
+
+#include "LinMpcEigen.hpp"
+
+namespace LinMpcEigen {
+
+class ScenarioMPC {
+public:
+  ScenarioMPC(const std::vector<LinearSystem> &scenario_systems, uint32_t horizon,
+              const VecNd &Y_d, const VecNd &x0, double Q, double R,
+              double solver_time_limit = 0.0, uint32_t n_threads = 0,
+              const OsqpSettings &solver_settings = OsqpSettings());
+
+  ScenarioMPC(const std::vector<LinearSystem> &scenario_systems, uint32_t horizon,
+              const VecNd &Y_d, const VecNd &x0, double Q, double R,
+              const VecNd &u_lower_bound, const VecNd &u_upper_bound,
+              double solver_time_limit = 0.0, uint32_t n_threads = 0,
+              const OsqpSettings &solver_settings = OsqpSettings());
+
+  void initializeSolver();
+  void updateSolver(const VecNd &Y_d_in, const VecNd &x0);
+
+  VecNd solve() const; // stacked solution [U_1; ...; U_S]
+  int getSolverStatus() const;
+
+  uint32_t getNumberOfScenarios() const;
+  VecNd extractScenarioU(const VecNd &U_stacked, uint32_t scenario) const;
+  VecNd calculateScenarioX(const VecNd &U_stacked, uint32_t scenario) const;
+  VecNd calculateScenarioY(const VecNd &U_stacked, uint32_t scenario) const;
+
+private:
+  // condensed data of a single scenario
+  struct ScenarioBlocks {
+    SparseMat A_mpc, B_mpc, C_mpc;
+    SparseMat A_qp;                // Hessian block
+    MatNd gradient_x0_map;         // gradient block = gradient_x0_map * x0 + gradient_Y_d_map * Y_d
+    MatNd gradient_Y_d_map;
+  };
+
+  std::vector<LinearSystem> scenario_systems_;
+  uint32_t N_;
+  uint32_t n_x_, n_u_, n_y_;
+
+  VecNd Y_d_;
+  VecNd x0_;
+  double Q_, R_;
+
+  bool bound_constrained_ = false;
+  VecNd u_lower_bound_, u_upper_bound_;
+
+  double solver_time_limit_ = 0;
+  uint32_t n_threads_ = 0;
+  OsqpSettings solver_settings_;
+
+  std::vector<ScenarioBlocks> scenario_blocks_;
+
+  std::unique_ptr<SparseQpProblem> qp_problem_;
+  std::unique_ptr<OsqpEigenOpt> osqp_eigen_opt_;
+
+  void setupScenarioBlocks();
+  VecNd calculateGradient() const;
+
+  void checkScenarioDimensions() const;
+  void checkMatrixDimensions() const;
+  void checkBoundsDimensions() const;
+};
+}
+#endif //SCENARIO_MPC_HPP_
@@ -0,0 +1,82 @@
+/**
+ * @file SolverAutotuner.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Offline OSQP settings autotuner
+ *
+ *    Replays a recorded workload (a sequence of (Y_d, x0) ticks) on a MPC
+ *    configuration for every candidate settings combination of a search
+ *    grid. Every candidate is compared against a reference solution
+ *    computed with OsqpSettings::highAccuracy(). run() throws if a
+ *    reference tick does not end with OSQP_SOLVED. The selected settings
+ *    minimize the p99 tick time (updateSolver + solve) subject to
+ *
+ *      ||U - U_ref||_inf <= accuracy_bound * max(1, ||U_ref||_inf)
+ *
+ *    on every tick. Candidates are evaluated in parallel, one MPC per
+ *    candidate. Timings of parallel evaluations share the machine, so
+ *    n_threads should not exceed the number of physical cores.
+ *
+ *    If the grid has more than max_candidates combinations, a random
+ *    subset of max_candidates combinations (seeded with seed) is searched.
+ */
+#ifndef SOLVER_AUTOTUNER_HPP_
+#define SOLVER_AUTOTUNER_HPP_
+
+#include <vector>
+
+#include "LinMpcEigen.hpp"
+
+namespace LinMpcEigen {
+
+struct WorkloadTick {
+  VecNd Y_d;
+  VecNd x0;
+};
+
+// search grid, every combination of the listed values is a candidate
+struct AutotuneGrid {
+  std::vector<double> rho = { 0.01, 0.1, 1.0 };
+  std::vector<double> alpha = { 1.0, 1.6 };
+  std::vector<uint32_t> scaling = { 0, 4, 10 };
+  std::vector<double> tolerance = { 1e-5, 1e-4, 1e-3 }; // absolute and relative tolerance
+  std::vector<uint32_t> check_termination = { 5, 25 };
+  std::vector<bool> adaptive_rho = { true, false };
+};
+
+struct AutotuneCandidate {
+  OsqpSettings settings;
+  bool feasible = false;       // accuracy bound met and every tick solved
+  double tick_time_p99 = 0.0;  // [s]
+  double tick_time_mean = 0.0; // [s]
+  double max_error = 0.0;      // largest relative error against the reference
+  uint32_t n_failures = 0;     // ticks not ending with OSQP_SOLVED or OSQP_SOLVED_INACCURATE
+};
+
+struct AutotuneResult {
+  bool found = false; // false if no candidate is feasible
+  AutotuneCandidate best;
+  std::vector<AutotuneCandidate> candidates;
+};
+
+class SolverAutotuner {
+public:
+  SolverAutotuner(const LinearSystem &linear_system, const MpcFactory &mpc_factory, 
+                  const std::vector<WorkloadTick> &workload);
+
+  AutotuneResult run( const AutotuneGrid &grid, double accuracy_bound,
+                      uint32_t repetitions = 3, uint32_t max_candidates = 256,
+                      uint64_t seed = 0, uint32_t n_threads = 0 ) const;
+
+private:
+  LinearSystem linear_system_;
+  MpcFactory mpc_factory_;
+  std::vector<WorkloadTick> workload_;
+
+  std::vector<OsqpSettings> makeCandidates(const AutotuneGrid &grid, uint32_t max_candidates, uint64_t seed) const;
+  std::vector<VecNd> solveReference() const;
+  AutotuneCandidate evaluate( const OsqpSettings &settings, const std::vector<VecNd> &reference,
+                              double accuracy_bound, uint32_t repetitions ) const;
+};
+}
+#endif //SOLVER_AUTOTUNER_HPP_
@@ -0,0 +1,60 @@
+/**
+ * @file ThreadPool.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Fixed size pool of worker threads used for the parallel parts
+ *    of the library (Monte Carlo sweeps, scenario assembly, ...).
+ *
+ *    parallelFor(n, task) calls task(index, worker_id) for every
+ *    index in [0, n) and blocks until all calls have returned.
+ *    worker_id is in [0, size()) and can be used to index
+ *    per-worker data (e.g. one MPC object per worker).
+ */
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LinMpcEigen {
+
+class ThreadPool {
+public:
+  // n_threads = 0 uses std::thread::hardware_concurrency()
+  explicit ThreadPool(uint32_t n_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  uint32_t size() const;
+
+  // rethrows the first exception thrown by a task
+  void parallelFor(uint32_t n, const std::function<void(uint32_t index, uint32_t worker_id)> &task);
+
+private:
+  void workerLoop(uint32_t worker_id);
+
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+
+  const std::function<void(uint32_t, uint32_t)> *task_ = nullptr;
+  uint32_t n_tasks_ = 0;
+  std::atomic<uint32_t> next_index_{0};
+  uint32_t busy_workers_ = 0;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+
+  std::exception_ptr exception_;
+};
+}
+#endif //THREAD_POOL_HPP_
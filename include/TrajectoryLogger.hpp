@@ -0,0 +1,143 @@
+/**
+ * @file TrajectoryLogger.hpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Columnar binary logger of the solution and predicted trajectories
+ *
+ *    Every tick appends U (N * n_u), X (N * n_x) and Y (N * n_y) to a
+ *    memory-mapped chunk file <path_prefix>_<chunk index>.lmtl holding
+ *    ticks_per_chunk ticks. log() only copies into the mapping. A
+ *    background thread creates, sizes and prefaults the next chunk in
+ *    advance and unmaps full chunks. If the next chunk is not ready when
+ *    the current one is full, the tick is dropped instead of stalling the
+ *    control loop (getDroppedTicks()).
+ *
+ *    Chunk file layout (native endianness), every column 64 byte aligned:
+ *      TrajectoryLogHeader
+ *      uint64 tick[capacity]
+ *      int64  time[capacity]                   [ns], steady clock
+ *      double U[capacity][horizon * n_u]       if columns & LOG_U
+ *      double X[capacity][horizon * n_x]       if columns & LOG_X
+ *      double Y[capacity][horizon * n_y]       if columns & LOG_Y
+ *    n_ticks in the header is updated after every tick, so a chunk can be
+ *    read while it is written. TrajectoryLogReader and the
+ *    trajectory_log_reader tool read chunk files. Linux only, the
+ *    constructors throw on other platforms.
+ */
+#ifndef TRAJECTORY_LOGGER_HPP_
+#define TRAJECTORY_LOGGER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "LinMpcEigen.hpp"
+
+namespace LinMpcEigen {
+
+enum TrajectoryLogColumns : uint32_t {
+  LOG_U = 1,
+  LOG_X = 2,
+  LOG_Y = 4,
+  LOG_ALL = LOG_U | LOG_X | LOG_Y
+};
+
+struct TrajectoryLogHeader {
+  char magic[4];        // "LMTL"
+  uint32_t version;
+  uint32_t n_u, n_x, n_y;
+  uint32_t horizon;
+  uint32_t capacity;    // ticks per chunk
+  uint32_t columns;     // TrajectoryLogColumns
+  uint64_t chunk_index;
+  uint64_t n_ticks;     // ticks written to this chunk
+  uint64_t column_offsets[5]; // tick, time, U, X, Y [bytes from the start of the file], 0 if not logged
+};
+
+class TrajectoryLogger {
+public:
+  TrajectoryLogger( const std::string &path_prefix, uint32_t n_u, uint32_t n_x, uint32_t n_y,
+                    uint32_t horizon, uint32_t ticks_per_chunk = 1000, uint32_t columns = LOG_ALL );
+  TrajectoryLogger( const std::string &path_prefix, const MPC &mpc,
+                    uint32_t ticks_per_chunk = 1000, uint32_t columns = LOG_ALL );
+  ~TrajectoryLogger();
+
+  TrajectoryLogger(const TrajectoryLogger &) = delete;
+  TrajectoryLogger &operator=(const TrajectoryLogger &) = delete;
+
+  // control thread only, vectors of the columns that are not logged are ignored,
+  // returns false if the tick was dropped
+  bool log(const VecNd &U, const VecNd &X, const VecNd &Y);
+  // X and Y are calculated from the MPC into preallocated vectors if they are logged
+  bool log(const MPC &mpc, const VecNd &U);
+
+  uint64_t getTickCount() const;   // logged ticks
+  uint64_t getDroppedTicks() const;
+  std::string getError() const;    // last error of the background thread
+  static std::string chunkPath(const std::string &path_prefix, uint64_t chunk_index);
+
+private:
+  struct Chunk {
+    int fd = -1;
+    char *data = nullptr;
+    size_t size = 0;
+    uint64_t index = 0;
+  };
+
+  Chunk *createChunk(uint64_t chunk_index) const;
+  static void closeChunk(Chunk *chunk);
+  TrajectoryLogHeader &header(Chunk *chunk) const;
+  void chunkLoop();
+
+  std::string path_prefix_;
+  TrajectoryLogHeader layout_; // header of every chunk, without chunk_index and n_ticks
+  size_t chunk_size_;
+
+  VecNd X_, Y_; // predictions of log(mpc, U), sized by the constructor
+
+  Chunk *current_ = nullptr;
+  uint64_t current_ticks_ = 0;
+  std::atomic<Chunk *> prepared_{nullptr};
+  std::atomic<Chunk *> retired_{nullptr};
+  std::atomic<uint64_t> tick_count_{0};
+  std::atomic<uint64_t> dropped_ticks_{0};
+
+  std::thread chunk_thread_;
+  mutable std::mutex mutex_;
+  std::condition_variable chunk_cv_;
+  bool stop_ = false;
+  uint64_t next_chunk_index_ = 1;
+  std::string error_;
+};
+
+class TrajectoryLogReader {
+public:
+  explicit TrajectoryLogReader(const std::string &file_path);
+  ~TrajectoryLogReader();
+
+  TrajectoryLogReader(const TrajectoryLogReader &) = delete;
+  TrajectoryLogReader &operator=(const TrajectoryLogReader &) = delete;
+
+  const TrajectoryLogHeader &getHeader() const;
+  uint64_t size() const; // ticks in the chunk
+
+  uint64_t getTick(uint64_t i) const;
+  int64_t getTime(uint64_t i) const;
+  // throw if the column is not logged
+  Eigen::Map<const VecNd> getU(uint64_t i) const;
+  Eigen::Map<const VecNd> getX(uint64_t i) const;
+  Eigen::Map<const VecNd> getY(uint64_t i) const;
+
+private:
+  Eigen::Map<const VecNd> getColumn(uint32_t column, uint32_t rows, uint64_t i) const;
+  void checkIndex(uint64_t i) const;
+
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  const TrajectoryLogHeader *header_ = nullptr;
+};
+}
+#endif //TRAJECTORY_LOGGER_HPP_
@@ -0,0 +1,288 @@
+/**
+ * @file CodeGenerator.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "CodeGenerator.hpp"
+
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+std::string literal(double value) 
+{
+  std::ostringstream stream;
+  stream.precision(17);
+  stream << value;
+  std::string text = stream.str();
+  if (text.find_first_of(".en") == std::string::npos) 
+    text += ".0";
+  return text;
+}
+
+// "output[row] = sum of the nonzeros of matrix(row, :) * input[:]" for every row
+void generateMatrixProduct( std::ostream &stream, const MatNd &matrix, 
+                            const std::string &input, const std::string &output, bool accumulate ) 
+{
+  for (uint32_t i = 0; i < matrix.rows(); i++) 
+  {
+    std::ostringstream terms;
+    for (uint32_t j = 0; j < matrix.cols(); j++) 
+    {
+      if (matrix(i, j) == 0.0) 
+        continue;
+      if (terms.tellp() > 0) 
+        terms << " + ";
+      terms << literal(matrix(i, j)) << " * " << input << "[" << j << "]";
+    }
+    if (terms.tellp() == 0) 
+    {
+      if (!accumulate) 
+        stream << "  " << output << "[" << i << "] = 0.0;\n";
+      continue;
+    }
+    stream << "  " << output << "[" << i << "] " << (accumulate ? "+=" : "=") << " " << terms.str() << ";\n";
+  }
+}
+
+// upper case, characters that can't be part of a macro name ("::") replaced by '_'
+std::string includeGuard(const std::string &namespace_name) 
+{
+  std::string guard = namespace_name;
+  for (char &c : guard) 
+    c = std::isalnum((unsigned char)c) ? std::toupper((unsigned char)c) : '_';
+  return guard + "_HPP_";
+}
+
+// "a::b" -> {"a", "b"}, opened as nested namespaces, the generated header needs C++11 only
+std::vector<std::string> namespaceNames(const std::string &namespace_name) 
+{
+  std::vector<std::string> names;
+  size_t begin = 0;
+  while (true) 
+  {
+    size_t end = namespace_name.find("::", begin);
+    names.push_back(namespace_name.substr(begin, end - begin));
+    if (end == std::string::npos) 
+      return names;
+    begin = end + 2;
+  }
+}
+
+void generateArray(std::ostream &stream, const std::string &name, const VecNd &values) 
+{
+  stream << "constexpr double " << name << "[" << values.rows() << "] = {";
+  for (uint32_t i = 0; i < values.rows(); i++) 
+    stream << (i % 4 == 0 ? "\n  " : " ") << literal(values(i)) << (i + 1 < values.rows() ? "," : "");
+  stream << "\n};\n\n";
+}
+
+} // namespace
+
+// -------------- CodeGenerator -----------------
+LinMpcEigen::CodeGenerator::CodeGenerator(const MPC &mpc, const CodeGenOptions &options) 
+  : options_(options),
+  n_x_(mpc.getLinearSystem().n_x), n_u_(mpc.getLinearSystem().n_u), n_y_(mpc.getLinearSystem().n_y),
+  N_(mpc.getHorizon()), n_var_(N_ * n_u_),
+  rho_(mpc.getSolverSettings().rho), sigma_(mpc.getSolverSettings().sigma), 
+  alpha_(mpc.getSolverSettings().alpha),
+  absolute_tolerance_(mpc.getSolverSettings().absolute_tolerance), 
+  relative_tolerance_(mpc.getSolverSettings().relative_tolerance),
+  check_termination_(options.fixed_iterations ? 0 : mpc.getSolverSettings().check_termination)
+{
+  const SparseQpProblem &qp_problem = mpc.getQpProblem();
+  if (qp_problem.A_eq.rows() > 0 || qp_problem.A_ieq.rows() > 0) 
+    throw std::runtime_error("CodeGenerator: only MPCs without state constraints are supported");
+  bounded_ = qp_problem.upper_bound.rows() > 0;
+
+  MatNd A_qp = MatNd(qp_problem.A_qp);
+  input_scaling_ = A_qp.diagonal().cwiseSqrt().cwiseInverse();
+  auto D = input_scaling_.asDiagonal();
+
+  gradient_x0_map_ = D * mpc.getGradientX0Map();
+  gradient_Y_d_map_ = D * mpc.getGradientYdMap();
+  mpc.getPredictionMatrices(A_mpc_, B_mpc_, C_mpc_);
+  if (bounded_) 
+  {
+    lower_bound_ = qp_problem.lower_bound.cwiseQuotient(input_scaling_);
+    upper_bound_ = qp_problem.upper_bound.cwiseQuotient(input_scaling_);
+  }
+
+  hessian_ = D * A_qp * D;
+  MatNd kkt_matrix = hessian_;
+  if (bounded_) 
+    kkt_matrix.diagonal().array() += sigma_ + rho_;
+  Eigen::LLT<MatNd> kkt_llt(kkt_matrix);
+  if (kkt_llt.info() != Eigen::Success) 
+    throw std::runtime_error("CodeGenerator: the KKT matrix is not positive definite");
+  kkt_factor_ = kkt_llt.matrixL();
+}
+
+void LinMpcEigen::CodeGenerator::generate(std::ostream &stream) const 
+{
+  std::string guard = includeGuard(options_.namespace_name);
+
+  stream << "// Generated by LinMpcEigen::CodeGenerator, do not edit\n";
+  stream << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+  stream << "#include <cstdint>\n\n";
+  std::vector<std::string> namespaces = namespaceNames(options_.namespace_name);
+  for (const std::string &name : namespaces) 
+    stream << "namespace " << name << " {\n";
+  stream << "\n";
+  stream << "constexpr uint32_t n_x = " << n_x_ << ";\n";
+  stream << "constexpr uint32_t n_u = " << n_u_ << ";\n";
+  stream << "constexpr uint32_t n_y = " << n_y_ << ";\n";
+  stream << "constexpr uint32_t horizon = " << N_ << ";\n";
+  stream << "constexpr uint32_t n_var = " << n_var_ << ";\n";
+  stream << "constexpr uint32_t admm_iterations = " << options_.admm_iterations << ";\n\n";
+
+  stream << "// ADMM iterate, keep it between solves for warm starting\n";
+  stream << "struct Workspace {\n  double x[n_var] = {};\n  double z[n_var] = {};\n  double y[n_var] = {};\n};\n\n";
+
+  generateArray(stream, "input_scaling", input_scaling_);
+  if (bounded_) 
+  {
+    generateArray(stream, "lower_bound", lower_bound_);
+    generateArray(stream, "upper_bound", upper_bound_);
+  }
+
+  generateGradient(stream);
+  generatePrediction(stream);
+  generateKktSolve(stream);
+  if (bounded_ && check_termination_ > 0) 
+    generateResiduals(stream);
+  generateSolve(stream);
+
+  for (auto name = namespaces.rbegin(); name != namespaces.rend(); ++name) 
+    stream << "} // namespace " << *name << "\n";
+  stream << "\n";
+  stream << "#endif //" << guard << "\n";
+}
+
+void LinMpcEigen::CodeGenerator::generateToFile(const std::string &file_path) const 
+{
+  std::ofstream file(file_path);
+  if (!file) 
+    throw std::runtime_error("CodeGenerator: can't open '" + file_path + "'");
+  generate(file);
+}
+
+void LinMpcEigen::CodeGenerator::generateGradient(std::ostream &stream) const 
+{
+  stream << "// gradient of the scaled QP, q = D * (gradient_x0_map * x0 + gradient_Y_d_map * Y_d)\n";
+  stream << "inline void calculateGradient(const double *x0, const double *Y_d, double *q)\n{\n";
+  generateMatrixProduct(stream, gradient_x0_map_, "x0", "q", false);
+  generateMatrixProduct(stream, gradient_Y_d_map_, "Y_d", "q", true);
+  stream << "}\n\n";
+}
+
+void LinMpcEigen::CodeGenerator::generatePrediction(std::ostream &stream) const 
+{
+  stream << "// X = A_mpc * U + B_mpc * x0\n";
+  stream << "inline void calculateX(const double *U, const double *x0, double *X)\n{\n";
+  generateMatrixProduct(stream, MatNd(A_mpc_), "U", "X", false);
+  generateMatrixProduct(stream, MatNd(B_mpc_), "x0", "X", true);
+  stream << "}\n\n";
+
+  stream << "// Y = C_mpc * X\n";
+  stream << "inline void calculateY(const double *X, double *Y)\n{\n";
+  generateMatrixProduct(stream, MatNd(C_mpc_), "X", "Y", false);
+  stream << "}\n\n";
+}
+
+void LinMpcEigen::CodeGenerator::generateKktSolve(std::ostream &stream) const 
+{
+  stream << "// solves L * L^T * v = r in place, L is the Cholesky factor of the KKT matrix\n";
+  stream << "inline void solveKkt(double *v)\n{\n";
+  for (uint32_t i = 0; i < n_var_; i++) 
+  {
+    stream << "  v[" << i << "] = (v[" << i << "]";
+    for (uint32_t j = 0; j < i; j++) 
+      if (kkt_factor_(i, j) != 0.0) 
+        stream << " - " << literal(kkt_factor_(i, j)) << " * v[" << j << "]";
+    stream << ") * " << literal(1.0 / kkt_factor_(i, i)) << ";\n";
+  }
+  for (int i = n_var_ - 1; i >= 0; i--) 
+  {
+    stream << "  v[" << i << "] = (v[" << i << "]";
+    for (uint32_t j = i + 1; j < n_var_; j++) 
+      if (kkt_factor_(j, i) != 0.0) 
+        stream << " - " << literal(kkt_factor_(j, i)) << " * v[" << j << "]";
+    stream << ") * " << literal(1.0 / kkt_factor_(i, i)) << ";\n";
+  }
+  stream << "}\n\n";
+}
+
+void LinMpcEigen::CodeGenerator::generateResiduals(std::ostream &stream) const 
+{
+  stream << "// infinity norm update\n";
+  stream << "inline double maxAbs(double norm, double value)\n{\n";
+  stream << "  value = value < 0.0 ? -value : value;\n  return value > norm ? value : norm;\n}\n\n";
+  stream << "// true if the primal and dual residuals of the scaled problem are within the tolerances\n";
+  stream << "inline bool converged(const Workspace &workspace, const double *q)\n{\n";
+  stream << "  double Px[n_var];\n";
+  generateMatrixProduct(stream, hessian_, "workspace.x", "Px", false);
+  stream << "  double primal_residual = 0.0, dual_residual = 0.0;\n";
+  stream << "  double x_norm = 0.0, z_norm = 0.0, Px_norm = 0.0, y_norm = 0.0, q_norm = 0.0;\n";
+  stream << "  for (uint32_t i = 0; i < n_var; i++)\n  {\n";
+  stream << "    primal_residual = maxAbs(primal_residual, workspace.x[i] - workspace.z[i]);\n";
+  stream << "    dual_residual = maxAbs(dual_residual, Px[i] + q[i] + workspace.y[i]);\n";
+  stream << "    x_norm = maxAbs(x_norm, workspace.x[i]);\n";
+  stream << "    z_norm = maxAbs(z_norm, workspace.z[i]);\n";
+  stream << "    Px_norm = maxAbs(Px_norm, Px[i]);\n";
+  stream << "    y_norm = maxAbs(y_norm, workspace.y[i]);\n";
+  stream << "    q_norm = maxAbs(q_norm, q[i]);\n";
+  stream << "  }\n";
+  stream << "  const double absolute_tolerance = " << literal(absolute_tolerance_) << ";\n";
+  stream << "  const double relative_tolerance = " << literal(relative_tolerance_) << ";\n";
+  stream << "  double primal_tolerance = absolute_tolerance + relative_tolerance * (x_norm > z_norm ? x_norm : z_norm);\n";
+  stream << "  double dual_norm = Px_norm > y_norm ? Px_norm : y_norm;\n";
+  stream << "  double dual_tolerance = absolute_tolerance + relative_tolerance * (dual_norm > q_norm ? dual_norm : q_norm);\n";
+  stream << "  return primal_residual <= primal_tolerance && dual_residual <= dual_tolerance;\n";
+  stream << "}\n\n";
+}
+
+void LinMpcEigen::CodeGenerator::generateSolve(std::ostream &stream) const 
+{
+  stream << "// optimal input sequence U for the initial state x0 and the reference Y_d, returns the ADMM iterations\n";
+  stream << "inline uint32_t solve(const double *x0, const double *Y_d, Workspace &workspace, double *U)\n{\n";
+  stream << "  double q[n_var];\n  double v[n_var];\n";
+  stream << "  calculateGradient(x0, Y_d, q);\n";
+  if (!bounded_) 
+  {
+    stream << "  (void)workspace;\n";
+    stream << "  for (uint32_t i = 0; i < n_var; i++)\n    v[i] = -q[i];\n";
+    stream << "  solveKkt(v);\n";
+    stream << "  for (uint32_t i = 0; i < n_var; i++)\n    U[i] = input_scaling[i] * v[i];\n";
+    stream << "  return 0;\n";
+    stream << "}\n\n";
+    return;
+  }
+  stream << "  const double rho = " << literal(rho_) << ";\n";
+  stream << "  const double sigma = " << literal(sigma_) << ";\n";
+  stream << "  const double alpha = " << literal(alpha_) << ";\n";
+  stream << "  uint32_t k = 0;\n";
+  stream << "  while (k < admm_iterations)\n  {\n";
+  stream << "    for (uint32_t i = 0; i < n_var; i++)\n";
+  stream << "      v[i] = sigma * workspace.x[i] - q[i] + rho * workspace.z[i] - workspace.y[i];\n";
+  stream << "    solveKkt(v);\n";
+  stream << "    for (uint32_t i = 0; i < n_var; i++)\n    {\n";
+  stream << "      double z_relaxed = alpha * v[i] + (1.0 - alpha) * workspace.z[i];\n";
+  stream << "      workspace.x[i] = alpha * v[i] + (1.0 - alpha) * workspace.x[i];\n";
+  stream << "      double z = z_relaxed + workspace.y[i] / rho;\n";
+  stream << "      z = z < lower_bound[i] ? lower_bound[i] : (z > upper_bound[i] ? upper_bound[i] : z);\n";
+  stream << "      workspace.y[i] += rho * (z_relaxed - z);\n";
+  stream << "      workspace.z[i] = z;\n";
+  stream << "    }\n";
+  stream << "    k++;\n";
+  if (check_termination_ > 0) 
+    stream << "    if (k % " << check_termination_ << " == 0 && converged(workspace, q))\n      break;\n";
+  stream << "  }\n";
+  stream << "  // z satisfies the bounds exactly\n";
+  stream << "  for (uint32_t i = 0; i < n_var; i++)\n    U[i] = input_scaling[i] * workspace.z[i];\n";
+  stream << "  return k;\n";
+  stream << "}\n\n";
+}
@@ -0,0 +1,297 @@
+/**
+ * @file DatasetGenerator.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "DatasetGenerator.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstring>
+#include <limits>
+#include <unistd.h>
+
+namespace {
+
+constexpr char DATASET_MAGIC[8] = { 'L', 'M', 'P', 'C', 'D', 'S', 'E', 'T' };
+
+template <typename T>
+void writePod(std::ostream &stream, const T &value)
+{
+  stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readPod(std::istream &stream, T &value)
+{
+  return (bool)stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+void writeVector(std::ostream &stream, const VecNd &vec)
+{
+  stream.write(reinterpret_cast<const char *>(vec.data()), vec.rows() * sizeof(double));
+}
+
+bool readVector(std::istream &stream, VecNd &vec, uint32_t size)
+{
+  vec.resize(size);
+  return (bool)stream.read(reinterpret_cast<char *>(vec.data()), size * sizeof(double));
+}
+
+}
+
+LinMpcEigen::ParameterSampler LinMpcEigen::makeBoxParameterSampler( const VecNd &x0_lower, const VecNd &x0_upper,
+                                                                    const VecNd &y_d_lower, const VecNd &y_d_upper,
+                                                                    uint32_t horizon )
+{
+  if (x0_lower.rows() != x0_upper.rows() || y_d_lower.rows() != y_d_upper.rows()) 
+    throw std::runtime_error("makeBoxParameterSampler: lower and upper bounds need to be of equal size");
+
+  return [=](std::mt19937_64 &rng, VecNd &x0, VecNd &Y_d)
+  {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    x0.resize(x0_lower.rows());
+    for (Eigen::Index i = 0; i < x0.rows(); i++) 
+      x0(i) = x0_lower(i) + (x0_upper(i) - x0_lower(i)) * uniform(rng);
+
+    VecNd y_d(y_d_lower.rows());
+    for (Eigen::Index i = 0; i < y_d.rows(); i++) 
+      y_d(i) = y_d_lower(i) + (y_d_upper(i) - y_d_lower(i)) * uniform(rng);
+    Y_d = y_d.colwise().replicate(horizon);
+  };
+}
+
+std::vector<uint32_t> LinMpcEigen::nearestNeighbourOrder(const MatNd &samples)
+{
+  uint32_t n = samples.cols();
+  std::vector<uint32_t> order;
+  order.reserve(n);
+  if (n == 0) 
+    return order;
+
+  std::vector<bool> visited(n, false);
+  uint32_t current = 0;
+  for (uint32_t k = 0; k < n; k++) 
+  {
+    visited[current] = true;
+    order.push_back(current);
+
+    double min_distance = std::numeric_limits<double>::infinity();
+    uint32_t next = current;
+    for (uint32_t j = 0; j < n; j++) 
+    {
+      if (visited[j]) 
+        continue;
+      double distance = (samples.col(j) - samples.col(current)).squaredNorm();
+      if (distance < min_distance) 
+      {
+        min_distance = distance;
+        next = j;
+      }
+    }
+    current = next;
+  }
+  return order;
+}
+
+// -------------- DatasetGenerator -----------------
+LinMpcEigen::DatasetGenerator::DatasetGenerator(const LinearSystem &linear_system, uint32_t horizon, 
+                                                const MpcFactory &mpc_factory, const ParameterSampler &sampler)
+  : linear_system_(linear_system), N_(horizon), mpc_factory_(mpc_factory), sampler_(sampler)
+{
+}
+
+LinMpcEigen::DatasetFileHeader LinMpcEigen::DatasetGenerator::makeHeader(const DatasetSpec &spec) const
+{
+  DatasetFileHeader header;
+  std::memcpy(header.magic, DATASET_MAGIC, sizeof(header.magic));
+  header.version = DATASET_FILE_VERSION;
+  header.n_x = linear_system_.n_x;
+  header.n_u = linear_system_.n_u;
+  header.n_y = linear_system_.n_y;
+  header.horizon = N_;
+  header.chunk_size = spec.chunk_size;
+  header.n_samples = spec.n_samples;
+  header.seed = spec.seed;
+  return header;
+}
+
+uint64_t LinMpcEigen::DatasetGenerator::recordBytes() const
+{
+  return (linear_system_.n_x + N_ * (linear_system_.n_y + linear_system_.n_u)) * sizeof(double) 
+         + sizeof(int32_t);
+}
+
+uint64_t LinMpcEigen::DatasetGenerator::resumeFile( const std::string &file_path, 
+                                                    const DatasetFileHeader &header ) const
+{
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file) 
+    return 0;
+
+  DatasetFileHeader file_header;
+  if (!readPod(file, file_header)) 
+    return 0; // not even a complete header, start over
+
+  if ( std::memcmp(file_header.magic, header.magic, sizeof(header.magic)) != 0 ||
+       file_header.version != header.version ||
+       file_header.n_x != header.n_x || file_header.n_u != header.n_u || file_header.n_y != header.n_y ||
+       file_header.horizon != header.horizon || file_header.chunk_size != header.chunk_size ||
+       file_header.n_samples != header.n_samples || file_header.seed != header.seed ) 
+  {
+    throw std::runtime_error("DatasetGenerator: can't resume '" + file_path + 
+                             "', the file was generated with a different configuration");
+  }
+
+  uint64_t n_chunks = 0;
+  uint64_t valid_bytes = sizeof(DatasetFileHeader);
+  DatasetChunkHeader chunk_header;
+  while (readPod(file, chunk_header)) 
+  {
+    if (chunk_header.magic != DATASET_CHUNK_MAGIC || chunk_header.chunk_index != n_chunks) 
+      break;
+    file.seekg(chunk_header.n_records * recordBytes(), std::ios::cur);
+    uint32_t trailer = 0;
+    if (!readPod(file, trailer) || trailer != DATASET_CHUNK_TRAILER) 
+      break;
+    valid_bytes = file.tellg();
+    n_chunks++;
+  }
+  file.close();
+
+  if (truncate(file_path.c_str(), valid_bytes) != 0) 
+    throw std::runtime_error("DatasetGenerator: can't truncate '" + file_path + "'");
+  return n_chunks;
+}
+
+uint64_t LinMpcEigen::DatasetGenerator::run(const std::string &file_path, const DatasetSpec &spec) const
+{
+  if (spec.chunk_size == 0) 
+    throw std::runtime_error("DatasetGenerator: 'chunk_size' needs to be > 0");
+
+  DatasetFileHeader header = makeHeader(spec);
+  uint64_t n_chunks = (spec.n_samples + spec.chunk_size - 1) / spec.chunk_size;
+
+  uint64_t first_chunk = spec.resume ? resumeFile(file_path, header) : 0;
+  std::ofstream file;
+  if (first_chunk > 0) 
+  {
+    file.open(file_path, std::ios::binary | std::ios::app);
+  }
+  else 
+  {
+    file.open(file_path, std::ios::binary | std::ios::trunc);
+    writePod(file, header);
+  }
+  if (!file) 
+    throw std::runtime_error("DatasetGenerator: can't open '" + file_path + "'");
+
+  uint32_t n_x = linear_system_.n_x;
+  uint32_t n_param = n_x + N_ * linear_system_.n_y;
+
+  ThreadPool thread_pool(spec.n_threads);
+  uint32_t n_workers = thread_pool.size();
+  std::vector< std::unique_ptr<MPC> > worker_mpcs(n_workers);
+
+  // chunk buffers, reused for every chunk
+  MatNd parameters(n_param, spec.chunk_size);
+  std::vector<VecNd> solutions(spec.chunk_size);
+  std::vector<int32_t> statuses(spec.chunk_size);
+
+  for (uint64_t chunk = first_chunk; chunk < n_chunks; chunk++) 
+  {
+    uint32_t n_records = std::min<uint64_t>(spec.chunk_size, spec.n_samples - chunk * spec.chunk_size);
+
+    std::seed_seq seed_seq{ (uint32_t)spec.seed, (uint32_t)(spec.seed >> 32), 
+                            (uint32_t)chunk, (uint32_t)(chunk >> 32) };
+    std::mt19937_64 rng(seed_seq);
+    VecNd x0, Y_d;
+    for (uint32_t i = 0; i < n_records; i++) 
+    {
+      sampler_(rng, x0, Y_d);
+      if ((uint32_t)x0.rows() != n_x || (uint32_t)Y_d.rows() != N_ * linear_system_.n_y) 
+        throw std::runtime_error("DatasetGenerator: sampler returned a (x0, Y_d) pair of wrong size");
+      parameters.col(i) << x0, Y_d;
+    }
+
+    // consecutive samples of a worker are close, each solve is warm started with the previous solution
+    std::vector<uint32_t> order = nearestNeighbourOrder(parameters.leftCols(n_records));
+    uint32_t segment_size = (n_records + n_workers - 1) / n_workers;
+
+    thread_pool.parallelFor(n_workers, [&](uint32_t segment, uint32_t worker_id)
+    {
+      uint32_t begin = segment * segment_size;
+      uint32_t end = std::min(n_records, begin + segment_size);
+      for (uint32_t k = begin; k < end; k++) 
+      {
+        uint32_t i = order[k];
+        VecNd sample_x0 = parameters.col(i).segment(0, n_x);
+        VecNd sample_Y_d = parameters.col(i).segment(n_x, n_param - n_x);
+        if (!worker_mpcs[worker_id]) 
+          worker_mpcs[worker_id] = mpc_factory_(linear_system_, sample_Y_d, sample_x0);
+        MPC &mpc = *worker_mpcs[worker_id];
+        if (k == begin) 
+        {
+          // a segment starts from a new solver, not from the last segment this worker happened to solve
+          mpc.setYd(sample_Y_d);
+          mpc.setX0(sample_x0);
+          mpc.initializeSolver();
+        }
+        else
+        {
+          mpc.updateSolver(sample_Y_d, sample_x0);
+          mpc.setWarmStart(solutions[order[k - 1]]);
+        }
+        solutions[i] = mpc.solve();
+        statuses[i] = mpc.getSolverStatus();
+      }
+    });
+
+    DatasetChunkHeader chunk_header{ DATASET_CHUNK_MAGIC, n_records, chunk };
+    writePod(file, chunk_header);
+    for (uint32_t i = 0; i < n_records; i++) 
+    {
+      writeVector(file, parameters.col(i));
+      writeVector(file, solutions[i]);
+      writePod(file, statuses[i]);
+    }
+    writePod(file, DATASET_CHUNK_TRAILER);
+    file.flush();
+    if (!file) 
+      throw std::runtime_error("DatasetGenerator: write to '" + file_path + "' failed");
+  }
+  return n_chunks - first_chunk;
+}
+
+// -------------- DatasetReader -----------------
+LinMpcEigen::DatasetReader::DatasetReader(const std::string &file_path)
+  : file_(file_path, std::ios::binary)
+{
+  if (!file_ || !readPod(file_, header_) || std::memcmp(header_.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC)) != 0) 
+    throw std::runtime_error("DatasetReader: '" + file_path + "' is not a dataset file");
+  if (header_.version != DATASET_FILE_VERSION) 
+    throw std::runtime_error("DatasetReader: unsupported dataset file version");
+}
+
+const LinMpcEigen::DatasetFileHeader &LinMpcEigen::DatasetReader::header() const
+{
+  return header_;
+}
+
+bool LinMpcEigen::DatasetReader::readChunk(std::vector<DatasetRecord> &records)
+{
+  DatasetChunkHeader chunk_header;
+  if (!readPod(file_, chunk_header) || chunk_header.magic != DATASET_CHUNK_MAGIC) 
+    return false;
+
+  records.resize(chunk_header.n_records);
+  for (auto &record : records) 
+  {
+    if ( !readVector(file_, record.x0, header_.n_x) ||
+         !readVector(file_, record.Y_d, header_.horizon * header_.n_y) ||
+         !readVector(file_, record.U, header_.horizon * header_.n_u) ||
+         !readPod(file_, record.status) ) 
+      return false;
+  }
+  uint32_t trailer = 0;
+  return readPod(file_, trailer) && trailer == DATASET_CHUNK_TRAILER;
+}
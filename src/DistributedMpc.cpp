@@ -0,0 +1,185 @@
+/**
+ * @file DistributedMpc.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "DistributedMpc.hpp"
+
+#include <cmath>
+
+LinMpcEigen::DistributedMPC::DistributedMPC( std::vector< std::unique_ptr<MPC> > subsystem_mpcs,
+                                             const std::vector<CouplingSpec> &couplings, uint32_t n_global,
+                                             double rho, double tolerance, uint32_t max_iterations,
+                                             uint32_t n_threads )
+  : subsystem_mpcs_(std::move(subsystem_mpcs)), couplings_(couplings), n_global_(n_global),
+    rho_(rho), tolerance_(tolerance), max_iterations_(max_iterations),
+    thread_pool_(std::min<uint32_t>(n_threads == 0 ? std::thread::hardware_concurrency() : n_threads, 
+                                    subsystem_mpcs_.size()))
+{
+  checkCouplingDimensions();
+
+  uint32_t n_subsystems = subsystem_mpcs_.size();
+  z_ = VecNd::Zero(n_global_);
+  z_count_ = VecNd::Zero(n_global_);
+  lambda_.resize(n_subsystems);
+  coupling_offset_.resize(n_subsystems);
+  coupling_value_.resize(n_subsystems);
+  U_.resize(n_subsystems);
+  for (uint32_t i = 0; i < n_subsystems; i++) 
+  {
+    uint32_t n_c = couplings_[i].global_indices.size();
+    lambda_[i] = VecNd::Zero(n_c);
+    coupling_offset_[i] = VecNd::Zero(n_c);
+    coupling_value_[i] = VecNd::Zero(n_c);
+    for (uint32_t g : couplings_[i].global_indices) 
+      z_count_(g) += 1.0;
+  }
+}
+
+void LinMpcEigen::DistributedMPC::checkCouplingDimensions() const
+{
+  std::ostringstream msg;
+  if (rho_ <= 0.0) 
+    throw std::runtime_error("DistributedMPC: 'rho' needs to be > 0");
+  if (couplings_.size() != subsystem_mpcs_.size()) 
+  {
+    msg << "DistributedMPC: " << subsystem_mpcs_.size() << " subsystem MPCs and " 
+        << couplings_.size() << " coupling specifications given";
+    throw std::runtime_error(msg.str());
+  }
+  for (uint32_t i = 0; i < couplings_.size(); i++) 
+  {
+    const CouplingSpec &coupling = couplings_[i];
+    const MPC &mpc = *subsystem_mpcs_[i];
+    uint32_t n_c = coupling.global_indices.size();
+    if ( (uint32_t)coupling.coupling_matrix.rows() != n_c || 
+         (uint32_t)coupling.coupling_matrix.cols() != mpc.getHorizon() * mpc.getLinearSystem().n_u ) 
+    {
+      msg << "DistributedMPC: subsystem " << i << " 'coupling_matrix' needs to be (" << n_c << " x " 
+          << mpc.getHorizon() * mpc.getLinearSystem().n_u << ")";
+      throw std::runtime_error(msg.str());
+    }
+    if ( coupling.coupling_x0_map.size() != 0 && 
+         ( (uint32_t)coupling.coupling_x0_map.rows() != n_c || 
+           (uint32_t)coupling.coupling_x0_map.cols() != mpc.getLinearSystem().n_x ) ) 
+    {
+      msg << "DistributedMPC: subsystem " << i << " 'coupling_x0_map' needs to be empty or (" << n_c << " x " 
+          << mpc.getLinearSystem().n_x << ")";
+      throw std::runtime_error(msg.str());
+    }
+    for (uint32_t g : coupling.global_indices) 
+    {
+      if (g >= n_global_) 
+      {
+        msg << "DistributedMPC: subsystem " << i << " global index " << g << " out of range";
+        throw std::runtime_error(msg.str());
+      }
+    }
+  }
+}
+
+void LinMpcEigen::DistributedMPC::initializeSolver()
+{
+  thread_pool_.parallelFor(subsystem_mpcs_.size(), [&](uint32_t i, uint32_t)
+  {
+    subsystem_mpcs_[i]->setProximalTerm(couplings_[i].coupling_matrix, rho_);
+    subsystem_mpcs_[i]->initializeSolver();
+  });
+}
+
+void LinMpcEigen::DistributedMPC::updateSolver(const std::vector<VecNd> &Y_d, const std::vector<VecNd> &x0)
+{
+  if (Y_d.size() != subsystem_mpcs_.size() || x0.size() != subsystem_mpcs_.size()) 
+    throw std::runtime_error("DistributedMPC: one (Y_d, x0) pair per subsystem is needed");
+
+  thread_pool_.parallelFor(subsystem_mpcs_.size(), [&](uint32_t i, uint32_t)
+  {
+    subsystem_mpcs_[i]->updateSolver(Y_d[i], x0[i]);
+    if (couplings_[i].coupling_x0_map.size() != 0) 
+      coupling_offset_[i] = couplings_[i].coupling_x0_map * x0[i];
+  });
+}
+
+VecNd LinMpcEigen::DistributedMPC::gatherGlobal(uint32_t i) const
+{
+  const std::vector<uint32_t> &indices = couplings_[i].global_indices;
+  VecNd z_i(indices.size());
+  for (uint32_t r = 0; r < indices.size(); r++) 
+    z_i(r) = z_(indices[r]);
+  return z_i;
+}
+
+std::vector<VecNd> LinMpcEigen::DistributedMPC::solve()
+{
+  uint32_t n_subsystems = subsystem_mpcs_.size();
+  solve_info_ = DistributedSolveInfo();
+
+  for (uint32_t k = 0; k < max_iterations_; k++) 
+  {
+    // local QPs
+    thread_pool_.parallelFor(n_subsystems, [&](uint32_t i, uint32_t)
+    {
+      const SparseMat &E = couplings_[i].coupling_matrix;
+      VecNd offset = rho_ * (E.transpose() * (coupling_offset_[i] - gatherGlobal(i) + lambda_[i]));
+      subsystem_mpcs_[i]->updateGradientOffset(offset);
+      U_[i] = subsystem_mpcs_[i]->solve();
+      coupling_value_[i] = E * U_[i] + coupling_offset_[i];
+    });
+
+    // consensus
+    VecNd z_previous = z_;
+    VecNd z_sum = VecNd::Zero(n_global_);
+    for (uint32_t i = 0; i < n_subsystems; i++) 
+    {
+      const std::vector<uint32_t> &indices = couplings_[i].global_indices;
+      for (uint32_t r = 0; r < indices.size(); r++) 
+        z_sum(indices[r]) += coupling_value_[i](r) + lambda_[i](r);
+    }
+    for (uint32_t g = 0; g < n_global_; g++) 
+      z_(g) = z_count_(g) > 0.0 ? z_sum(g) / z_count_(g) : 0.0;
+
+    // dual update and residuals
+    double primal_residual_sq = 0.0;
+    double dual_residual_sq = 0.0;
+    for (uint32_t i = 0; i < n_subsystems; i++) 
+    {
+      VecNd residual = coupling_value_[i] - gatherGlobal(i);
+      lambda_[i] += residual;
+      primal_residual_sq += residual.squaredNorm();
+
+      const std::vector<uint32_t> &indices = couplings_[i].global_indices;
+      for (uint32_t r = 0; r < indices.size(); r++) 
+        dual_residual_sq += std::pow(z_(indices[r]) - z_previous(indices[r]), 2);
+    }
+
+    solve_info_.iterations = k + 1;
+    solve_info_.primal_residual = std::sqrt(primal_residual_sq);
+    solve_info_.dual_residual = rho_ * std::sqrt(dual_residual_sq);
+    if (solve_info_.primal_residual <= tolerance_ && solve_info_.dual_residual <= tolerance_) 
+    {
+      solve_info_.converged = true;
+      break;
+    }
+  }
+  return U_;
+}
+
+const LinMpcEigen::DistributedSolveInfo &LinMpcEigen::DistributedMPC::getSolveInfo() const
+{
+  return solve_info_;
+}
+
+const VecNd &LinMpcEigen::DistributedMPC::getCouplingVariables() const
+{
+  return z_;
+}
+
+uint32_t LinMpcEigen::DistributedMPC::getNumberOfSubsystems() const
+{
+  return subsystem_mpcs_.size();
+}
+
+LinMpcEigen::MPC &LinMpcEigen::DistributedMPC::getSubsystemMPC(uint32_t i)
+{
+  return *subsystem_mpcs_.at(i);
+}
@@ -0,0 +1,234 @@
+/**
+ * @file FlightRecorder.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "FlightRecorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <osqp.h>
+#include <sstream>
+
+namespace {
+
+const char dump_magic[4] = {'L', 'M', 'F', 'R'};
+const uint32_t dump_version = 1;
+
+template <typename T>
+void writeValue(std::ostream &stream, const T &value)
+{
+  stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T readValue(std::istream &stream)
+{
+  T value;
+  stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+  if (!stream)
+    throw std::runtime_error("FlightRecorder: truncated dump");
+  return value;
+}
+
+} // namespace
+
+LinMpcEigen::FlightRecorder::FlightRecorder(uint32_t capacity, uint32_t n_x, uint32_t n_u,
+                                            const std::string &fault_dump_prefix)
+  : capacity_(capacity), n_x_(n_x), n_u_(n_u),
+  slots_(new Slot[capacity]),
+  data_((n_x + n_u) * (size_t)capacity, 0.0),
+  fault_dump_prefix_(fault_dump_prefix)
+{
+  if (capacity_ == 0)
+    throw std::runtime_error("FlightRecorder: capacity needs to be > 0");
+  if (!fault_dump_prefix_.empty())
+    fault_dump_thread_ = std::thread(&FlightRecorder::faultDumpLoop, this);
+}
+
+LinMpcEigen::FlightRecorder::~FlightRecorder()
+{
+  if (fault_dump_thread_.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(fault_mutex_);
+      stop_ = true;
+    }
+    fault_cv_.notify_one();
+    fault_dump_thread_.join();
+  }
+}
+
+void LinMpcEigen::FlightRecorder::record(const double *x0, const double *u0, int status,
+                                         uint32_t iterations, double latency)
+{
+  uint64_t tick = next_tick_.load(std::memory_order_relaxed);
+  Slot &slot = slots_[tick % capacity_];
+  double *data = &data_[(tick % capacity_) * (n_x_ + n_u_)];
+
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.tick = tick;
+  slot.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+  slot.status = status;
+  slot.iterations = iterations;
+  slot.latency = latency;
+  std::copy(x0, x0 + n_x_, data);
+  std::copy(u0, u0 + n_u_, data + n_x_);
+  slot.sequence.store(tick + 1, std::memory_order_release);
+  next_tick_.store(tick + 1, std::memory_order_release);
+
+  if (!fault_dump_prefix_.empty() && isFault(status))
+  {
+    last_fault_tick_.store(tick, std::memory_order_relaxed);
+    fault_count_.fetch_add(1, std::memory_order_release);
+    fault_cv_.notify_one(); // no lock, a missed wake-up is caught by the timed wait
+  }
+}
+
+std::vector<LinMpcEigen::FlightRecord> LinMpcEigen::FlightRecorder::snapshot() const
+{
+  uint64_t next_tick = next_tick_.load(std::memory_order_acquire);
+  uint64_t first_tick = next_tick > capacity_ ? next_tick - capacity_ : 0;
+
+  std::vector<FlightRecord> records;
+  records.reserve(next_tick - first_tick);
+  for (uint64_t tick = first_tick; tick < next_tick; tick++)
+  {
+    const Slot &slot = slots_[tick % capacity_];
+    const double *data = &data_[(tick % capacity_) * (n_x_ + n_u_)];
+
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    FlightRecord record;
+    record.tick = slot.tick;
+    record.time = slot.time;
+    record.status = slot.status;
+    record.iterations = slot.iterations;
+    record.latency = slot.latency;
+    record.x0 = Eigen::Map<const Eigen::VectorXd>(data, n_x_);
+    record.u0 = Eigen::Map<const Eigen::VectorXd>(data + n_x_, n_u_);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // skip slots that were overwritten by a newer record while being copied
+    if (sequence != tick + 1 || slot.sequence.load(std::memory_order_relaxed) != sequence)
+      continue;
+    records.push_back(std::move(record));
+  }
+  return records;
+}
+
+void LinMpcEigen::FlightRecorder::dump(const std::string &file_path) const
+{
+  std::vector<FlightRecord> records = snapshot();
+  std::ofstream file(file_path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("FlightRecorder: can't open '" + file_path + "'");
+
+  file.write(dump_magic, sizeof(dump_magic));
+  writeValue<uint32_t>(file, dump_version);
+  writeValue<uint32_t>(file, n_x_);
+  writeValue<uint32_t>(file, n_u_);
+  writeValue<uint64_t>(file, records.size());
+  for (const auto &record : records)
+  {
+    writeValue<uint64_t>(file, record.tick);
+    writeValue<int64_t>(file, record.time);
+    writeValue<int32_t>(file, record.status);
+    writeValue<uint32_t>(file, record.iterations);
+    writeValue<double>(file, record.latency);
+    file.write(reinterpret_cast<const char *>(record.x0.data()), n_x_ * sizeof(double));
+    file.write(reinterpret_cast<const char *>(record.u0.data()), n_u_ * sizeof(double));
+  }
+  if (!file)
+    throw std::runtime_error("FlightRecorder: can't write '" + file_path + "'");
+}
+
+std::vector<LinMpcEigen::FlightRecord> LinMpcEigen::FlightRecorder::loadDump(const std::string &file_path)
+{
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("FlightRecorder: can't open '" + file_path + "'");
+
+  char magic[sizeof(dump_magic)];
+  file.read(magic, sizeof(magic));
+  if (!file || !std::equal(magic, magic + sizeof(magic), dump_magic))
+    throw std::runtime_error("FlightRecorder: '" + file_path + "' is not a flight recorder dump");
+  uint32_t version = readValue<uint32_t>(file);
+  if (version != dump_version)
+  {
+    std::ostringstream msg;
+    msg << "FlightRecorder: dump version " << version << " is not supported, needs to be " << dump_version << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  uint32_t n_x = readValue<uint32_t>(file);
+  uint32_t n_u = readValue<uint32_t>(file);
+  uint64_t n_records = readValue<uint64_t>(file);
+
+  std::vector<FlightRecord> records;
+  for (uint64_t i = 0; i < n_records; i++)
+  {
+    FlightRecord record;
+    record.tick = readValue<uint64_t>(file);
+    record.time = readValue<int64_t>(file);
+    record.status = readValue<int32_t>(file);
+    record.iterations = readValue<uint32_t>(file);
+    record.latency = readValue<double>(file);
+    record.x0.resize(n_x);
+    record.u0.resize(n_u);
+    file.read(reinterpret_cast<char *>(record.x0.data()), n_x * sizeof(double));
+    file.read(reinterpret_cast<char *>(record.u0.data()), n_u * sizeof(double));
+    if (!file)
+      throw std::runtime_error("FlightRecorder: truncated dump");
+    records.push_back(std::move(record));
+  }
+  return records;
+}
+
+uint32_t LinMpcEigen::FlightRecorder::capacity() const
+{
+  return capacity_;
+}
+
+uint64_t LinMpcEigen::FlightRecorder::getTickCount() const
+{
+  return next_tick_.load(std::memory_order_acquire);
+}
+
+uint64_t LinMpcEigen::FlightRecorder::getFaultCount() const
+{
+  return fault_count_.load(std::memory_order_acquire);
+}
+
+bool LinMpcEigen::FlightRecorder::isFault(int status)
+{
+  return status != OSQP_SOLVED && status != OSQP_SOLVED_INACCURATE;
+}
+
+void LinMpcEigen::FlightRecorder::faultDumpLoop()
+{
+  std::unique_lock<std::mutex> lock(fault_mutex_);
+  while (!stop_)
+  {
+    fault_cv_.wait_for(lock, std::chrono::milliseconds(100), [this] {
+      return stop_ || fault_count_.load(std::memory_order_acquire) != dumped_fault_count_;
+    });
+    uint64_t fault_count = fault_count_.load(std::memory_order_acquire);
+    if (fault_count == dumped_fault_count_)
+      continue;
+    // one dump for a burst of faults, named after the latest one
+    dumped_fault_count_ = fault_count;
+    std::string file_path = fault_dump_prefix_ + "_" + std::to_string(last_fault_tick_.load()) + ".bin";
+    lock.unlock();
+    try
+    {
+      dump(file_path);
+    }
+    catch (const std::exception &exception)
+    {
+      std::cerr << exception.what() << "\n";
+    }
+    lock.lock();
+  }
+}
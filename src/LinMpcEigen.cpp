@@ -1,4 +1,196 @@
 #include "LinMpcEigen.hpp"
+#include "PolicyMpc.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+template <typename Dense>
+Dense applyStructuredDense( const SparseMat &matrix, const LinMpcEigen::MatrixStructureInfo &structure, 
+                            const Dense &input ) 
+{
+  switch (structure.type) 
+  {
+    case LinMpcEigen::MatrixStructure::DIAGONAL:
+      return structure.diagonal.asDiagonal() * input;
+    case LinMpcEigen::MatrixStructure::SELECTION:
+    {
+      Dense output(structure.selected_columns.size(), input.cols());
+      for (uint32_t i = 0; i < structure.selected_columns.size(); i++) 
+        output.row(i) = input.row(structure.selected_columns[i]);
+      return output;
+    }
+    default:
+      return matrix * input;
+  }
+}
+
+void appendBlockTriplets( std::vector<Eigen::Triplet<double>> &triplets, const SparseMat &block, 
+                          uint32_t i, uint32_t j ) 
+{
+  for (int k = 0; k < block.outerSize(); ++k) 
+    for (SparseMat::InnerIterator it(block, k); it; ++it) 
+      triplets.emplace_back(it.row() + i, it.col() + j, it.value());
+}
+
+// structure of C_mpc = blockdiag(C, ..., C)
+LinMpcEigen::MatrixStructureInfo stackedOutputStructure(const LinMpcEigen::LinearSystem &linear_system, 
+                                                        uint32_t horizon) 
+{
+  const LinMpcEigen::MatrixStructureInfo &structure = linear_system.C_structure;
+  LinMpcEigen::MatrixStructureInfo stacked;
+  stacked.type = structure.type;
+  if (structure.type == LinMpcEigen::MatrixStructure::SELECTION) 
+  {
+    for (uint32_t k = 0; k < horizon; k++) 
+      for (uint32_t column : structure.selected_columns) 
+        stacked.selected_columns.push_back(k * linear_system.n_x + column);
+  }
+  else if (structure.type == LinMpcEigen::MatrixStructure::DIAGONAL) 
+    stacked.diagonal = structure.diagonal.colwise().replicate(horizon);
+  else
+    stacked.type = LinMpcEigen::MatrixStructure::GENERAL;
+  return stacked;
+}
+
+SparseMat outputMatrixSequence(const LinMpcEigen::LinearSystem &linear_system, uint32_t horizon) 
+{
+  SparseMat C_mpc(horizon * linear_system.n_y, horizon * linear_system.n_x);
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (uint32_t k = 0; k < horizon; k++) 
+    appendBlockTriplets(triplets, linear_system.C, linear_system.n_y * k, linear_system.n_x * k);
+  C_mpc.setFromTriplets(triplets.begin(), triplets.end());
+  return C_mpc;
+}
+
+// -------------- checkpoint serialization -----------------
+const char checkpoint_magic[4] = {'L', 'M', 'P', 'C'};
+const uint32_t checkpoint_version = 1;
+
+template <typename T>
+void writeValue(std::ostream &stream, const T &value) 
+{
+  stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T readValue(std::istream &stream) 
+{
+  T value;
+  stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+  if (!stream) 
+    throw std::runtime_error("MPC: truncated checkpoint");
+  return value;
+}
+
+// sizes read from a checkpoint are bounded by the bytes left in the stream before anything is allocated
+uint64_t remainingBytes(std::istream &stream) 
+{
+  std::streampos position = stream.tellg();
+  stream.seekg(0, std::ios::end);
+  std::streampos end = stream.tellg();
+  stream.seekg(position);
+  if (!stream || position < 0 || end < position) 
+    throw std::runtime_error("MPC: checkpoint stream is not seekable");
+  return (uint64_t)(end - position);
+}
+
+uint64_t readSize(std::istream &stream, uint64_t element_size) 
+{
+  uint64_t size = readValue<uint64_t>(stream);
+  if (size > remainingBytes(stream) / element_size) 
+    throw std::runtime_error("MPC: truncated checkpoint");
+  return size;
+}
+
+void writeVector(std::ostream &stream, const VecNd &vector) 
+{
+  writeValue<uint64_t>(stream, vector.rows());
+  stream.write(reinterpret_cast<const char *>(vector.data()), vector.rows() * sizeof(double));
+}
+
+VecNd readVector(std::istream &stream) 
+{
+  VecNd vector(readSize(stream, sizeof(double)));
+  stream.read(reinterpret_cast<char *>(vector.data()), vector.rows() * sizeof(double));
+  if (!stream) 
+    throw std::runtime_error("MPC: truncated checkpoint");
+  return vector;
+}
+
+// compressed column storage: rows, cols, nonzeros, outer indices, inner indices, values
+void writeSparse(std::ostream &stream, SparseMat matrix) 
+{
+  matrix.makeCompressed();
+  writeValue<uint64_t>(stream, matrix.rows());
+  writeValue<uint64_t>(stream, matrix.cols());
+  writeValue<uint64_t>(stream, matrix.nonZeros());
+  stream.write(reinterpret_cast<const char *>(matrix.outerIndexPtr()), (matrix.cols() + 1) * sizeof(int));
+  stream.write(reinterpret_cast<const char *>(matrix.innerIndexPtr()), matrix.nonZeros() * sizeof(int));
+  stream.write(reinterpret_cast<const char *>(matrix.valuePtr()), matrix.nonZeros() * sizeof(double));
+}
+
+SparseMat readSparse(std::istream &stream) 
+{
+  uint64_t rows = readValue<uint64_t>(stream);
+  uint64_t cols = readValue<uint64_t>(stream);
+  uint64_t non_zeros = readValue<uint64_t>(stream);
+  uint64_t remaining = remainingBytes(stream);
+  if (cols >= remaining / sizeof(int) || 
+      non_zeros > (remaining - (cols + 1) * sizeof(int)) / (sizeof(int) + sizeof(double))) 
+    throw std::runtime_error("MPC: truncated checkpoint");
+  if (rows > (uint64_t)std::numeric_limits<int>::max()) 
+    throw std::runtime_error("MPC: corrupted sparse matrix in checkpoint");
+  std::vector<int> outer_index(cols + 1), inner_index(non_zeros);
+  std::vector<double> values(non_zeros);
+  stream.read(reinterpret_cast<char *>(outer_index.data()), outer_index.size() * sizeof(int));
+  stream.read(reinterpret_cast<char *>(inner_index.data()), inner_index.size() * sizeof(int));
+  stream.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(double));
+  if (!stream || outer_index.front() != 0 || (uint64_t)outer_index.back() != non_zeros) 
+    throw std::runtime_error("MPC: corrupted sparse matrix in checkpoint");
+  // outer indices non-decreasing, inner indices strictly increasing within a column and inside [0, rows)
+  for (uint64_t j = 0; j < cols; j++) 
+  {
+    if (outer_index[j] > outer_index[j + 1]) 
+      throw std::runtime_error("MPC: corrupted sparse matrix in checkpoint");
+    for (int k = outer_index[j]; k < outer_index[j + 1]; k++) 
+    {
+      if (inner_index[k] < 0 || (uint64_t)inner_index[k] >= rows || 
+          (k > outer_index[j] && inner_index[k] <= inner_index[k - 1])) 
+        throw std::runtime_error("MPC: corrupted sparse matrix in checkpoint");
+    }
+  }
+  return Eigen::Map<const SparseMat>(rows, cols, non_zeros, outer_index.data(), 
+                                     inner_index.data(), values.data());
+}
+
+void writeString(std::ostream &stream, const std::string &string) 
+{
+  writeValue<uint64_t>(stream, string.size());
+  stream.write(string.data(), string.size());
+}
+
+std::string readString(std::istream &stream) 
+{
+  std::string string(readSize(stream, 1), '\0');
+  stream.read(&string[0], string.size());
+  if (!stream) 
+    throw std::runtime_error("MPC: truncated checkpoint");
+  return string;
+}
+
+// MPC2_BOUND_CONSTRAINED_2 bounds only the second state entry x[1], x_lower_bound and x_upper_bound 
+// have size n_x but their other entries are not used
+LinMpcEigen::StateBounds secondStateEntryBounds(const VecNd &x_lower_bound, const VecNd &x_upper_bound) 
+{
+  return LinMpcEigen::StateBounds(x_lower_bound, x_upper_bound, {1});
+}
+
+} // namespace
 
 void LinMpcEigen::setSparseBlock( Eigen::SparseMatrix<double> &output_matrix, const Eigen::SparseMatrix<double> &input_block,
                                   uint32_t i, uint32_t j) 
@@ -63,6 +255,117 @@ LinMpcEigen::LinearSystem::LinearSystem(const SparseMat &A, const SparseMat &B,
   : A(A), B(B), C(C), D(D), n_x(A.cols()), n_u(B.cols()), n_y(C.rows())
 {
   checkMatrixDimensions();
+  detectStructure();
+}
+
+void LinMpcEigen::LinearSystem::detectStructure() 
+{
+  A_structure = detectMatrixStructure(A);
+  B_structure = detectMatrixStructure(B);
+  C_structure = detectMatrixStructure(C);
+}
+
+VecNd LinMpcEigen::LinearSystem::stepState(const VecNd &x, const VecNd &u) const 
+{
+  return applyStructuredDense(A, A_structure, x) + applyStructuredDense(B, B_structure, u);
+}
+
+VecNd LinMpcEigen::LinearSystem::output(const VecNd &x) const 
+{
+  return applyStructuredDense(C, C_structure, x);
+}
+
+LinMpcEigen::MatrixStructureInfo LinMpcEigen::detectMatrixStructure(const SparseMat &matrix) 
+{
+  MatrixStructureInfo info;
+  SparseMat pruned = matrix.pruned();
+  uint32_t rows = pruned.rows();
+  uint32_t cols = pruned.cols();
+  bool square = (rows == cols);
+
+  std::vector<uint32_t> row_nonzeros(rows, 0);
+  std::vector<uint32_t> row_column(rows, 0);
+  bool unit_values = true;
+  uint32_t bandwidth = 0;
+  for (int k = 0; k < pruned.outerSize(); ++k) 
+    for (SparseMat::InnerIterator it(pruned, k); it; ++it) 
+    {
+      row_nonzeros[it.row()]++;
+      row_column[it.row()] = it.col();
+      unit_values = unit_values && (it.value() == 1.0);
+      bandwidth = std::max<uint32_t>(bandwidth, std::abs((int)it.row() - (int)it.col()));
+    }
+
+  if (square && bandwidth == 0) 
+  {
+    info.type = MatrixStructure::DIAGONAL;
+    info.diagonal = VecNd(pruned.diagonal());
+    return info;
+  }
+  if (unit_values && std::all_of(row_nonzeros.begin(), row_nonzeros.end(), [](uint32_t n) { return n == 1; })) 
+  {
+    info.type = MatrixStructure::SELECTION;
+    info.selected_columns = row_column;
+    return info;
+  }
+  if (!square || rows < 2) 
+    return info;
+
+  for (uint32_t block_size = 1; block_size <= rows / 2; block_size++) 
+  {
+    if (rows % block_size != 0) 
+      continue;
+    bool block_diagonal = true;
+    for (int k = 0; k < pruned.outerSize() && block_diagonal; ++k) 
+      for (SparseMat::InnerIterator it(pruned, k); it; ++it) 
+        if (it.row() / block_size != it.col() / block_size) 
+        {
+          block_diagonal = false;
+          break;
+        }
+    if (block_diagonal) 
+    {
+      info.type = MatrixStructure::BLOCK_DIAGONAL;
+      info.block_size = block_size;
+      return info;
+    }
+  }
+  if (2 * bandwidth + 1 < rows) 
+  {
+    info.type = MatrixStructure::BANDED;
+    info.bandwidth = bandwidth;
+  }
+  return info;
+}
+
+MatNd LinMpcEigen::applyStructuredMatrix(const SparseMat &matrix, const MatrixStructureInfo &structure, 
+                                         const MatNd &input) 
+{
+  return applyStructuredDense(matrix, structure, input);
+}
+
+SparseMat LinMpcEigen::applyStructuredMatrix(const SparseMat &matrix, const MatrixStructureInfo &structure, 
+                                             const SparseMat &input) 
+{
+  if (structure.type == MatrixStructure::DIAGONAL) 
+    return structure.diagonal.asDiagonal() * input;
+  if (structure.type != MatrixStructure::SELECTION) 
+    return matrix * input;
+
+  // row gather, output row i is input row selected_columns[i]
+  std::vector< std::vector<uint32_t> > output_rows(input.rows());
+  for (uint32_t i = 0; i < structure.selected_columns.size(); i++) 
+    output_rows[structure.selected_columns[i]].push_back(i);
+
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int k = 0; k < input.outerSize(); ++k) 
+    for (SparseMat::InnerIterator it(input, k); it; ++it) 
+      for (uint32_t row : output_rows[it.row()]) 
+        triplets.emplace_back(row, it.col(), it.value());
+
+  SparseMat output(structure.selected_columns.size(), input.cols());
+  output.setFromTriplets(triplets.begin(), triplets.end());
+  return output;
 }
 
 void LinMpcEigen::LinearSystem::checkMatrixDimensions() const 
@@ -102,17 +405,110 @@ void LinMpcEigen::LinearSystem::checkMatrixDimensions() const
   }
 }
 
+void LinMpcEigen::setupPredictionMatrices( const LinearSystem &linear_system, uint32_t horizon,
+                                           SparseMat &A_mpc, SparseMat &B_mpc, SparseMat &C_mpc ) 
+{
+  uint32_t n_x = linear_system.n_x;
+  uint32_t n_u = linear_system.n_u;
+  uint32_t n_y = linear_system.n_y;
+  
+  // A_mpc is block Toeplitz, the blocks A^k * B and A^(k+1) are computed once, 
+  // each from the previous one with the kernel for the structure of A
+  std::vector<SparseMat> A_pow_B(horizon), A_pow(horizon);
+  for (uint32_t k = 0; k < horizon; k++) 
+  {
+    A_pow_B[k] = (k == 0) ? linear_system.B 
+                          : applyStructuredMatrix(linear_system.A, linear_system.A_structure, A_pow_B[k-1]);
+    A_pow[k] = (k == 0) ? linear_system.A 
+                        : applyStructuredMatrix(linear_system.A, linear_system.A_structure, A_pow[k-1]);
+  }
+
+  std::vector<Eigen::Triplet<double>> triplets_A, triplets_B, triplets_C;
+  for (uint32_t i = 0; i < horizon; i++) 
+  {
+    appendBlockTriplets(triplets_B, A_pow[i], n_x * i, 0);
+    appendBlockTriplets(triplets_C, linear_system.C, n_y * i, n_x * i);
+    for (uint32_t j = 0; j <= i; j++) 
+      appendBlockTriplets(triplets_A, A_pow_B[i-j], n_x * i, n_u * j);
+  }
+  A_mpc.setFromTriplets(triplets_A.begin(), triplets_A.end());
+  B_mpc.setFromTriplets(triplets_B.begin(), triplets_B.end());
+  C_mpc.setFromTriplets(triplets_C.begin(), triplets_C.end());
+}
+
+SparseMat LinMpcEigen::applyOutputMatrix(const LinearSystem &linear_system, uint32_t horizon, const SparseMat &M) 
+{
+  MatrixStructureInfo structure = stackedOutputStructure(linear_system, horizon);
+  if (structure.type == MatrixStructure::GENERAL) 
+    return outputMatrixSequence(linear_system, horizon) * M;
+  return applyStructuredMatrix(SparseMat(), structure, M);
+}
+
+VecNd LinMpcEigen::rolloutStates(const LinearSystem &linear_system, const VecNd &U, const VecNd &x0) 
+{
+  uint32_t n_x = linear_system.n_x;
+  uint32_t n_u = linear_system.n_u;
+  uint32_t horizon = U.rows() / n_u;
+  VecNd X(horizon * n_x);
+  VecNd x = x0;
+  for (uint32_t k = 0; k < horizon; k++) 
+  {
+    x = linear_system.stepState(x, U.segment(k * n_u, n_u));
+    X.segment(k * n_x, n_x) = x;
+  }
+  return X;
+}
+
+void LinMpcEigen::rolloutStates(const LinearSystem &linear_system, const VecNd &U, const VecNd &x0, VecNd &X) 
+{
+  uint32_t n_x = linear_system.n_x;
+  uint32_t n_u = linear_system.n_u;
+  uint32_t horizon = U.rows() / n_u;
+  X.resize(horizon * n_x);
+  for (uint32_t k = 0; k < horizon; k++) 
+  {
+    // plain sparse products, the structured kernels return temporaries
+    if (k == 0) 
+      X.head(n_x).noalias() = linear_system.A * x0;
+    else
+      X.segment(k * n_x, n_x).noalias() = linear_system.A * X.segment((k - 1) * n_x, n_x);
+    X.segment(k * n_x, n_x).noalias() += linear_system.B * U.segment(k * n_u, n_u);
+  }
+}
+
+void LinMpcEigen::outputSequence(const LinearSystem &linear_system, const VecNd &X, VecNd &Y) 
+{
+  uint32_t n_x = linear_system.n_x;
+  uint32_t n_y = linear_system.n_y;
+  uint32_t horizon = X.rows() / n_x;
+  Y.resize(horizon * n_y);
+  for (uint32_t k = 0; k < horizon; k++) 
+    Y.segment(k * n_y, n_y).noalias() = linear_system.C * X.segment(k * n_x, n_x);
+}
+
+VecNd LinMpcEigen::outputSequence(const LinearSystem &linear_system, const VecNd &X) 
+{
+  uint32_t n_x = linear_system.n_x;
+  uint32_t n_y = linear_system.n_y;
+  uint32_t horizon = X.rows() / n_x;
+  VecNd Y(horizon * n_y);
+  for (uint32_t k = 0; k < horizon; k++) 
+    Y.segment(k * n_y, n_y) = linear_system.output(X.segment(k * n_x, n_x));
+  return Y;
+}
+
 // -------------- MPC -----------------
 LinMpcEigen::MPC::MPC(const LinearSystem &linear_system, uint32_t horizon, 
                       const VecNd &Y_d, const VecNd &x0, double Q, double R,
-                      double solver_time_limit) 
+                      double solver_time_limit, const OsqpSettings &solver_settings) 
 : linear_system_(linear_system), N_(horizon), Y_d_(Y_d), x0_(x0), Q_(Q), R_(R),
   A_mpc_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_u)),
   B_mpc_(SparseMat(N_ * linear_system_.n_x, linear_system_.n_x)),
   C_mpc_(SparseMat(N_ * linear_system_.n_y, N_ * linear_system_.n_x)),
-  solver_time_limit_(solver_time_limit)
+  solver_time_limit_(solver_time_limit), solver_settings_(solver_settings)
 {
   mpc_type_ = MPC1;
+  policy_ = std::make_unique<MpcPolicyPair<OutputTrackingCost>>(OutputTrackingCost(Q_, R_));
   checkMatrixDimensions();
   setupMpcDynamics();
 }
@@ -120,15 +516,17 @@ LinMpcEigen::MPC::MPC(const LinearSystem &linear_system, uint32_t horizon,
 LinMpcEigen::MPC::MPC(const LinearSystem &linear_system, uint32_t horizon, 
                       const VecNd &Y_d, const VecNd &x0, double Q, double R,
                       const VecNd &u_lower_bound, const VecNd &u_upper_bound,
-                      double solver_time_limit) 
+                      double solver_time_limit, const OsqpSettings &solver_settings) 
 : linear_system_(linear_system), N_(horizon), Y_d_(Y_d), x0_(x0), Q_(Q), R_(R),
   u_lower_bound_(u_lower_bound), u_upper_bound_(u_upper_bound),
   A_mpc_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_u)),
   B_mpc_(SparseMat(N_ * linear_system_.n_x, linear_system_.n_x)),
   C_mpc_(SparseMat(N_ * linear_system_.n_y, N_ * linear_system_.n_x)),
-  solver_time_limit_(solver_time_limit)
+  solver_time_limit_(solver_time_limit), solver_settings_(solver_settings)
 {
   mpc_type_ = MPC1_BOUND_CONSTRAINED;
+  policy_ = std::make_unique<MpcPolicyPair<OutputTrackingCost, InputBounds>>(
+    OutputTrackingCost(Q_, R_), InputBounds(u_lower_bound_, u_upper_bound_));
   checkBoundsDimensions();
   checkMatrixDimensions();
   setupMpcDynamics();
@@ -137,42 +535,41 @@ LinMpcEigen::MPC::MPC(const LinearSystem &linear_system, uint32_t horizon,
 LinMpcEigen::MPC::MPC(const LinearSystem &linear_system, uint32_t horizon, 
                       const VecNd &Y_d, const VecNd &x0, double W_y, 
                       const SparseMat &w_u, const SparseMat &w_x,
-                      double solver_time_limit) 
+                      double solver_time_limit, const OsqpSettings &solver_settings) 
 : linear_system_(linear_system), N_(horizon), Y_d_(Y_d), x0_(x0), 
   W_y_(W_y), w_u_(w_u), w_x_(w_x),
-  W_u_(SparseMat(N_ * linear_system_.n_u, N_ * linear_system_.n_u)),
-  W_x_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_x)),
   A_mpc_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_u)),
   B_mpc_(SparseMat(N_ * linear_system_.n_x, linear_system_.n_x)),
   C_mpc_(SparseMat(N_ * linear_system_.n_y, N_ * linear_system_.n_x)),
-  solver_time_limit_(solver_time_limit)
+  solver_time_limit_(solver_time_limit), solver_settings_(solver_settings)
 {
   mpc_type_ = MPC2;
+  policy_ = std::make_unique<MpcPolicyPair<WeightedCost>>(WeightedCost(W_y_, w_u_, w_x_));
   checkMatrixDimensions();
   setupMpcDynamics();
-  setWeightMatrices();
+  checkWeightDimensions();
 }
 
 LinMpcEigen::MPC::MPC(const LinearSystem &linear_system, uint32_t horizon, 
                       const VecNd &Y_d, const VecNd &x0, double W_y, 
                       const SparseMat &w_u, const SparseMat &w_x,
                       const VecNd &u_lower_bound, const VecNd &u_upper_bound,
-                      double solver_time_limit) 
+                      double solver_time_limit, const OsqpSettings &solver_settings) 
 : linear_system_(linear_system), N_(horizon), Y_d_(Y_d), x0_(x0), 
   W_y_(W_y), w_u_(w_u), w_x_(w_x),
-  W_u_(SparseMat(N_ * linear_system_.n_u, N_ * linear_system_.n_u)),
-  W_x_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_x)),
   u_lower_bound_(u_lower_bound), u_upper_bound_(u_upper_bound),
   A_mpc_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_u)),
   B_mpc_(SparseMat(N_ * linear_system_.n_x, linear_system_.n_x)),
   C_mpc_(SparseMat(N_ * linear_system_.n_y, N_ * linear_system_.n_x)),
-  solver_time_limit_(solver_time_limit)
+  solver_time_limit_(solver_time_limit), solver_settings_(solver_settings)
 {
   mpc_type_ = MPC2_BOUND_CONSTRAINED;
+  policy_ = std::make_unique<MpcPolicyPair<WeightedCost, InputBounds>>(
+    WeightedCost(W_y_, w_u_, w_x_), InputBounds(u_lower_bound_, u_upper_bound_));
   checkBoundsDimensions();
   checkMatrixDimensions();
   setupMpcDynamics();
-  setWeightMatrices();
+  checkWeightDimensions();
 }
 
 LinMpcEigen::MPC::MPC(const LinearSystem &linear_system, uint32_t horizon, 
@@ -180,26 +577,28 @@ LinMpcEigen::MPC::MPC(const LinearSystem &linear_system, uint32_t horizon,
                       const SparseMat &w_u, const SparseMat &w_x,
                       const VecNd &u_lower_bound, const VecNd &u_upper_bound,
                       const VecNd &x_lower_bound, const VecNd &x_upper_bound,
-                      double solver_time_limit) 
+                      double solver_time_limit, const OsqpSettings &solver_settings) 
 : linear_system_(linear_system), N_(horizon), Y_d_(Y_d), x0_(x0), 
   W_y_(W_y), w_u_(w_u), w_x_(w_x),
-  W_u_(SparseMat(N_ * linear_system_.n_u, N_ * linear_system_.n_u)),
-  W_x_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_x)),
   u_lower_bound_(u_lower_bound), u_upper_bound_(u_upper_bound),
   x_lower_bound_(x_lower_bound), x_upper_bound_(x_upper_bound),
   A_mpc_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_u)),
   B_mpc_(SparseMat(N_ * linear_system_.n_x, linear_system_.n_x)),
   C_mpc_(SparseMat(N_ * linear_system_.n_y, N_ * linear_system_.n_x)),
-  solver_time_limit_(solver_time_limit)
+  solver_time_limit_(solver_time_limit), solver_settings_(solver_settings)
 {
   mpc_type_ = MPC2_BOUND_CONSTRAINED_2;
+  policy_ = std::make_unique<MpcPolicyPair<WeightedCost, StateBounds>>(
+    WeightedCost(W_y_, w_u_, w_x_), secondStateEntryBounds(x_lower_bound_, x_upper_bound_));
   checkBoundsDimensions();
   checkStateBoundsDimensions();
   checkMatrixDimensions();
   setupMpcDynamics();
-  setWeightMatrices();
+  checkWeightDimensions();
 }
 
+LinMpcEigen::MPC::~MPC() = default;
+
 void LinMpcEigen::MPC::checkMatrixDimensions() const 
 {
   std::ostringstream msg;
@@ -257,22 +656,7 @@ void LinMpcEigen::MPC::checkStateBoundsDimensions() const
 
 void LinMpcEigen::MPC::setupMpcDynamics() 
 {
-  uint32_t n_x = linear_system_.n_x;
-  uint32_t n_u = linear_system_.n_u;
-  uint32_t n_y = linear_system_.n_y;
-  
-  for (uint32_t i = 0; i < N_; i++) 
-  {
-    setSparseBlock(B_mpc_, matrixPow(linear_system_.A, i+1), n_x * i, 0);
-    setSparseBlock(C_mpc_, linear_system_.C, n_y * i, n_x * i);
-    for (uint32_t j = 0; j <= i; j++) 
-    {
-      if (i == j) 
-        setSparseBlock(A_mpc_, linear_system_.B, n_x * i, n_u * j);
-      else
-        setSparseBlock(A_mpc_, matrixPow(linear_system_.A, i-j) * linear_system_.B, n_x * i, n_u * j);
-    }
-  }
+  setupPredictionMatrices(linear_system_, N_, A_mpc_, B_mpc_, C_mpc_);
 }
 
 void LinMpcEigen::MPC::setYd(const VecNd &Y_d_in) 
@@ -280,250 +664,850 @@ void LinMpcEigen::MPC::setYd(const VecNd &Y_d_in)
   Y_d_ = Y_d_in;
 }
 
+void LinMpcEigen::MPC::setX0(const VecNd &x0_in) 
+{
+  x0_ = x0_in;
+}
+
+void LinMpcEigen::MPC::setSolverSettings(const OsqpSettings &solver_settings)
+{
+  solver_settings_ = solver_settings;
+}
+
+const OsqpSettings &LinMpcEigen::MPC::getSolverSettings() const
+{
+  return solver_settings_;
+}
+
 void LinMpcEigen::MPC::initializeSolver()
 {
-  if(mpc_type_ == MPC1)
-    setupQpMPC1();
-  if(mpc_type_ == MPC2)
-    setupQpMPC2();
-  if(mpc_type_ == MPC1_BOUND_CONSTRAINED)
+  qp_problem_ = policy_->setupQp(linear_system_, N_, A_mpc_, B_mpc_, Y_d_, x0_);
+  createSolver();
+  setupGradientMaps();
+}
+
+void LinMpcEigen::MPC::updateSolver(const VecNd &Y_d_in, const VecNd &x0)
+{
+  std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+  Y_d_ = Y_d_in;
+  x0_ = x0;
+  policy_->updateQp(Y_d_, x0_, *qp_problem_);
+  updateSolverData();
+  metrics_->recordUpdate(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+}
+
+void LinMpcEigen::MPC::setWarmStart(const VecNd &U_warm_start) 
+{
+  std::ostringstream msg;
+  if ((uint32_t)U_warm_start.rows() != N_ * linear_system_.n_u) 
+  {
+    msg << "MPC: Vector 'U_warm_start' size error\n U_warm_start.rows() = " << U_warm_start.rows() 
+        << ", needs to be = " << N_ * linear_system_.n_u << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  VecNd primal_variable = structured_scaling_ ? VecNd(U_warm_start.cwiseQuotient(input_scaling_)) 
+                                              : U_warm_start;
+  if (qp_backend_ != QpBackend::OSQP) 
+    mixed_precision_opt_->setPrimalWarmStart(primal_variable);
+  else
+    osqp_eigen_opt_->setPrimalWarmStart(primal_variable);
+}
+
+VecNd LinMpcEigen::MPC::solve() const 
+{
+  bool warm_started = (qp_backend_ != QpBackend::OSQP) ? mixed_precision_opt_->isWarmStarted() 
+                                                      : osqp_eigen_opt_->isWarmStarted();
+  std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+  VecNd U = (qp_backend_ != QpBackend::OSQP) ? mixed_precision_opt_->solveProblem() 
+                                                        : osqp_eigen_opt_->solveProblem();
+  if (structured_scaling_) 
+    U = input_scaling_.cwiseProduct(U);
+  double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  recordSolve(U, getSolverStatus(), getSolverIterations(), latency, warm_started);
+  return U;
+} 
+
+void LinMpcEigen::MPC::recordSolve(const VecNd &U, int status, uint32_t iterations, double latency,
+                                   bool warm_started) const 
+{
+  metrics_->recordSolve(status, iterations, latency, warm_started);
+  if (flight_recorder_) 
+    flight_recorder_->record(x0_.data(), U.data(), status, iterations, latency);
+}
+
+LinMpcEigen::MpcMetrics &LinMpcEigen::MPC::getMetrics() 
+{
+  return *metrics_;
+}
+
+const LinMpcEigen::MpcMetrics &LinMpcEigen::MPC::getMetrics() const 
+{
+  return *metrics_;
+}
+
+void LinMpcEigen::MPC::enableFlightRecorder(uint32_t capacity, const std::string &fault_dump_prefix) 
+{
+  flight_recorder_ = std::make_unique<FlightRecorder>(capacity, linear_system_.n_x, linear_system_.n_u, 
+                                                      fault_dump_prefix);
+}
+
+const LinMpcEigen::FlightRecorder *LinMpcEigen::MPC::getFlightRecorder() const 
+{
+  return flight_recorder_.get();
+}
+
+void LinMpcEigen::MPC::dumpFlightRecorder(const std::string &file_path) const 
+{
+  if (!flight_recorder_) 
+    throw std::runtime_error("MPC: dumpFlightRecorder() requires enableFlightRecorder() to be called first");
+  flight_recorder_->dump(file_path);
+}
+
+LinMpcEigen::RealTimeReport LinMpcEigen::MPC::enableRealTimeMode(const RealTimeSettings &settings) 
+{
+  if (!qp_problem_) 
+    throw std::runtime_error("MPC: enableRealTimeMode() requires initializeSolver() to be called first");
+
+  RealTimeReport report = configureProcessMemory(settings);
+
+  // without mlockall the pages are at least faulted in once
+  for (const SparseMat *matrix : { &A_mpc_, &B_mpc_, &C_mpc_,
+                                   &qp_problem_->A_qp, &qp_problem_->A_eq, &qp_problem_->A_ieq }) 
+    report.prefaulted_bytes += prefaultMatrix(*matrix);
+  if (const OutputTrackingCost *cost = policy_->outputTrackingCost()) 
+    for (const SparseMat *matrix : { &cost->C_A, &cost->C_B, &cost->Q_C_A_T, &cost->Q_C_A_T_C_B }) 
+      report.prefaulted_bytes += prefaultMatrix(*matrix);
+  if (const WeightedCost *cost = policy_->weightedCost()) 
+  {
+    for (const SparseMat *matrix : { &cost->C_A, &cost->C_B, &cost->W_u }) 
+      report.prefaulted_bytes += prefaultMatrix(*matrix);
+    for (const MatNd *matrix : { &cost->W_x_A, &cost->W_x_B }) 
+      report.prefaulted_bytes += prefaultMatrix(*matrix);
+  }
+  for (const MatNd *matrix : { &gradient_x0_map_, &gradient_Y_d_map_ }) 
+    report.prefaulted_bytes += prefaultMatrix(*matrix);
+  for (const VecNd *vector : { &Y_d_, &x0_, &qp_problem_->b_qp, &qp_problem_->b_eq, &qp_problem_->b_ieq,
+                               &qp_problem_->lower_bound, &qp_problem_->upper_bound, 
+                               &input_scaling_, &constraint_scaling_ }) 
+    report.prefaulted_bytes += prefaultMatrix(*vector);
+
+  configureCurrentThread(settings.priority, settings.cpu_cores, report);
+  // first touch of the solver workspace (OSQP iterates, KKT factorization) outside of the control loop
+  if (settings.warm_up_solve) 
+    solve();
+  return report;
+}
+
+LinMpcEigen::RealTimeReport LinMpcEigen::enableRealTimeMode(const std::vector<MPC *> &controllers, 
+                                                             const RealTimeSettings &settings) 
+{
+  // the threads are configured by themselves, the process memory only once
+  RealTimeSettings mpc_settings = settings;
+  mpc_settings.priority = 0;
+  mpc_settings.cpu_cores.clear();
+  RealTimeReport report;
+  for (MPC *mpc : controllers) 
+  {
+    report.merge(mpc->enableRealTimeMode(mpc_settings));
+    mpc_settings.lock_memory = false;
+    mpc_settings.heap_reserve_size = 0;
+  }
+  return report;
+}
+
+std::string LinMpcEigen::MPC::checkpoint() const 
+{
+  std::ostringstream stream(std::ios::binary);
+  stream.write(checkpoint_magic, sizeof(checkpoint_magic));
+  writeValue<uint32_t>(stream, checkpoint_version);
+
+  // construction parameters
+  writeValue<uint32_t>(stream, mpc_type_);
+  writeValue<uint32_t>(stream, N_);
+  for (const SparseMat *matrix : { &linear_system_.A, &linear_system_.B, &linear_system_.C, &linear_system_.D }) 
+    writeSparse(stream, *matrix);
+  writeVector(stream, Y_d_);
+  writeVector(stream, x0_);
+  if (mpc_type_ == MPC1 || mpc_type_ == MPC1_BOUND_CONSTRAINED) 
   {
-    setupQpConstrainedMPC1();
+    writeValue<double>(stream, Q_);
+    writeValue<double>(stream, R_);
   }
-  if(mpc_type_ == MPC2_BOUND_CONSTRAINED)
+  else 
   {
-    setupQpConstrainedMPC2();
+    writeValue<double>(stream, W_y_);
+    writeSparse(stream, w_u_);
+    writeSparse(stream, w_x_);
   }
-  if(mpc_type_ == MPC2_BOUND_CONSTRAINED_2)
+  if (mpc_type_ != MPC1 && mpc_type_ != MPC2) 
   {
-    setupQpConstrainedMPC2_2();
+    writeVector(stream, u_lower_bound_);
+    writeVector(stream, u_upper_bound_);
   }
+  if (mpc_type_ == MPC2_BOUND_CONSTRAINED_2) 
+  {
+    writeVector(stream, x_lower_bound_);
+    writeVector(stream, x_upper_bound_);
+  }
+
+  // solver configuration
+  writeValue<double>(stream, solver_time_limit_);
+  std::ostringstream settings_stream;
+  solver_settings_.save(settings_stream);
+  writeString(stream, settings_stream.str());
+  writeValue<uint32_t>(stream, (uint32_t)qp_backend_);
+  writeValue<uint8_t>(stream, structured_scaling_);
+  writeValue<double>(stream, proximal_rho_);
+  writeSparse(stream, proximal_E_);
+
+  // solver state
+  writeValue<uint8_t>(stream, qp_problem_ != nullptr);
+  VecNd primal_variable, dual_variable;
+  double rho = 0.0;
+  if (qp_problem_ && qp_backend_ == QpBackend::OSQP) 
+    osqp_eigen_opt_->getIterate(primal_variable, dual_variable, rho);
+  writeVector(stream, primal_variable);
+  writeVector(stream, dual_variable);
+  writeValue<double>(stream, rho);
+  return stream.str();
 }
 
-void LinMpcEigen::MPC::updateSolver(const VecNd &Y_d_in, const VecNd &x0)
+std::unique_ptr<LinMpcEigen::MPC> LinMpcEigen::MPC::restore(const std::string &checkpoint) 
 {
-  Y_d_ = Y_d_in;
-  x0_ = x0;
-  if(mpc_type_ == MPC1 || mpc_type_ == MPC1_BOUND_CONSTRAINED)
-    updateQpMPC1();
-  if(mpc_type_ == MPC2 || mpc_type_ == MPC2_BOUND_CONSTRAINED)
-    updateQpMPC2();
-  if(mpc_type_ == MPC2_BOUND_CONSTRAINED_2)
-    updateQpMPC2_2();
+  std::istringstream stream(checkpoint, std::ios::binary);
+  char magic[sizeof(checkpoint_magic)];
+  stream.read(magic, sizeof(magic));
+  if (!stream || !std::equal(magic, magic + sizeof(magic), checkpoint_magic)) 
+    throw std::runtime_error("MPC: not a MPC checkpoint");
+  uint32_t version = readValue<uint32_t>(stream);
+  if (version != checkpoint_version) 
+  {
+    std::ostringstream msg;
+    msg << "MPC: checkpoint version " << version << " is not supported, needs to be " << checkpoint_version << "\n";
+    throw std::runtime_error(msg.str());
+  }
+
+  uint32_t type = readValue<uint32_t>(stream);
+  if (type > MPC2_BOUND_CONSTRAINED_2) 
+    throw std::runtime_error("MPC: corrupted checkpoint, unknown MPC type");
+  uint32_t horizon = readValue<uint32_t>(stream);
+  SparseMat A = readSparse(stream);
+  SparseMat B = readSparse(stream);
+  SparseMat C = readSparse(stream);
+  SparseMat D = readSparse(stream);
+  LinearSystem linear_system(A, B, C, D);
+  VecNd Y_d = readVector(stream);
+  VecNd x0 = readVector(stream);
+
+  double Q = 0.0, R = 0.0, W_y = 0.0;
+  SparseMat w_u, w_x;
+  if (type == MPC1 || type == MPC1_BOUND_CONSTRAINED) 
+  {
+    Q = readValue<double>(stream);
+    R = readValue<double>(stream);
+  }
+  else 
+  {
+    W_y = readValue<double>(stream);
+    w_u = readSparse(stream);
+    w_x = readSparse(stream);
+  }
+  VecNd u_lower_bound, u_upper_bound, x_lower_bound, x_upper_bound;
+  if (type != MPC1 && type != MPC2) 
+  {
+    u_lower_bound = readVector(stream);
+    u_upper_bound = readVector(stream);
+  }
+  if (type == MPC2_BOUND_CONSTRAINED_2) 
+  {
+    x_lower_bound = readVector(stream);
+    x_upper_bound = readVector(stream);
+  }
+
+  double solver_time_limit = readValue<double>(stream);
+  std::istringstream settings_stream(readString(stream));
+  OsqpSettings solver_settings = OsqpSettings::load(settings_stream);
+
+  std::unique_ptr<MPC> mpc;
+  switch (type) 
+  {
+    case MPC1:
+      mpc.reset(new MPC(linear_system, horizon, Y_d, x0, Q, R, solver_time_limit, solver_settings));
+      break;
+    case MPC1_BOUND_CONSTRAINED:
+      mpc.reset(new MPC(linear_system, horizon, Y_d, x0, Q, R, u_lower_bound, u_upper_bound, 
+                        solver_time_limit, solver_settings));
+      break;
+    case MPC2:
+      mpc.reset(new MPC(linear_system, horizon, Y_d, x0, W_y, w_u, w_x, solver_time_limit, solver_settings));
+      break;
+    case MPC2_BOUND_CONSTRAINED:
+      mpc.reset(new MPC(linear_system, horizon, Y_d, x0, W_y, w_u, w_x, u_lower_bound, u_upper_bound, 
+                        solver_time_limit, solver_settings));
+      break;
+    default:
+      mpc.reset(new MPC(linear_system, horizon, Y_d, x0, W_y, w_u, w_x, u_lower_bound, u_upper_bound, 
+                        x_lower_bound, x_upper_bound, solver_time_limit, solver_settings));
+  }
+
+  uint32_t qp_backend = readValue<uint32_t>(stream);
+  if (qp_backend > (uint32_t)QpBackend::RICCATI) 
+    throw std::runtime_error("MPC: corrupted checkpoint, unknown QP backend");
+  mpc->setQpBackend((QpBackend)qp_backend);
+  mpc->setStructuredScaling(readValue<uint8_t>(stream) != 0);
+  double proximal_rho = readValue<double>(stream);
+  SparseMat proximal_E = readSparse(stream);
+  if (proximal_E.cols() > 0) 
+    mpc->setProximalTerm(proximal_E, proximal_rho);
+
+  bool initialized = readValue<uint8_t>(stream) != 0;
+  VecNd primal_variable = readVector(stream);
+  VecNd dual_variable = readVector(stream);
+  double rho = readValue<double>(stream);
+  if (initialized) 
+  {
+    mpc->initializeSolver();
+    if (primal_variable.rows() > 0 && mpc->qp_backend_ == QpBackend::OSQP) 
+      mpc->osqp_eigen_opt_->setIterate(primal_variable, dual_variable, rho);
+  }
+  return mpc;
 }
 
-VecNd LinMpcEigen::MPC::solve() const 
+void LinMpcEigen::MPC::checkpointToFile(const std::string &file_path) const 
 {
-  return osqp_eigen_opt_->solveProblem();
+  std::ofstream file(file_path, std::ios::binary);
+  if (!file) 
+    throw std::runtime_error("MPC: can't open '" + file_path + "'");
+  file << checkpoint();
+}
+
+std::unique_ptr<LinMpcEigen::MPC> LinMpcEigen::MPC::restoreFromFile(const std::string &file_path) 
+{
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file) 
+    throw std::runtime_error("MPC: can't open '" + file_path + "'");
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return restore(contents.str());
+}
+
+VecNd LinMpcEigen::MPC::solveWithinBudget(double time_budget, OsqpSolveInfo &solve_info) const 
+{
+  if (qp_backend_ != QpBackend::OSQP) 
+    throw std::runtime_error("MPC: solveWithinBudget() requires the OSQP backend");
+  bool warm_started = osqp_eigen_opt_->isWarmStarted();
+  VecNd U = osqp_eigen_opt_->solveProblemWithinBudget(time_budget, solve_info);
+  if (structured_scaling_) 
+    U = input_scaling_.cwiseProduct(U);
+  recordSolve(U, solve_info.status, solve_info.iterations, solve_info.solve_time, warm_started);
+  return U;
 } 
 
-void LinMpcEigen::MPC::setupQpMPC1() 
+int LinMpcEigen::MPC::getSolverStatus() const 
 {
-  uint32_t n_u = linear_system_.n_u;
-  C_A_ = C_mpc_*A_mpc_;
-  C_B_ = C_mpc_*B_mpc_;
-  Q_C_A_T_ = Q_*(C_A_).transpose();
-  Q_C_A_T_C_B_ = Q_*(C_A_).transpose()*(C_B_);
+  if (qp_backend_ != QpBackend::OSQP) 
+    return mixed_precision_opt_->getStatus();
+  return osqp_eigen_opt_->getStatus();
+}
+
+uint32_t LinMpcEigen::MPC::getSolverIterations() const 
+{
+  if (qp_backend_ != QpBackend::OSQP) 
+    return mixed_precision_opt_->getIterations();
+  return osqp_eigen_opt_->getIterations();
+}
 
-  SparseMat A_qp = Q_*(C_A_).transpose()*(C_A_) + R_*MatNd::Identity(N_*n_u, N_*n_u); //Sparse identity
-  VecNd b_qp = Q_C_A_T_C_B_ * x0_ - Q_C_A_T_*Y_d_;
+uint32_t LinMpcEigen::MPC::getHorizon() const 
+{
+  return N_;
+}
 
-  SparseMat A_eq(0, N_ * n_u);
-  VecNd b_eq = VecNd::Zero(0);
-  SparseMat A_ieq(0, N_ * n_u);
-  VecNd b_ieq = VecNd::Zero(0);
+const LinMpcEigen::LinearSystem &LinMpcEigen::MPC::getLinearSystem() const 
+{
+  return linear_system_;
+}
 
-  qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq);
-  osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(*qp_problem_, solver_time_limit_);
+const SparseQpProblem &LinMpcEigen::MPC::getQpProblem() const 
+{
+  if (!qp_problem_) 
+    throw std::runtime_error("MPC: getQpProblem() requires initializeSolver() to be called first");
+  return *qp_problem_;
 }
 
-void LinMpcEigen::MPC::updateQpMPC1() 
+const MatNd &LinMpcEigen::MPC::getGradientX0Map() const 
 {
-  VecNd b_qp = Q_C_A_T_C_B_ * x0_ - Q_C_A_T_*Y_d_;
+  return gradient_x0_map_;
+}
 
-  qp_problem_->b_qp = b_qp;
-  osqp_eigen_opt_->setGradientAndInit(b_qp);
+const MatNd &LinMpcEigen::MPC::getGradientYdMap() const 
+{
+  return gradient_Y_d_map_;
 }
 
-void LinMpcEigen::MPC::setupQpConstrainedMPC1() 
+void LinMpcEigen::MPC::getPredictionMatrices(SparseMat &A_mpc, SparseMat &B_mpc, SparseMat &C_mpc) const 
 {
-  uint32_t n_u = linear_system_.n_u;
-  C_A_ = C_mpc_*A_mpc_;
-  C_B_ = C_mpc_*B_mpc_;
-  Q_C_A_T_ = Q_*(C_A_).transpose();
-  Q_C_A_T_C_B_ = Q_*(C_A_).transpose()*(C_B_);
-
-  SparseMat A_qp = Q_*(C_A_).transpose()*(C_A_) + R_*MatNd::Identity(N_*n_u, N_*n_u); //Sparse identity
-  VecNd b_qp = Q_C_A_T_C_B_ * x0_ - Q_C_A_T_*Y_d_;
-
-  SparseMat A_eq(0, N_ * n_u);
-  VecNd b_eq = VecNd::Zero(0);
-  SparseMat A_ieq(0, N_ * n_u);
-  VecNd b_ieq = VecNd::Zero(0);
-  
-  qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq, 
-                                                  u_lower_bound_.colwise().replicate(N_), 
-                                                  u_upper_bound_.colwise().replicate(N_));
-  osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(*qp_problem_, solver_time_limit_);
+  A_mpc = A_mpc_;
+  B_mpc = B_mpc_;
+  C_mpc = C_mpc_;
 }
 
-void LinMpcEigen::MPC::setupQpMPC2() 
+const SparseMat &LinMpcEigen::MPC::outputInputMatrix() const 
 {
-  uint32_t n_u = linear_system_.n_u;
-  // save intermediate product matrices to reduce redundant computation
-  C_A_ = C_mpc_*A_mpc_;
-  C_B_ = C_mpc_*B_mpc_;
-  W_x_B_ = W_x_*B_mpc_;
-  W_x_A_ = W_x_*A_mpc_;
+  return policy_->outputTrackingCost() ? policy_->outputTrackingCost()->C_A : policy_->weightedCost()->C_A;
+}
 
-  SparseMat A_qp = 	W_y_*(C_A_).transpose()*(C_A_) 
-                    + W_u_.transpose()*W_u_ 
-                    + (W_x_A_).transpose()*(W_x_A_);
+VecNd LinMpcEigen::MPC::calculateX(const VecNd &U_in) const 
+{
+  VecNd X = rolloutStates(linear_system_, U_in, x0_);
+  return X;
+}
 
-  VecNd b_qp = ( W_y_*(C_B_*x0_ - Y_d_).transpose()*C_A_ +
-                 (W_x_B_*x0_).transpose()*(W_x_A_) 
-                 ).transpose();
+VecNd LinMpcEigen::MPC::calculateY(const VecNd &U_in) const 
+{
+  VecNd X = calculateX(U_in);
+  VecNd Y = outputSequence(linear_system_, X);
+  return Y;
+}
+
+void LinMpcEigen::MPC::calculateX(const VecNd &U_in, VecNd &X) const 
+{
+  rolloutStates(linear_system_, U_in, x0_, X);
+}
 
-  SparseMat A_eq(0, N_ * n_u);
-  VecNd b_eq = VecNd::Zero(0);
-  SparseMat A_ieq(0, N_ * n_u);
-  VecNd b_ieq = VecNd::Zero(0);
+void LinMpcEigen::MPC::createSolver()
+{
+  if (proximal_rho_ != 0.0) 
+    qp_problem_->A_qp += proximal_rho_ * SparseMat(proximal_E_.transpose() * proximal_E_);
 
-  qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq);
-  osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(*qp_problem_, solver_time_limit_);
+  OsqpSettings settings = solver_settings_;
+  if (structured_scaling_) 
+  {
+    // the structured scaling replaces OSQP's Ruiz scaling
+    setupStructuredScaling();
+    settings.scaling = 0;
+  }
+  const SparseQpProblem &qp_problem = structured_scaling_ ? scaleQpProblem() : *qp_problem_;
+
+  osqp_eigen_opt_.reset();
+  mixed_precision_opt_.reset();
+  if (qp_backend_ == QpBackend::MIXED_PRECISION) 
+    mixed_precision_opt_ = std::make_unique<MixedPrecisionQpSolver>(qp_problem, settings, solver_time_limit_);
+  else if (qp_backend_ == QpBackend::RICCATI) 
+    mixed_precision_opt_ = std::make_unique<MixedPrecisionQpSolver>(qp_problem, settings, 
+                                                                    createRiccatiKktSolver(), solver_time_limit_);
+  else
+    osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(qp_problem, solver_time_limit_, settings);
 }
 
-void LinMpcEigen::MPC::setupQpConstrainedMPC2() 
+// Pushes qp_problem_->b_qp (and b_ieq) to the solver without repeating the solver setup
+void LinMpcEigen::MPC::updateSolverData()
 {
-  uint32_t n_u = linear_system_.n_u;
-  // save intermediate product matrices to reduce redundant computation
-  C_A_ = C_mpc_*A_mpc_;
-  C_B_ = C_mpc_*B_mpc_;
-  W_x_B_ = W_x_*B_mpc_;
-  W_x_A_ = W_x_*A_mpc_;
-
-  SparseMat A_qp = 	W_y_*(C_A_).transpose()*(C_A_) 
-                    + W_u_.transpose()*W_u_ 
-                    + (W_x_A_).transpose()*(W_x_A_);
-
-  VecNd b_qp = ( W_y_*(C_B_*x0_ - Y_d_).transpose()*C_A_ +
-                 (W_x_B_*x0_).transpose()*(W_x_A_) 
-                 ).transpose();
-
-  SparseMat A_eq(0, N_ * n_u);
-  VecNd b_eq = VecNd::Zero(0);
-  SparseMat A_ieq(0, N_ * n_u);
-  VecNd b_ieq = VecNd::Zero(0);
-  
-  qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq, 
-                                                  u_lower_bound_.colwise().replicate(N_), 
-                                                  u_upper_bound_.colwise().replicate(N_));
-  osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(*qp_problem_, solver_time_limit_);
+  VecNd b_qp = qp_problem_->b_qp;
+  VecNd b_ieq = qp_problem_->b_ieq;
+  if (structured_scaling_) 
+  {
+    b_qp = input_scaling_.cwiseProduct(b_qp);
+    b_ieq = constraint_scaling_.cwiseProduct(b_ieq);
+  }
+  if (qp_backend_ != QpBackend::OSQP) 
+  {
+    if (b_ieq.rows() > 0) 
+      mixed_precision_opt_->updateGradientAndIeqConstraint(b_qp, b_ieq);
+    else
+      mixed_precision_opt_->updateGradient(b_qp);
+    return;
+  }
+  if (b_ieq.rows() > 0) 
+    osqp_eigen_opt_->updateGradientAndIeqConstraint(b_qp, b_ieq);
+  else
+    osqp_eigen_opt_->updateGradient(b_qp);
 }
 
-void LinMpcEigen::MPC::setupQpConstrainedMPC2_2() 
+// A_qp = G^T * blockdiag(C^T * Q * C) * G + blockdiag(R) for MPC I and
+// A_qp = G^T * blockdiag(W_y * C^T * C + w_x^T * w_x) * G + blockdiag(w_u^T * w_u) for MPC II
+std::unique_ptr<KktSolver> LinMpcEigen::MPC::createRiccatiKktSolver() const
 {
+  if (policy_->stateBounds() || proximal_rho_ != 0.0) 
+    throw std::runtime_error("MPC: the RICCATI backend requires a MPC without state constraints or proximal term");
+
   uint32_t n_u = linear_system_.n_u;
-  // save intermediate product matrices to reduce redundant computation
-  C_A_ = C_mpc_*A_mpc_;
-  C_B_ = C_mpc_*B_mpc_;
-  W_x_B_ = W_x_*B_mpc_;
-  W_x_A_ = W_x_*A_mpc_;
+  MatNd C = MatNd(linear_system_.C);
+  MatNd state_weight, input_weight;
+  if (policy_->outputTrackingCost()) 
+  {
+    state_weight = Q_ * C.transpose() * C;
+    input_weight = R_ * MatNd::Identity(n_u, n_u);
+  }
+  else
+  {
+    MatNd w_x = MatNd(w_x_);
+    MatNd w_u = MatNd(w_u_);
+    state_weight = W_y_ * C.transpose() * C + w_x.transpose() * w_x;
+    input_weight = w_u.transpose() * w_u;
+  }
+  return std::make_unique<RiccatiKktSolver>( MatNd(linear_system_.A), MatNd(linear_system_.B), N_,
+                                             state_weight, input_weight, 
+                                             structured_scaling_ ? input_scaling_ : VecNd() );
+}
 
-  SparseMat A_qp = 	W_y_*(C_A_).transpose()*(C_A_) 
-                    + W_u_.transpose()*W_u_ 
-                    + (W_x_A_).transpose()*(W_x_A_);
+void LinMpcEigen::MPC::setStructuredScaling(bool enable)
+{
+  structured_scaling_ = enable;
+}
 
-  VecNd b_qp = ( W_y_*(C_B_*x0_ - Y_d_).transpose()*C_A_ +
-                 (W_x_B_*x0_).transpose()*(W_x_A_) 
-                 ).transpose();
+void LinMpcEigen::MPC::setQpBackend(QpBackend qp_backend)
+{
+  qp_backend_ = qp_backend;
+}
 
+/*
+  Diagonal scaling U = D * U_s computed from the Markov parameters G_m = C * A^m * B.
+  Input j of stage k affects the outputs of stages k..N-1 through G_0..G_(N-1-k), so the 
+  diagonal of A_qp is:
+    A_qp(k, j) = W_y * sum_{m=0}^{N-1-k} ||G_m(:, j)||^2 + ||w_x * A^m * B(:, j)||^2 + ||w_u(:, j)||^2
+  (Q, R instead of W_y, w_u for MPC I), and D = diag(A_qp)^(-1/2).
+  The rows of the inequality constraints are then normalized to a unit infinity norm.
+*/
+void LinMpcEigen::MPC::setupStructuredScaling()
+{
+  uint32_t n_u = linear_system_.n_u;
   uint32_t n_x = linear_system_.n_x;
-  SparseMat identity(n_x, n_x);
+  uint32_t n_y = linear_system_.n_y;
+  bool mpc1 = policy_->outputTrackingCost() != nullptr;
 
-  SparseMat A_ieq_full = cocatenateMatrices(A_mpc_, -A_mpc_);
-  VecNd b_ieq_full = VecNd::Zero(2 * N_ * n_x);
+  // first block column of C_A (and W_x_A) holds the Markov parameters
+  MatNd C_A_first = MatNd(outputInputMatrix().leftCols(n_u));
+  MatNd markov_norms(N_, n_u);
+  for (uint32_t m = 0; m < N_; m++) 
+  {
+    markov_norms.row(m) = (mpc1 ? Q_ : W_y_) * C_A_first.middleRows(m * n_y, n_y).colwise().squaredNorm();
+    if (!mpc1) 
+      markov_norms.row(m) += policy_->weightedCost()->W_x_A.block(m * n_x, 0, n_x, n_u).colwise().squaredNorm();
+  }
+  VecNd input_weight = mpc1 ? VecNd(R_ * VecNd::Ones(n_u)) 
+                            : VecNd(MatNd(w_u_).colwise().squaredNorm().transpose());
 
-  b_ieq_full << -x_upper_bound_.colwise().replicate(N_) + B_mpc_ * x0_,
-                x_lower_bound_.colwise().replicate(N_) - B_mpc_ * x0_;
-  
-  //Hack select only second entry of x!
-  uint32_t which_i_of_x = 1;
-  MatNd A_ieq_dense(2 * N_ * 1, N_ * n_u);
-  VecNd b_ieq(2 * N_ * 1);
-  uint32_t row_counter = 0;
-  for(auto i = which_i_of_x; i < 2 * N_ * n_x; i+=n_x)
-  {
-    A_ieq_dense.row(row_counter) = A_ieq_full.row(i);
-    b_ieq(row_counter) = b_ieq_full(i);
-    row_counter++; 
-  }
-  std::cout << "row_counter = " << row_counter << "\n";  
-  SparseMat A_ieq = A_ieq_dense.sparseView();
-
-  SparseMat A_eq(0, N_ * n_u);
-  VecNd b_eq = VecNd::Zero(0);
-  //SparseMat A_ieq(0, N_ * n_u);
-  //VecNd b_ieq = VecNd::Zero(0);
-  
-  /*
-  qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq, 
-                                                  u_lower_bound_.colwise().replicate(N_), 
-                                                  u_upper_bound_.colwise().replicate(N_));
-  */
-  qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq);
-  
-  osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(*qp_problem_, solver_time_limit_);
+  VecNd hessian_diagonal(N_ * n_u);
+  VecNd markov_sum = VecNd::Zero(n_u);
+  for (int k = N_ - 1; k >= 0; k--) 
+  {
+    markov_sum += markov_norms.row(N_ - 1 - k).transpose();
+    hessian_diagonal.segment(k * n_u, n_u) = markov_sum + input_weight;
+  }
+  if (proximal_rho_ != 0.0) 
+    for (uint32_t i = 0; i < N_ * n_u; i++) 
+      hessian_diagonal(i) += proximal_rho_ * proximal_E_.col(i).squaredNorm();
+
+  input_scaling_.resize(N_ * n_u);
+  for (uint32_t i = 0; i < N_ * n_u; i++) 
+    input_scaling_(i) = hessian_diagonal(i) > 0.0 ? 1.0 / std::sqrt(hessian_diagonal(i)) : 1.0;
+
+  MatNd A_ieq_scaled = MatNd(qp_problem_->A_ieq) * input_scaling_.asDiagonal();
+  constraint_scaling_.resize(A_ieq_scaled.rows());
+  for (uint32_t i = 0; i < A_ieq_scaled.rows(); i++) 
+  {
+    double row_norm = A_ieq_scaled.row(i).lpNorm<Eigen::Infinity>();
+    constraint_scaling_(i) = row_norm > 0.0 ? 1.0 / row_norm : 1.0;
+  }
 }
 
-void LinMpcEigen::MPC::updateQpMPC2() 
+SparseQpProblem LinMpcEigen::MPC::scaleQpProblem() const
 {
-  VecNd b_qp = (	W_y_*(C_B_*x0_ - Y_d_).transpose()*C_A_ +
-                  (W_x_B_*x0_).transpose()*(W_x_A_)
-                  ).transpose();
-  qp_problem_->b_qp = b_qp;
-  osqp_eigen_opt_->setGradientAndInit(b_qp);
+  auto D = input_scaling_.asDiagonal();
+  auto E = constraint_scaling_.asDiagonal();
+
+  SparseMat A_qp = D * qp_problem_->A_qp * D;
+  VecNd b_qp = D * qp_problem_->b_qp;
+  SparseMat A_eq = qp_problem_->A_eq * D;
+  SparseMat A_ieq = E * qp_problem_->A_ieq * D;
+  VecNd b_ieq = E * qp_problem_->b_ieq;
+
+  if (qp_problem_->upper_bound.rows() == 0) 
+    return SparseQpProblem(A_qp, b_qp, A_eq, qp_problem_->b_eq, A_ieq, b_ieq);
+
+  return SparseQpProblem( A_qp, b_qp, A_eq, qp_problem_->b_eq, A_ieq, b_ieq,
+                          qp_problem_->lower_bound.cwiseQuotient(input_scaling_),
+                          qp_problem_->upper_bound.cwiseQuotient(input_scaling_) );
 }
 
-void LinMpcEigen::MPC::updateQpMPC2_2() 
+void LinMpcEigen::MPC::setProximalTerm(const SparseMat &E, double rho)
 {
-  VecNd b_qp = (	W_y_*(C_B_*x0_ - Y_d_).transpose()*C_A_ +
-                  (W_x_B_*x0_).transpose()*(W_x_A_)
-                  ).transpose();
-  qp_problem_->b_qp = b_qp;
-  uint32_t n_x = linear_system_.n_x;
-  VecNd b_ieq_full = VecNd::Zero(2 * N_ * n_x);
+  std::ostringstream msg;
+  if ((uint32_t)E.cols() != N_ * linear_system_.n_u) 
+  {
+    msg << "MPC: Matrix 'E' size error\n E.cols() = " << E.cols() 
+        << ", needs to be = " << N_ * linear_system_.n_u << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  proximal_E_ = E;
+  proximal_rho_ = rho;
+}
 
-  b_ieq_full << -x_upper_bound_.colwise().replicate(N_) + B_mpc_ * x0_,
-                x_lower_bound_.colwise().replicate(N_) - B_mpc_ * x0_;
-  
-  //Hack select only second entry of x!
-  uint32_t which_i_of_x = 1;
-  VecNd b_ieq(2 * N_ * 1);
-  uint32_t row_counter = 0;
-  for(auto i = which_i_of_x; i < 2 * N_ * n_x; i+=n_x)
+void LinMpcEigen::MPC::updateGradientOffset(const VecNd &gradient_offset)
+{
+  std::ostringstream msg;
+  if (gradient_offset.rows() != qp_problem_->b_qp.rows()) 
+  {
+    msg << "MPC: Vector 'gradient_offset' size error\n gradient_offset.rows() = " << gradient_offset.rows() 
+        << ", needs to be = " << qp_problem_->b_qp.rows() << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  VecNd b_qp = qp_problem_->b_qp + gradient_offset;
+  if (structured_scaling_) 
+    b_qp = input_scaling_.cwiseProduct(b_qp);
+  if (qp_backend_ != QpBackend::OSQP) 
+    mixed_precision_opt_->updateGradient(b_qp);
+  else
+    osqp_eigen_opt_->updateGradient(b_qp);
+}
+
+void LinMpcEigen::MPC::setupGradientMaps()
+{
+  gradient_x0_map_ = policy_->gradientX0Map();
+  gradient_Y_d_map_ = policy_->gradientYdMap();
+  hessian_factorized_ = false;
+}
+
+void LinMpcEigen::MPC::checkBatchDimensions(const MatNd &x0_batch, uint32_t batch_rows, 
+                                            uint32_t expected_rows, const char *batch_name) const
+{
+  std::ostringstream msg;
+
+  if ((uint32_t)x0_batch.rows() != linear_system_.n_x) 
   {
-    b_ieq(row_counter) = b_ieq_full(i);
-    row_counter++; 
+    msg << "MPC: Matrix 'x0_batch' size error\n x0_batch.rows() = " << x0_batch.rows() 
+        << ", needs to be = " << linear_system_.n_x << "\n";
+    throw std::runtime_error(msg.str());
   }
+  if (batch_rows != expected_rows) 
+  {
+    msg << "MPC: Matrix '" << batch_name << "' size error\n " << batch_name << ".rows() = " << batch_rows 
+        << ", needs to be = " << expected_rows << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
 
-  osqp_eigen_opt_->setGradientIeqConstraintAndInit(b_qp, b_ieq);
+// b_qp for every scenario (column) with a single pair of matrix-matrix products
+MatNd LinMpcEigen::MPC::calculateGradientBatch(const MatNd &Y_d_batch, const MatNd &x0_batch) const
+{
+  if (!qp_problem_) 
+    throw std::runtime_error("MPC: batch gradients and unconstrained solutions require initializeSolver() to be called first");
+  checkBatchDimensions(x0_batch, Y_d_batch.rows(), N_ * linear_system_.n_y, "Y_d_batch");
+  if (Y_d_batch.cols() != x0_batch.cols()) 
+    throw std::runtime_error("MPC: 'Y_d_batch' and 'x0_batch' need to have an equal number of columns");
+
+  MatNd gradients(gradient_x0_map_.rows(), x0_batch.cols());
+  gradients.noalias() = gradient_x0_map_ * x0_batch;
+  gradients.noalias() += gradient_Y_d_map_ * Y_d_batch;
+  return gradients;
 }
 
+// minimizers of the QP cost function, constraints are ignored
+MatNd LinMpcEigen::MPC::solveUnconstrainedBatch(const MatNd &Y_d_batch, const MatNd &x0_batch)
+{
+  MatNd gradients = calculateGradientBatch(Y_d_batch, x0_batch);
+  if (!hessian_factorized_) 
+  {
+    hessian_ldlt_.compute(MatNd(qp_problem_->A_qp));
+    hessian_factorized_ = true;
+  }
+  return hessian_ldlt_.solve(-gradients);
+}
 
-VecNd LinMpcEigen::MPC::calculateX(const VecNd &U_in) const 
+MatNd LinMpcEigen::MPC::calculateXBatch(const MatNd &U_batch, const MatNd &x0_batch) const
 {
-  VecNd X = A_mpc_ * U_in + B_mpc_ * x0_;
+  checkBatchDimensions(x0_batch, U_batch.rows(), N_ * linear_system_.n_u, "U_batch");
+  if (U_batch.cols() != x0_batch.cols()) 
+    throw std::runtime_error("MPC: 'U_batch' and 'x0_batch' need to have an equal number of columns");
+
+  MatNd X(A_mpc_.rows(), U_batch.cols());
+  X.noalias() = A_mpc_ * U_batch;
+  X.noalias() += B_mpc_ * x0_batch;
   return X;
 }
 
-VecNd LinMpcEigen::MPC::calculateY(const VecNd &U_in) const 
+MatNd LinMpcEigen::MPC::calculateYBatch(const MatNd &U_batch, const MatNd &x0_batch) const
 {
-  VecNd X = calculateX(U_in);
-  VecNd Y = C_mpc_ * X;
+  MatNd X = calculateXBatch(U_batch, x0_batch);
+  MatNd Y(C_mpc_.rows(), X.cols());
+  Y.noalias() = C_mpc_ * X;
   return Y;
 }
 
+/*
+  Active set sensitivities of the QP  min 1/2 U^T A_qp U + b_qp^T U  s.t.  G U + h <= 0
+  (G, h: A_ieq, b_ieq and the input bounds). With the rows G_a, h_a active at U, the KKT conditions
+    A_qp U + b_qp + G_a^T nu = 0,   G_a U + h_a = 0
+  differentiated with respect to a parameter p give
+    [A_qp  G_a^T] [dU/dp ]     [d(A_qp)/dp U + d(b_qp)/dp]
+    [G_a   0    ] [dnu/dp] = - [d(h_a)/dp                ]
+*/
+LinMpcEigen::MpcSensitivities LinMpcEigen::MPC::calculateSensitivities(const VecNd &U, double active_tolerance) const
+{
+  std::ostringstream msg;
+  if (!qp_problem_) 
+    throw std::runtime_error("MPC: calculateSensitivities() requires initializeSolver() to be called first");
+  uint32_t n_u = linear_system_.n_u;
+  uint32_t n_x = linear_system_.n_x;
+  uint32_t n = N_ * n_u;
+  if ((uint32_t)U.rows() != n) 
+  {
+    msg << "MPC: Vector 'U' size error\n U.rows() = " << U.rows() << ", needs to be = " << n << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  const SparseQpProblem &qp_problem = *qp_problem_;
+  auto isActive = [&](double slack, double bound) {
+    return slack <= active_tolerance * std::max(1.0, std::abs(bound));
+  };
+
+  // active set, state constraints first, then input bounds (+1 upper, -1 lower)
+  std::vector<uint32_t> active_constraints;
+  VecNd constraint_values = qp_problem.A_ieq * U + qp_problem.b_ieq;
+  for (uint32_t i = 0; i < constraint_values.rows(); i++) 
+    if (isActive(-constraint_values(i), qp_problem.b_ieq(i)))
+      active_constraints.push_back(i);
+  std::vector<std::pair<uint32_t, double>> active_bounds;
+  if (qp_problem.lower_bound.rows() > 0) 
+  {
+    for (uint32_t i = 0; i < n; i++) 
+    {
+      if (isActive(U(i) - qp_problem.lower_bound(i), qp_problem.lower_bound(i)))
+        active_bounds.emplace_back(i, -1.0);
+      else if (isActive(qp_problem.upper_bound(i) - U(i), qp_problem.upper_bound(i)))
+        active_bounds.emplace_back(i, 1.0);
+    }
+  }
+  uint32_t n_active = active_constraints.size() + active_bounds.size();
+
+  // reduced KKT matrix
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int k = 0; k < qp_problem.A_qp.outerSize(); k++) 
+    for (SparseMat::InnerIterator it(qp_problem.A_qp, k); it; ++it) 
+      triplets.emplace_back(it.row(), it.col(), it.value());
+  Eigen::SparseMatrix<double, Eigen::RowMajor> A_ieq_rows = qp_problem.A_ieq;
+  uint32_t kkt_row = n;
+  for (uint32_t i : active_constraints) 
+  {
+    for (Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(A_ieq_rows, i); it; ++it) 
+    {
+      triplets.emplace_back(kkt_row, it.col(), it.value());
+      triplets.emplace_back(it.col(), kkt_row, it.value());
+    }
+    kkt_row++;
+  }
+  for (const auto &bound : active_bounds) 
+  {
+    triplets.emplace_back(kkt_row, bound.first, bound.second);
+    triplets.emplace_back(bound.first, kkt_row, bound.second);
+    kkt_row++;
+  }
+  SparseMat kkt_matrix(n + n_active, n + n_active);
+  kkt_matrix.setFromTriplets(triplets.begin(), triplets.end());
+  Eigen::SparseLU<SparseMat> kkt_lu(kkt_matrix);
+  if (kkt_lu.info() != Eigen::Success) 
+    throw std::runtime_error("MPC: calculateSensitivities() singular KKT matrix, the active constraints "
+                             "are linearly dependent at U");
+
+  // right-hand sides, one column per parameter
+  MatNd w_u = MatNd(w_u_), w_x = MatNd(w_x_);
+  std::vector<std::string> weight_names;
+  std::vector<VecNd> weight_gradients; // d(A_qp)/dp U + d(b_qp)/dp
+  if (policy_->outputTrackingCost()) 
+  {
+    const OutputTrackingCost &cost = *policy_->outputTrackingCost();
+    VecNd output_error = cost.C_A * U + cost.C_B * x0_ - Y_d_;
+    weight_names = {"Q", "R"};
+    weight_gradients = {cost.C_A.transpose() * output_error, U};
+  }
+  else
+  {
+    const WeightedCost &cost = *policy_->weightedCost();
+    VecNd output_error = cost.C_A * U + cost.C_B * x0_ - Y_d_;
+    weight_names.push_back("W_y");
+    weight_gradients.push_back(cost.C_A.transpose() * output_error);
+    // d/dw(i,j) of W^T W v over the blocks v_k of v: e_j * (w * v_k)(i) + w(i, :)^T * v_k(j)
+    auto blockWeightGradient = [&](const MatNd &w, const VecNd &v, uint32_t i, uint32_t j) {
+      uint32_t size = w.rows();
+      VecNd gradient = VecNd::Zero(v.rows());
+      for (uint32_t k = 0; k < N_; k++) 
+      {
+        gradient(k * size + j) += w.row(i).dot(v.segment(k * size, size));
+        gradient.segment(k * size, size) += w.row(i).transpose() * v(k * size + j);
+      }
+      return gradient;
+    };
+    for (int k = 0; k < w_u_.outerSize(); k++) 
+    {
+      for (SparseMat::InnerIterator it(w_u_, k); it; ++it) 
+      {
+        weight_names.push_back("w_u(" + std::to_string(it.row()) + "," + std::to_string(it.col()) + ")");
+        weight_gradients.push_back(blockWeightGradient(w_u, U, it.row(), it.col()));
+      }
+    }
+    VecNd X = A_mpc_ * U + B_mpc_ * x0_;
+    for (int k = 0; k < w_x_.outerSize(); k++) 
+    {
+      for (SparseMat::InnerIterator it(w_x_, k); it; ++it) 
+      {
+        weight_names.push_back("w_x(" + std::to_string(it.row()) + "," + std::to_string(it.col()) + ")");
+        weight_gradients.push_back(A_mpc_.transpose() * blockWeightGradient(w_x, X, it.row(), it.col()));
+      }
+    }
+  }
+
+  uint32_t n_weights = weight_gradients.size();
+  uint32_t col_u_lower = n_weights, col_u_upper = col_u_lower + n_u;
+  uint32_t col_x_lower = col_u_upper + n_u, col_x_upper = col_x_lower + n_x;
+  uint32_t col_x0 = col_x_upper + n_x, col_Y_d = col_x0 + n_x;
+  MatNd rhs = MatNd::Zero(n + n_active, col_Y_d + Y_d_.rows());
+  for (uint32_t i = 0; i < n_weights; i++) 
+    rhs.block(0, i, n, 1) = -weight_gradients[i];
+  rhs.block(0, col_x0, n, n_x) = -gradient_x0_map_;
+  rhs.block(0, col_Y_d, n, Y_d_.rows()) = -gradient_Y_d_map_;
+
+  kkt_row = n;
+  for (uint32_t i : active_constraints) 
+  {
+    // state constraints, b_ieq = [-x_upper + B_mpc * x0; x_lower - B_mpc * x0] at the bounded rows of X
+    uint32_t state_row = policy_->stateBounds()->predictionRow(i);
+    uint32_t state_entry = state_row % n_x;
+    if (policy_->stateBounds()->isUpperBoundRow(i)) 
+    {
+      rhs(kkt_row, col_x_upper + state_entry) = 1.0;
+      rhs.block(kkt_row, col_x0, 1, n_x) = -MatNd(B_mpc_.row(state_row));
+    }
+    else
+    {
+      rhs(kkt_row, col_x_lower + state_entry) = -1.0;
+      rhs.block(kkt_row, col_x0, 1, n_x) = MatNd(B_mpc_.row(state_row));
+    }
+    kkt_row++;
+  }
+  for (const auto &bound : active_bounds) 
+  {
+    // U(i) - u_upper <= 0 and u_lower - U(i) <= 0
+    if (bound.second > 0.0) 
+      rhs(kkt_row, col_u_upper + bound.first % n_u) = 1.0;
+    else
+      rhs(kkt_row, col_u_lower + bound.first % n_u) = -1.0;
+    kkt_row++;
+  }
+
+  MatNd solution = kkt_lu.solve(rhs);
+  MpcSensitivities sensitivities;
+  sensitivities.dU_dweights = solution.block(0, 0, n, n_weights);
+  sensitivities.weight_names = weight_names;
+  sensitivities.dU_du_lower_bound = solution.block(0, col_u_lower, n, n_u);
+  sensitivities.dU_du_upper_bound = solution.block(0, col_u_upper, n, n_u);
+  sensitivities.dU_dx_lower_bound = solution.block(0, col_x_lower, n, n_x);
+  sensitivities.dU_dx_upper_bound = solution.block(0, col_x_upper, n, n_x);
+  sensitivities.dU_dx0 = solution.block(0, col_x0, n, n_x);
+  sensitivities.dU_dY_d = solution.block(0, col_Y_d, n, Y_d_.rows());
+  sensitivities.n_active_bounds = active_bounds.size();
+  sensitivities.n_active_constraints = active_constraints.size();
+  return sensitivities;
+}
+
 std::vector< std::vector<double> > LinMpcEigen::MPC::extractU(const VecNd &U_in) const 
 {
   std::vector<std::vector<double>> return_vector_U;
@@ -568,16 +1552,6 @@ std::vector< std::vector<double> > LinMpcEigen::MPC::extractY(const VecNd &U_in)
   return return_vector_Y;
 } 
 
-void LinMpcEigen::MPC::setWeightMatrices() 
-{
-  checkWeightDimensions();
-  for (uint32_t i = 0; i < N_; i++) 
-  {
-    setSparseBlock(W_u_, w_u_, linear_system_.n_u * i, linear_system_.n_u * i);
-    setSparseBlock(W_x_, w_x_, linear_system_.n_x * i, linear_system_.n_x * i);
-  }
-}
-
 void LinMpcEigen::MPC::checkWeightDimensions() const
 {
   std::ostringstream msg;
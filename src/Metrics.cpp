@@ -0,0 +1,304 @@
+/**
+ * @file Metrics.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <osqp.h>
+#include <sstream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::string escapeLabel(const std::string &value)
+{
+  std::string escaped;
+  for (char c : value)
+  {
+    if (c == '\\' || c == '"')
+      escaped += '\\';
+    if (c == '\n')
+    {
+      escaped += "\\n";
+      continue;
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+void writeAll(int fd, const std::string &text)
+{
+#ifdef __linux__
+  size_t written = 0;
+  while (written < text.size())
+  {
+    // no SIGPIPE if the client has already disconnected
+    ssize_t n = ::send(fd, text.data() + written, text.size() - written, MSG_NOSIGNAL);
+    if (n <= 0 && errno != EINTR)
+      return;
+    if (n > 0)
+      written += n;
+  }
+#else
+  (void)fd;
+  (void)text;
+#endif
+}
+
+} // namespace
+
+// -------------- LatencySummary -----------------
+const std::array<double, LinMpcEigen::LatencySummary::n_buckets> LinMpcEigen::LatencySummary::bucket_bounds = {
+  1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 1e-1, 2.5e-1, 1.0
+};
+
+void LinMpcEigen::LatencySummary::observe(double seconds)
+{
+  uint64_t nanoseconds = (uint64_t)(std::max(seconds, 0.0) * 1e9);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(nanoseconds, std::memory_order_relaxed);
+  uint64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+  while (nanoseconds > max_ns && !max_ns_.compare_exchange_weak(max_ns, nanoseconds, std::memory_order_relaxed)) {}
+
+  auto bucket = std::lower_bound(bucket_bounds.begin(), bucket_bounds.end(), seconds);
+  if (bucket != bucket_bounds.end())
+    buckets_[bucket - bucket_bounds.begin()].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t LinMpcEigen::LatencySummary::getCount() const
+{
+  return count_.load(std::memory_order_relaxed);
+}
+
+double LinMpcEigen::LatencySummary::getSum() const
+{
+  return sum_ns_.load(std::memory_order_relaxed) * 1e-9;
+}
+
+double LinMpcEigen::LatencySummary::getMax() const
+{
+  return max_ns_.load(std::memory_order_relaxed) * 1e-9;
+}
+
+uint64_t LinMpcEigen::LatencySummary::getBucketCount(uint32_t bucket) const
+{
+  uint64_t count = 0;
+  for (uint32_t i = 0; i <= bucket && i < n_buckets; i++)
+    count += buckets_[i].load(std::memory_order_relaxed);
+  return count;
+}
+
+// -------------- MpcMetrics -----------------
+void LinMpcEigen::MpcMetrics::recordSolve(int status, uint32_t solve_iterations, double latency, 
+                                          bool warm_started)
+{
+  solves.fetch_add(1, std::memory_order_relaxed);
+  if (warm_started)
+    warm_starts.fetch_add(1, std::memory_order_relaxed);
+  if (status != OSQP_SOLVED && status != OSQP_SOLVED_INACCURATE)
+    failures.fetch_add(1, std::memory_order_relaxed);
+  if (status == OSQP_PRIMAL_INFEASIBLE || status == OSQP_PRIMAL_INFEASIBLE_INACCURATE ||
+      status == OSQP_DUAL_INFEASIBLE || status == OSQP_DUAL_INFEASIBLE_INACCURATE)
+    infeasible.fetch_add(1, std::memory_order_relaxed);
+  if (status == OSQP_TIME_LIMIT_REACHED)
+    time_limit_hits.fetch_add(1, std::memory_order_relaxed);
+  iterations.fetch_add(solve_iterations, std::memory_order_relaxed);
+  last_status.store(status, std::memory_order_relaxed);
+  last_iterations.store(solve_iterations, std::memory_order_relaxed);
+  solve_latency.observe(latency);
+}
+
+void LinMpcEigen::MpcMetrics::recordUpdate(double latency)
+{
+  updates.fetch_add(1, std::memory_order_relaxed);
+  update_latency.observe(latency);
+}
+
+double LinMpcEigen::MpcMetrics::getWarmStartRatio() const
+{
+  uint64_t n_solves = solves.load(std::memory_order_relaxed);
+  return n_solves > 0 ? (double)warm_starts.load(std::memory_order_relaxed) / n_solves : 0.0;
+}
+
+double LinMpcEigen::MpcMetrics::getSkipRatio() const
+{
+  uint64_t n_skipped = skipped_solves.load(std::memory_order_relaxed);
+  uint64_t n_releases = solves.load(std::memory_order_relaxed) + n_skipped;
+  return n_releases > 0 ? (double)n_skipped / n_releases : 0.0;
+}
+
+// -------------- MetricsExporter -----------------
+LinMpcEigen::MetricsExporter::~MetricsExporter()
+{
+  stopServing();
+}
+
+void LinMpcEigen::MetricsExporter::add(const std::string &controller_name, const MpcMetrics &metrics)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  controllers_.emplace_back(controller_name, &metrics);
+}
+
+void LinMpcEigen::MetricsExporter::render(std::ostream &stream) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::streamsize precision = stream.precision(9);
+
+  auto family = [&](const char *name, const char *type, const char *help) {
+    stream << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+  };
+  auto counter = [&](const char *name, const char *help, std::atomic<uint64_t> MpcMetrics::*member) {
+    family(name, "counter", help);
+    for (const auto &controller : controllers_)
+      stream << name << "{controller=\"" << escapeLabel(controller.first) << "\"} "
+             << (controller.second->*member).load(std::memory_order_relaxed) << "\n";
+  };
+  auto gauge = [&](const char *name, const char *help, double (*value)(const MpcMetrics &)) {
+    family(name, "gauge", help);
+    for (const auto &controller : controllers_)
+      stream << name << "{controller=\"" << escapeLabel(controller.first) << "\"} "
+             << value(*controller.second) << "\n";
+  };
+  auto histogram = [&](const char *name, const char *help, LatencySummary MpcMetrics::*member) {
+    family(name, "histogram", help);
+    for (const auto &controller : controllers_)
+    {
+      const LatencySummary &summary = controller.second->*member;
+      std::string label = "controller=\"" + escapeLabel(controller.first) + "\"";
+      for (uint32_t i = 0; i < LatencySummary::n_buckets; i++)
+        stream << name << "_bucket{" << label << ",le=\"" << LatencySummary::bucket_bounds[i] << "\"} "
+               << summary.getBucketCount(i) << "\n";
+      stream << name << "_bucket{" << label << ",le=\"+Inf\"} " << summary.getCount() << "\n";
+      stream << name << "_sum{" << label << "} " << summary.getSum() << "\n";
+      stream << name << "_count{" << label << "} " << summary.getCount() << "\n";
+    }
+  };
+
+  counter("lin_mpc_solves_total", "QP solves", &MpcMetrics::solves);
+  counter("lin_mpc_solve_failures_total", "Solves that ended without a solution", &MpcMetrics::failures);
+  counter("lin_mpc_infeasible_total", "Solves that detected primal or dual infeasibility", &MpcMetrics::infeasible);
+  counter("lin_mpc_time_limit_hits_total", "Solves stopped by the time limit", &MpcMetrics::time_limit_hits);
+  counter("lin_mpc_iterations_total", "ADMM iterations over all solves", &MpcMetrics::iterations);
+  counter("lin_mpc_updates_total", "Solver updates", &MpcMetrics::updates);
+  counter("lin_mpc_warm_starts_total", "Solves started from a previous iterate", &MpcMetrics::warm_starts);
+  counter("lin_mpc_skipped_solves_total", "Releases skipped by the executor", &MpcMetrics::skipped_solves);
+  gauge("lin_mpc_last_status", "OSQP status of the last solve",
+        [](const MpcMetrics &metrics) { return (double)metrics.last_status.load(std::memory_order_relaxed); });
+  gauge("lin_mpc_last_iterations", "ADMM iterations of the last solve",
+        [](const MpcMetrics &metrics) { return (double)metrics.last_iterations.load(std::memory_order_relaxed); });
+  gauge("lin_mpc_warm_start_ratio", "Warm started solves per solve",
+        [](const MpcMetrics &metrics) { return metrics.getWarmStartRatio(); });
+  gauge("lin_mpc_skip_ratio", "Skipped releases per release",
+        [](const MpcMetrics &metrics) { return metrics.getSkipRatio(); });
+  gauge("lin_mpc_solve_latency_max_seconds", "Longest solve",
+        [](const MpcMetrics &metrics) { return metrics.solve_latency.getMax(); });
+  gauge("lin_mpc_update_latency_max_seconds", "Longest solver update",
+        [](const MpcMetrics &metrics) { return metrics.update_latency.getMax(); });
+  histogram("lin_mpc_solve_latency_seconds", "Solve latency", &MpcMetrics::solve_latency);
+  histogram("lin_mpc_update_latency_seconds", "Solver update latency", &MpcMetrics::update_latency);
+  stream.precision(precision);
+}
+
+std::string LinMpcEigen::MetricsExporter::render() const
+{
+  std::ostringstream stream;
+  render(stream);
+  return stream.str();
+}
+
+void LinMpcEigen::MetricsExporter::writeToFile(const std::string &file_path) const
+{
+  // scrapers never see a partially written file
+  std::string temporary_path = file_path + ".tmp";
+  {
+    std::ofstream file(temporary_path);
+    if (!file)
+      throw std::runtime_error("MetricsExporter: can't open '" + temporary_path + "'");
+    render(file);
+    if (!file)
+      throw std::runtime_error("MetricsExporter: can't write '" + temporary_path + "'");
+  }
+  if (std::rename(temporary_path.c_str(), file_path.c_str()) != 0)
+    throw std::runtime_error("MetricsExporter: can't rename '" + temporary_path + "' to '" + file_path + "'");
+}
+
+void LinMpcEigen::MetricsExporter::serveUnixSocket(const std::string &socket_path)
+{
+#ifdef __linux__
+  stopServing();
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("MetricsExporter: socket path '" + socket_path + "' is too long");
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+  int socket_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_fd < 0)
+    throw std::runtime_error(std::string("MetricsExporter: socket: ") + std::strerror(errno));
+  ::unlink(socket_path.c_str());
+  if (::bind(socket_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      ::listen(socket_fd, 8) != 0)
+  {
+    std::string error = std::strerror(errno);
+    ::close(socket_fd);
+    throw std::runtime_error("MetricsExporter: can't listen on '" + socket_path + "': " + error);
+  }
+
+  socket_path_ = socket_path;
+  stop_ = false;
+  server_ = std::thread(&MetricsExporter::serveLoop, this, socket_fd);
+#else
+  (void)socket_path;
+  throw std::runtime_error("MetricsExporter: Unix sockets are only supported on Linux");
+#endif
+}
+
+void LinMpcEigen::MetricsExporter::stopServing()
+{
+  if (!server_.joinable())
+    return;
+  stop_ = true;
+  server_.join();
+#ifdef __linux__
+  ::unlink(socket_path_.c_str());
+#endif
+  socket_path_.clear();
+}
+
+void LinMpcEigen::MetricsExporter::serveLoop(int socket_fd)
+{
+#ifdef __linux__
+  pollfd poll_fd;
+  poll_fd.fd = socket_fd;
+  poll_fd.events = POLLIN;
+  while (!stop_)
+  {
+    // short timeout to notice stopServing()
+    if (::poll(&poll_fd, 1, 100) <= 0)
+      continue;
+    int client_fd = ::accept(socket_fd, nullptr, nullptr);
+    if (client_fd < 0)
+      continue;
+    writeAll(client_fd, render());
+    ::close(client_fd);
+  }
+  ::close(socket_fd);
+#else
+  (void)socket_fd;
+#endif
+}
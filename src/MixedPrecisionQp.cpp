@@ -0,0 +1,396 @@
+/**
+ * @file MixedPrecisionQp.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "MixedPrecisionQp.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+struct AdmmTolerance {
+  double absolute_tolerance;
+  double relative_tolerance;
+};
+
+// OSQP adaptive rho: rho is replaced by its estimate if they differ by more than this factor
+const double adaptive_rho_tolerance = 5.0;
+const double rho_min = 1e-6;
+const double rho_max = 1e6;
+
+// residuals of the unscaled problem and their normalization terms
+struct AdmmResiduals {
+  double primal, primal_scale; // ||A x - z||_inf, max(||A x||_inf, ||z||_inf)
+  double dual, dual_scale;     // ||P x + q + A^T y||_inf, max(||P x||_inf, ||A^T y||_inf, ||q||_inf)
+
+  // OSQP termination criterion
+  bool converged(const AdmmTolerance &tolerance) const 
+  {
+    return primal <= tolerance.absolute_tolerance + tolerance.relative_tolerance * primal_scale &&
+           dual <= tolerance.absolute_tolerance + tolerance.relative_tolerance * dual_scale;
+  }
+  // OSQP rho estimate rho * sqrt(normalized primal residual / normalized dual residual), as a factor of rho
+  double rhoFactor() const 
+  {
+    double primal_normalized = primal / (primal_scale + 1e-10);
+    double dual_normalized = dual / (dual_scale + 1e-10);
+    return std::sqrt(primal_normalized / (dual_normalized + 1e-10));
+  }
+};
+
+// scaled problem data in the precision of Scalar, the residuals are unscaled with 
+// primal_unscaling = E^-1 and dual_unscaling = D^-1 / c
+template <typename Scalar>
+struct AdmmProblem {
+  using Vec = Eigen::Matrix<Scalar, -1, 1>;
+  const Eigen::SparseMatrix<Scalar> &P;
+  const Eigen::SparseMatrix<Scalar> &A;
+  const Vec &q, &lower_bound, &upper_bound;
+  const Vec &primal_unscaling, &dual_unscaling;
+};
+
+template <typename Scalar>
+AdmmResiduals admmResiduals( const AdmmProblem<Scalar> &problem, const Eigen::Matrix<Scalar, -1, 1> &x,
+                             const Eigen::Matrix<Scalar, -1, 1> &z, const Eigen::Matrix<Scalar, -1, 1> &y ) 
+{
+  using Vec = Eigen::Matrix<Scalar, -1, 1>;
+  Vec Ax = problem.primal_unscaling.cwiseProduct(problem.A * x);
+  Vec z_unscaled = problem.primal_unscaling.cwiseProduct(z);
+  Vec Px = problem.dual_unscaling.cwiseProduct(problem.P * x);
+  Vec ATy = problem.dual_unscaling.cwiseProduct(problem.A.transpose() * y);
+  Vec q = problem.dual_unscaling.cwiseProduct(problem.q);
+
+  AdmmResiduals residuals;
+  bool constrained = problem.A.rows() > 0;
+  residuals.primal = constrained ? (double)(Ax - z_unscaled).template lpNorm<Eigen::Infinity>() : 0.0;
+  residuals.primal_scale = constrained ? std::max( (double)Ax.template lpNorm<Eigen::Infinity>(), 
+                                                   (double)z_unscaled.template lpNorm<Eigen::Infinity>() ) : 0.0;
+  residuals.dual = (double)(Px + q + ATy).template lpNorm<Eigen::Infinity>();
+  residuals.dual_scale = std::max( (double)Px.template lpNorm<Eigen::Infinity>(), 
+                                   std::max( (double)ATy.template lpNorm<Eigen::Infinity>(), 
+                                             (double)q.template lpNorm<Eigen::Infinity>() ) );
+  return residuals;
+}
+
+/*
+  At most max_iteration OSQP ADMM iterations in the precision of Scalar, linear_solve solves K * x = rhs. 
+  Every adaptive_rho_interval iterations (0 - fixed rho) rho is rescaled to the OSQP estimate and 
+  update_rho(rho) refactorizes K. The time limit is checked every iteration.
+  Returns true if converged, the iterations are added to iterations
+*/
+template <typename Scalar, typename LinearSolve, typename RhoUpdate, typename TimeExceeded>
+bool runAdmm( const AdmmProblem<Scalar> &problem, Eigen::Matrix<Scalar, -1, 1> &rho,
+              Scalar sigma, Scalar alpha, const AdmmTolerance &tolerance, uint32_t max_iteration, 
+              uint32_t check_termination, uint32_t adaptive_rho_interval,
+              Eigen::Matrix<Scalar, -1, 1> &x, Eigen::Matrix<Scalar, -1, 1> &z, Eigen::Matrix<Scalar, -1, 1> &y,
+              uint32_t &iterations, LinearSolve linear_solve, RhoUpdate update_rho, TimeExceeded time_exceeded ) 
+{
+  using Vec = Eigen::Matrix<Scalar, -1, 1>;
+  const Eigen::SparseMatrix<Scalar> &A = problem.A;
+  for (uint32_t k = 1; k <= max_iteration; k++) 
+  {
+    Vec rhs = sigma * x - problem.q + A.transpose() * (rho.cwiseProduct(z) - y);
+    Vec x_tilde = linear_solve(rhs);
+    Vec z_tilde = A * x_tilde;
+    Vec z_relaxed = alpha * z_tilde + (1 - alpha) * z;
+
+    x = alpha * x_tilde + (1 - alpha) * x;
+    Vec z_new = (z_relaxed + y.cwiseQuotient(rho)).cwiseMax(problem.lower_bound).cwiseMin(problem.upper_bound);
+    y += rho.cwiseProduct(z_relaxed - z_new);
+    z = z_new;
+    iterations++;
+
+    bool check = check_termination > 0 && k % check_termination == 0;
+    bool adapt = adaptive_rho_interval > 0 && k % adaptive_rho_interval == 0 && A.rows() > 0;
+    if (check || adapt) 
+    {
+      AdmmResiduals residuals = admmResiduals(problem, x, z, y);
+      if (check && residuals.converged(tolerance)) 
+        return true;
+      // the smallest entry of rho is the bound and inequality rho, equality rows use 1e3 times of it
+      double rho_factor = residuals.rhoFactor();
+      double rho_base = rho.minCoeff();
+      rho_factor = std::min(std::max(rho_factor, rho_min / rho_base), rho_max / rho_base);
+      if (adapt && (rho_factor > adaptive_rho_tolerance || rho_factor < 1.0 / adaptive_rho_tolerance)) 
+      {
+        rho *= (Scalar)rho_factor;
+        update_rho(rho);
+      }
+    }
+    if (time_exceeded()) 
+      return false;
+  }
+  return admmResiduals(problem, x, z, y).converged(tolerance);
+}
+
+} // namespace
+
+// -------------- MixedPrecisionQpSolver -----------------
+MixedPrecisionQpSolver::MixedPrecisionQpSolver( const SparseQpProblem &qp_problem, const OsqpSettings &settings,
+                                                double time_limit, uint32_t refinement_steps, 
+                                                double single_precision_tolerance,
+                                                uint32_t single_precision_max_iteration ) 
+  : settings_(settings), time_limit_(time_limit), 
+  refinement_steps_(refinement_steps), single_precision_tolerance_(single_precision_tolerance),
+  single_precision_max_iteration_(single_precision_max_iteration),
+  n_(qp_problem.A_qp.rows()), 
+  m_(qp_problem.upper_bound.rows() + qp_problem.A_eq.rows() + qp_problem.A_ieq.rows()),
+  P_(qp_problem.A_qp), q_(qp_problem.b_qp),
+  x_(VecNd::Zero(n_)), z_(VecNd::Zero(m_)), y_(VecNd::Zero(m_))
+{
+  if (settings_.rho <= 0.0 || settings_.sigma <= 0.0) 
+    throw std::runtime_error("MixedPrecisionQpSolver: rho and sigma must be positive");
+  setupConstraints(qp_problem);
+  scaleProblem();
+  factorize();
+}
+
+MixedPrecisionQpSolver::MixedPrecisionQpSolver( const SparseQpProblem &qp_problem, const OsqpSettings &settings,
+                                                std::unique_ptr<KktSolver> kkt_solver, double time_limit ) 
+  : settings_(settings), time_limit_(time_limit), 
+  refinement_steps_(0), single_precision_tolerance_(0.0), single_precision_max_iteration_(0),
+  n_(qp_problem.A_qp.rows()), 
+  m_(qp_problem.upper_bound.rows() + qp_problem.A_eq.rows() + qp_problem.A_ieq.rows()),
+  P_(qp_problem.A_qp), q_(qp_problem.b_qp), kkt_solver_(std::move(kkt_solver)),
+  x_(VecNd::Zero(n_)), z_(VecNd::Zero(m_)), y_(VecNd::Zero(m_))
+{
+  if (settings_.rho <= 0.0 || settings_.sigma <= 0.0) 
+    throw std::runtime_error("MixedPrecisionQpSolver: rho and sigma must be positive");
+  // A^T * diag(rho) * A is diagonal only for bound constraints
+  if ( qp_problem.A_eq.rows() > 0 || qp_problem.A_ieq.rows() > 0 || 
+       (m_ > 0 && m_ != n_) ) 
+    throw std::runtime_error("MixedPrecisionQpSolver: a KktSolver requires a bounds-only QP");
+  setupConstraints(qp_problem);
+  scaleProblem();
+  factorize();
+}
+
+void MixedPrecisionQpSolver::setupConstraints(const SparseQpProblem &qp_problem) 
+{
+  uint32_t n_bounds = qp_problem.upper_bound.rows();
+  uint32_t n_eq = qp_problem.A_eq.rows();
+  uint32_t n_ieq = qp_problem.A_ieq.rows();
+
+  std::vector<Eigen::Triplet<double>> triplets;
+  triplets.reserve(n_bounds + qp_problem.A_eq.nonZeros() + qp_problem.A_ieq.nonZeros());
+  for (uint32_t i = 0; i < n_bounds; i++) 
+    triplets.emplace_back(i, i, 1.0);
+  for (int k = 0; k < qp_problem.A_eq.outerSize(); ++k) 
+    for (SparseMat::InnerIterator it(qp_problem.A_eq, k); it; ++it) 
+      triplets.emplace_back(n_bounds + it.row(), it.col(), it.value());
+  for (int k = 0; k < qp_problem.A_ieq.outerSize(); ++k) 
+    for (SparseMat::InnerIterator it(qp_problem.A_ieq, k); it; ++it) 
+      triplets.emplace_back(n_bounds + n_eq + it.row(), it.col(), it.value());
+
+  A_.resize(m_, n_);
+  A_.setFromTriplets(triplets.begin(), triplets.end());
+
+  lower_bound_.resize(m_);
+  upper_bound_.resize(m_);
+  lower_bound_ << qp_problem.lower_bound, -qp_problem.b_eq, -inf * VecNd::Ones(n_ieq);
+  upper_bound_ << qp_problem.upper_bound, -qp_problem.b_eq, -qp_problem.b_ieq;
+
+  // OSQP step size choice: equality rows get 1e3 * rho
+  rho_ = VecNd::Constant(m_, settings_.rho);
+  rho_.segment(n_bounds, n_eq).setConstant(1e3 * settings_.rho);
+}
+
+/*
+  OSQP's Ruiz equilibration, settings_.scaling iterations of
+    D <- D / sqrt(column infinity norms of [P; A]),  E <- E / sqrt(row infinity norms of A)
+  followed by the cost scaling c <- c / max(mean column infinity norm of P, ||q||_inf).
+  The solver works on c * D * P * D, c * D * q, E * A * D and E * bounds, so x = D * x_s
+*/
+void MixedPrecisionQpSolver::scaleProblem() 
+{
+  // OSQP limits the scaling steps to [1e-4, 1e4], too small norms are not scaled
+  auto limitScaling = [](double value) { return value < 1e-4 ? 1.0 : std::min(value, 1e4); };
+
+  D_ = VecNd::Ones(n_);
+  E_ = VecNd::Ones(m_);
+  cost_scaling_ = 1.0;
+  for (uint32_t i = 0; i < settings_.scaling; i++) 
+  {
+    VecNd column_norm = VecNd::Zero(n_);
+    VecNd row_norm = VecNd::Zero(m_);
+    for (int k = 0; k < P_.outerSize(); ++k) 
+      for (SparseMat::InnerIterator it(P_, k); it; ++it) 
+        column_norm(it.col()) = std::max(column_norm(it.col()), std::abs(it.value()));
+    for (int k = 0; k < A_.outerSize(); ++k) 
+      for (SparseMat::InnerIterator it(A_, k); it; ++it) 
+      {
+        column_norm(it.col()) = std::max(column_norm(it.col()), std::abs(it.value()));
+        row_norm(it.row()) = std::max(row_norm(it.row()), std::abs(it.value()));
+      }
+    VecNd D_step = column_norm.unaryExpr(limitScaling).cwiseSqrt().cwiseInverse();
+    VecNd E_step = row_norm.unaryExpr(limitScaling).cwiseSqrt().cwiseInverse();
+    P_ = D_step.asDiagonal() * P_ * D_step.asDiagonal();
+    A_ = E_step.asDiagonal() * A_ * D_step.asDiagonal();
+    q_ = D_step.cwiseProduct(q_);
+    D_ = D_.cwiseProduct(D_step);
+    E_ = E_.cwiseProduct(E_step);
+
+    VecNd P_column_norm = VecNd::Zero(n_);
+    for (int k = 0; k < P_.outerSize(); ++k) 
+      for (SparseMat::InnerIterator it(P_, k); it; ++it) 
+        P_column_norm(it.col()) = std::max(P_column_norm(it.col()), std::abs(it.value()));
+    double cost_measure = limitScaling(n_ > 0 ? P_column_norm.mean() : 0.0);
+    double cost_step = limitScaling(1.0 / std::max(cost_measure, limitScaling(q_.lpNorm<Eigen::Infinity>())));
+    P_ *= cost_step;
+    q_ *= cost_step;
+    cost_scaling_ *= cost_step;
+  }
+  lower_bound_ = E_.cwiseProduct(lower_bound_);
+  upper_bound_ = E_.cwiseProduct(upper_bound_);
+}
+
+void MixedPrecisionQpSolver::factorize() 
+{
+  if (kkt_solver_) 
+  {
+    // A = E * D is diagonal, (c * D * A_qp * D + diag(shift)) * x = rhs is solved as
+    // (A_qp + diag(shift / (c * D^2))) * D * x = D^-1 * rhs / c
+    VecNd diagonal_shift = VecNd::Constant(n_, settings_.sigma);
+    if (m_ > 0) 
+      diagonal_shift += rho_.cwiseProduct(A_.diagonal().cwiseAbs2());
+    kkt_solver_->factorize(diagonal_shift.cwiseQuotient(cost_scaling_ * D_.cwiseAbs2()));
+    return;
+  }
+
+  SparseMat identity(n_, n_);
+  identity.setIdentity();
+  K_ = P_ + settings_.sigma * identity + SparseMat(A_.transpose() * rho_.asDiagonal() * A_);
+
+  P_f_ = P_.cast<float>();
+  A_f_ = A_.cast<float>();
+  K_f_ldlt_.compute(K_.cast<float>());
+  if (K_f_ldlt_.info() != Eigen::Success) 
+    throw std::runtime_error("MixedPrecisionQpSolver: single precision factorization of the KKT matrix failed");
+}
+
+VecNd MixedPrecisionQpSolver::refinedSolve(const VecNd &rhs) const 
+{
+  if (kkt_solver_) 
+  {
+    VecNd D_inverse = D_.cwiseInverse();
+    return D_inverse.cwiseProduct(kkt_solver_->solve(D_inverse.cwiseProduct(rhs) / cost_scaling_));
+  }
+
+  VecNd solution = K_f_ldlt_.solve(VecNf(rhs.cast<float>())).cast<double>();
+  for (uint32_t i = 0; i < refinement_steps_; i++) 
+  {
+    VecNd residual = rhs - K_ * solution;
+    solution += K_f_ldlt_.solve(VecNf(residual.cast<float>())).cast<double>();
+  }
+  return solution;
+}
+
+void MixedPrecisionQpSolver::updateGradient(const VecNd &b_qp) 
+{
+  q_ = cost_scaling_ * D_.cwiseProduct(b_qp);
+}
+
+void MixedPrecisionQpSolver::updateGradientAndIeqConstraint(const VecNd &b_qp, const VecNd &b_ieq) 
+{
+  q_ = cost_scaling_ * D_.cwiseProduct(b_qp);
+  upper_bound_.tail(b_ieq.rows()) = -E_.tail(b_ieq.rows()).cwiseProduct(b_ieq);
+}
+
+void MixedPrecisionQpSolver::setPrimalWarmStart(const VecNd &primal_variable) 
+{
+  x_ = primal_variable.cwiseQuotient(D_);
+  z_ = A_ * x_;
+  has_iterate_ = true;
+}
+
+VecNd MixedPrecisionQpSolver::solveProblem() 
+{
+  auto start_time = std::chrono::steady_clock::now();
+  auto time_exceeded = [&]() {
+    return time_limit_ > 0.0 && 
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count() > time_limit_;
+  };
+
+  if (!settings_.warm_start) 
+  {
+    x_.setZero();
+    z_.setZero();
+    y_.setZero();
+  }
+  iterations_ = 0;
+  uint32_t adaptive_rho_interval = settings_.adaptive_rho ? 
+    (settings_.adaptive_rho_interval > 0 ? settings_.adaptive_rho_interval : 25) : 0;
+  VecNd primal_unscaling = E_.cwiseInverse();
+  VecNd dual_unscaling = D_.cwiseInverse() / cost_scaling_;
+
+  // single precision phase with its own iteration cap, skipped with a KktSolver
+  bool time_limit_reached = false;
+  if (!kkt_solver_) 
+  {
+    VecNf x_f = x_.cast<float>();
+    VecNf z_f = z_.cast<float>();
+    VecNf y_f = y_.cast<float>();
+    VecNf q_f = q_.cast<float>();
+    VecNf lower_bound_f = lower_bound_.cast<float>();
+    VecNf upper_bound_f = upper_bound_.cast<float>();
+    VecNf rho_f = rho_.cast<float>();
+    VecNf primal_unscaling_f = primal_unscaling.cast<float>();
+    VecNf dual_unscaling_f = dual_unscaling.cast<float>();
+    AdmmProblem<float> problem_f = { P_f_, A_f_, q_f, lower_bound_f, upper_bound_f, 
+                                     primal_unscaling_f, dual_unscaling_f };
+    AdmmTolerance single_precision_tolerance = { single_precision_tolerance_, single_precision_tolerance_ };
+    auto single_precision_solve = [this](const VecNf &rhs) -> VecNf { return K_f_ldlt_.solve(rhs); };
+    auto single_precision_rho_update = [this](const VecNf &rho) { rho_ = rho.cast<double>(); factorize(); };
+
+    runAdmm<float>( problem_f, rho_f, (float)settings_.sigma, (float)settings_.alpha, single_precision_tolerance,
+                    single_precision_max_iteration_, std::max<uint32_t>(settings_.check_termination, 1),
+                    adaptive_rho_interval, x_f, z_f, y_f, iterations_, 
+                    single_precision_solve, single_precision_rho_update, time_exceeded );
+    x_ = x_f.cast<double>();
+    z_ = z_f.cast<double>();
+    y_ = y_f.cast<double>();
+    time_limit_reached = time_exceeded();
+  }
+
+  // double precision phase with the max_iteration budget of the settings, every linear solve is 
+  // refined (or solved directly by the KktSolver)
+  bool converged = false;
+  if (!time_limit_reached) 
+  {
+    AdmmProblem<double> problem = { P_, A_, q_, lower_bound_, upper_bound_, primal_unscaling, dual_unscaling };
+    AdmmTolerance tolerance = { settings_.absolute_tolerance, settings_.relative_tolerance };
+    auto refined_solve = [this](const VecNd &rhs) -> VecNd { return refinedSolve(rhs); };
+    auto rho_update = [this](const VecNd &/*rho*/) { factorize(); };
+
+    converged = runAdmm<double>( problem, rho_, settings_.sigma, settings_.alpha, tolerance, 
+                                 settings_.max_iteration, settings_.check_termination, adaptive_rho_interval,
+                                 x_, z_, y_, iterations_, refined_solve, rho_update, time_exceeded );
+  }
+
+  if (converged) 
+    status_ = OSQP_SOLVED;
+  else if (time_exceeded()) 
+    status_ = OSQP_TIME_LIMIT_REACHED;
+  else 
+    status_ = OSQP_MAX_ITER_REACHED;
+  has_iterate_ = true;
+  return D_.cwiseProduct(x_);
+}
+
+int MixedPrecisionQpSolver::getStatus() const 
+{
+  return status_;
+}
+
+uint32_t MixedPrecisionQpSolver::getIterations() const 
+{
+  return iterations_;
+}
+
+bool MixedPrecisionQpSolver::isWarmStarted() const 
+{
+  return settings_.warm_start && has_iterate_;
+}
@@ -0,0 +1,238 @@
+/**
+ * @file MonteCarlo.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "MonteCarlo.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+SparseMat perturbMatrix(const SparseMat &mat, double relative_std, std::mt19937_64 &rng)
+{
+  SparseMat perturbed = mat;
+  if (relative_std <= 0.0) 
+    return perturbed;
+
+  std::normal_distribution<double> normal(0.0, relative_std);
+  for (Eigen::Index k = 0; k < perturbed.outerSize(); ++k)
+    for (SparseMat::InnerIterator it(perturbed, k); it; ++it)
+      it.valueRef() *= 1.0 + normal(rng);
+  return perturbed;
+}
+
+VecNd sampleNoise(const VecNd &noise_std, uint32_t n_x, std::mt19937_64 &rng)
+{
+  VecNd noise = VecNd::Zero(n_x);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (Eigen::Index i = 0; i < noise_std.rows(); i++) 
+    noise(i) = noise_std(i) * normal(rng);
+  return noise;
+}
+
+// largest violation of lower_bound <= v <= upper_bound, 0 if the bounds are empty
+double boundViolation(const VecNd &v, const VecNd &lower_bound, const VecNd &upper_bound)
+{
+  if (lower_bound.rows() == 0) 
+    return 0.0;
+  return std::max( (lower_bound - v).maxCoeff(), (v - upper_bound).maxCoeff() );
+}
+
+double percentile(const std::vector<double> &sorted_values, double q)
+{
+  if (sorted_values.empty()) 
+    return 0.0;
+  size_t i = (size_t)std::ceil(q * sorted_values.size());
+  return sorted_values[std::min(std::max<size_t>(i, 1), sorted_values.size()) - 1];
+}
+
+}
+
+LinMpcEigen::MonteCarloHarness::MonteCarloHarness(const LinearSystem &nominal_system, 
+                                                  const PerturbationDistribution &perturbation,
+                                                  const MpcFactory &mpc_factory)
+  : nominal_system_(nominal_system), perturbation_(perturbation), mpc_factory_(mpc_factory)
+{
+  std::ostringstream msg;
+  uint32_t n_x = nominal_system_.n_x;
+  if (perturbation_.process_noise_std.rows() != 0 && (uint32_t)perturbation_.process_noise_std.rows() != n_x) 
+  {
+    msg << "MonteCarloHarness: Vector 'process_noise_std' size error\n process_noise_std.rows() = " 
+        << perturbation_.process_noise_std.rows() << ", needs to be = " << n_x << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  if (perturbation_.measurement_noise_std.rows() != 0 && (uint32_t)perturbation_.measurement_noise_std.rows() != n_x) 
+  {
+    msg << "MonteCarloHarness: Vector 'measurement_noise_std' size error\n measurement_noise_std.rows() = " 
+        << perturbation_.measurement_noise_std.rows() << ", needs to be = " << n_x << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+void LinMpcEigen::MonteCarloHarness::checkSpecDimensions(const ScenarioSpec &spec, uint32_t horizon) const
+{
+  std::ostringstream msg;
+  uint32_t n_x = nominal_system_.n_x;
+  uint32_t n_u = nominal_system_.n_u;
+  uint32_t n_y = nominal_system_.n_y;
+
+  if ((uint32_t)spec.x0.rows() != n_x) 
+  {
+    msg << "MonteCarloHarness: Vector 'x0' size error\n x0.rows() = " << spec.x0.rows() 
+        << ", needs to be = " << n_x << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  if (horizon == 0 || (uint32_t)spec.Y_d_full.rows() != (spec.n_steps + horizon) * n_y) 
+  {
+    msg << "MonteCarloHarness: Vector 'Y_d_full' size error\n Y_d_full.rows() = " << spec.Y_d_full.rows() 
+        << ", needs to be = (n_steps + N) * n_y, with N > 0\n";
+    throw std::runtime_error(msg.str());
+  }
+  if (spec.u_lower_bound.rows() != 0 && 
+      ((uint32_t)spec.u_lower_bound.rows() != n_u || (uint32_t)spec.u_upper_bound.rows() != n_u)) 
+  {
+    msg << "MonteCarloHarness: 'u_lower_bound' and 'u_upper_bound' need to be empty or of size " << n_u << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  if (spec.x_lower_bound.rows() != 0 && 
+      ((uint32_t)spec.x_lower_bound.rows() != n_x || (uint32_t)spec.x_upper_bound.rows() != n_x)) 
+  {
+    msg << "MonteCarloHarness: 'x_lower_bound' and 'x_upper_bound' need to be empty or of size " << n_x << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+LinMpcEigen::MonteCarloStatistics LinMpcEigen::MonteCarloHarness::run(const ScenarioSpec &spec) const
+{
+  // Y_d_full holds the references of n_steps closed-loop steps plus one horizon
+  uint32_t n_y = nominal_system_.n_y;
+  uint32_t horizon = spec.Y_d_full.rows() / n_y > spec.n_steps ? spec.Y_d_full.rows() / n_y - spec.n_steps : 0;
+  checkSpecDimensions(spec, horizon);
+  VecNd Y_d_initial = spec.Y_d_full.segment(0, horizon * n_y);
+
+  ThreadPool thread_pool(spec.n_threads);
+  std::vector< std::unique_ptr<MPC> > worker_mpcs(thread_pool.size());
+
+  MonteCarloStatistics stats;
+  stats.scenarios.resize(spec.n_scenarios);
+
+  thread_pool.parallelFor(spec.n_scenarios, [&](uint32_t i, uint32_t worker_id)
+  {
+    // every scenario starts from the solver of a new MPC, the warm start and rho of the previous 
+    // scenario of this worker are dropped
+    if (!worker_mpcs[worker_id]) 
+      worker_mpcs[worker_id] = mpc_factory_(nominal_system_, Y_d_initial, spec.x0);
+    else
+    {
+      worker_mpcs[worker_id]->setYd(Y_d_initial);
+      worker_mpcs[worker_id]->setX0(spec.x0);
+    }
+    worker_mpcs[worker_id]->initializeSolver();
+    stats.scenarios[i] = runScenario(i, spec, *worker_mpcs[worker_id]);
+  });
+
+  std::vector<double> solve_times;
+  double rmse_sum = 0.0;
+  for (const auto &scenario : stats.scenarios) 
+  {
+    rmse_sum += scenario.tracking_rmse;
+    stats.tracking_rmse_max = std::max(stats.tracking_rmse_max, scenario.tracking_rmse);
+    stats.tracking_max_error = std::max(stats.tracking_max_error, scenario.tracking_max_error);
+    if (scenario.n_constraint_violations > 0) 
+      stats.n_violating_scenarios++;
+    stats.n_constraint_violations += scenario.n_constraint_violations;
+    stats.max_constraint_violation = std::max(stats.max_constraint_violation, scenario.max_constraint_violation);
+    stats.n_solver_failures += scenario.n_solver_failures;
+    solve_times.insert(solve_times.end(), scenario.solve_times.begin(), scenario.solve_times.end());
+  }
+  if (spec.n_scenarios > 0) 
+    stats.tracking_rmse_mean = rmse_sum / spec.n_scenarios;
+
+  std::sort(solve_times.begin(), solve_times.end());
+  stats.n_solves = solve_times.size();
+  if (!solve_times.empty()) 
+  {
+    double time_sum = 0.0;
+    for (double t : solve_times) 
+      time_sum += t;
+    stats.solve_time_mean = time_sum / solve_times.size();
+    stats.solve_time_p50 = percentile(solve_times, 0.5);
+    stats.solve_time_p99 = percentile(solve_times, 0.99);
+    stats.solve_time_max = solve_times.back();
+  }
+  return stats;
+}
+
+LinMpcEigen::ScenarioResult LinMpcEigen::MonteCarloHarness::runScenario(uint32_t scenario_index, 
+                                                                         const ScenarioSpec &spec, 
+                                                                         MPC &mpc) const
+{
+  std::seed_seq seed_seq{ (uint32_t)spec.seed, (uint32_t)(spec.seed >> 32), scenario_index };
+  std::mt19937_64 rng(seed_seq);
+
+  uint32_t n_x = nominal_system_.n_x;
+  uint32_t n_u = nominal_system_.n_u;
+  uint32_t n_y = nominal_system_.n_y;
+  uint32_t horizon = mpc.getHorizon();
+
+  SparseMat A = perturbMatrix(nominal_system_.A, perturbation_.A_relative_std, rng);
+  SparseMat B = perturbMatrix(nominal_system_.B, perturbation_.B_relative_std, rng);
+
+  ScenarioResult result;
+  result.solve_times.reserve(spec.n_steps);
+
+  VecNd x = spec.x0;
+  double squared_error_sum = 0.0;
+  for (uint32_t k = 0; k < spec.n_steps; k++) 
+  {
+    VecNd Y_d = spec.Y_d_full.segment(k * n_y, horizon * n_y);
+    VecNd x_measured = x + sampleNoise(perturbation_.measurement_noise_std, n_x, rng);
+
+    const auto start = std::chrono::steady_clock::now();
+    mpc.updateSolver(Y_d, x_measured);
+    VecNd U = mpc.solve();
+    const auto end = std::chrono::steady_clock::now();
+    result.solve_times.push_back(std::chrono::duration<double>(end - start).count());
+
+    if (mpc.getSolverStatus() != OSQP_SOLVED) 
+      result.n_solver_failures++;
+
+    VecNd u = U.segment(0, n_u);
+    x = A * x + B * u + sampleNoise(perturbation_.process_noise_std, n_x, rng);
+
+    // Y_d(k) is the reference for y(k+1)
+    VecNd error = nominal_system_.C * x - Y_d.segment(0, n_y);
+    squared_error_sum += error.squaredNorm();
+    result.tracking_max_error = std::max(result.tracking_max_error, error.lpNorm<Eigen::Infinity>());
+
+    double violation = std::max( boundViolation(u, spec.u_lower_bound, spec.u_upper_bound),
+                                 boundViolation(x, spec.x_lower_bound, spec.x_upper_bound) );
+    if (violation > spec.violation_tolerance) 
+    {
+      result.n_constraint_violations++;
+      result.max_constraint_violation = std::max(result.max_constraint_violation, violation);
+    }
+  }
+  if (spec.n_steps > 0) 
+    result.tracking_rmse = std::sqrt(squared_error_sum / (spec.n_steps * n_y));
+  return result;
+}
+
+std::ostream& LinMpcEigen::operator<< (std::ostream& stream, const MonteCarloStatistics& stats)
+{
+  stream << "Monte Carlo statistics (" << stats.scenarios.size() << " scenarios):\n";
+  stream << "  tracking rmse: mean = " << stats.tracking_rmse_mean 
+         << ", max = " << stats.tracking_rmse_max << "\n";
+  stream << "  tracking max error = " << stats.tracking_max_error << "\n";
+  stream << "  constraint violations: " << stats.n_constraint_violations 
+         << " in " << stats.n_violating_scenarios << " scenarios, max = " 
+         << stats.max_constraint_violation << "\n";
+  stream << "  solver failures: " << stats.n_solver_failures << " / " << stats.n_solves << "\n";
+  stream << "  solve time [s]: mean = " << stats.solve_time_mean << ", p50 = " << stats.solve_time_p50 
+         << ", p99 = " << stats.solve_time_p99 << ", max = " << stats.solve_time_max << "\n";
+  return stream;
+}
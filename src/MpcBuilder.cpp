@@ -0,0 +1,343 @@
+/**
+ * @file MpcBuilder.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "MpcBuilder.hpp"
+
+#include <cmath>
+
+namespace {
+
+SparseMat blockDiagonal(const SparseMat &block, uint32_t n_blocks) 
+{
+  SparseMat output(block.rows() * n_blocks, block.cols() * n_blocks);
+  output.reserve(block.nonZeros() * n_blocks);
+  for (uint32_t i = 0; i < n_blocks; i++) 
+    LinMpcEigen::setSparseBlock(output, block, block.rows() * i, block.cols() * i);
+  return output;
+}
+
+SparseMat stackMatrices(const std::vector<SparseMat> &matrices, uint32_t cols) 
+{
+  SparseMat output(0, cols);
+  for (const auto &matrix : matrices) 
+    output = LinMpcEigen::cocatenateMatrices(output, matrix);
+  return output;
+}
+
+} // namespace
+
+// -------------- ComposedMPC -----------------
+LinMpcEigen::ComposedMPC::ComposedMPC(const LinearSystem &linear_system, uint32_t horizon) 
+  : linear_system_(linear_system), N_(horizon)
+{
+}
+
+void LinMpcEigen::ComposedMPC::updateSolver(const VecNd &Y_d, const VecNd &x0, const VecNd &u_prev) 
+{
+  checkParameterDimensions(Y_d, x0, u_prev);
+  x0_ = x0;
+  qp_problem_->b_qp = parameterGradient(Y_d, x0, u_prev);
+  if (update_plan_.constraints_x0) 
+  {
+    qp_problem_->b_ieq = constraint_x0_map_ * x0 + constraint_offset_;
+    osqp_eigen_opt_->updateGradientAndIeqConstraint(qp_problem_->b_qp, qp_problem_->b_ieq);
+  }
+  else
+    osqp_eigen_opt_->updateGradient(qp_problem_->b_qp);
+}
+
+// evaluates only the gradient maps listed in the update plan
+VecNd LinMpcEigen::ComposedMPC::parameterGradient(const VecNd &Y_d, const VecNd &x0, const VecNd &u_prev) const 
+{
+  VecNd b_qp = VecNd::Zero(N_ * linear_system_.n_u);
+  if (update_plan_.gradient_x0) 
+    b_qp += gradient_x0_map_ * x0;
+  if (update_plan_.gradient_Y_d) 
+    b_qp += gradient_Y_d_map_ * Y_d;
+  if (update_plan_.gradient_u_prev && u_prev.rows() > 0) 
+    b_qp += gradient_u_prev_map_ * u_prev;
+  return b_qp;
+}
+
+VecNd LinMpcEigen::ComposedMPC::solve() const 
+{
+  return osqp_eigen_opt_->solveProblem();
+}
+
+int LinMpcEigen::ComposedMPC::getSolverStatus() const 
+{
+  return osqp_eigen_opt_->getStatus();
+}
+
+VecNd LinMpcEigen::ComposedMPC::calculateX(const VecNd &U_in) const 
+{
+  return rolloutStates(linear_system_, U_in, x0_);
+}
+
+VecNd LinMpcEigen::ComposedMPC::calculateY(const VecNd &U_in) const 
+{
+  return outputSequence(linear_system_, calculateX(U_in));
+}
+
+const SparseQpProblem &LinMpcEigen::ComposedMPC::getQpProblem() const 
+{
+  return *qp_problem_;
+}
+
+const LinMpcEigen::MpcUpdatePlan &LinMpcEigen::ComposedMPC::getUpdatePlan() const 
+{
+  return update_plan_;
+}
+
+void LinMpcEigen::ComposedMPC::checkParameterDimensions(const VecNd &Y_d, const VecNd &x0, const VecNd &u_prev) const 
+{
+  std::ostringstream msg;
+  if ((uint32_t)Y_d.rows() != N_ * linear_system_.n_y) 
+  {
+    msg << "ComposedMPC: Vector 'Y_d' size error\n Y_d.rows() = " << Y_d.rows() 
+        << ", needs to be = " << N_ * linear_system_.n_y << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  if ((uint32_t)x0.rows() != linear_system_.n_x) 
+  {
+    msg << "ComposedMPC: Vector 'x0' size error\n x0.rows() = " << x0.rows() 
+        << ", needs to be = " << linear_system_.n_x << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  if (u_prev.rows() > 0 && (uint32_t)u_prev.rows() != linear_system_.n_u) 
+  {
+    msg << "ComposedMPC: Vector 'u_prev' size error\n u_prev.rows() = " << u_prev.rows() 
+        << ", needs to be = " << linear_system_.n_u << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+// -------------- MpcBuilder -----------------
+LinMpcEigen::MpcBuilder::MpcBuilder(const LinearSystem &linear_system, uint32_t horizon) 
+  : linear_system_(linear_system), N_(horizon),
+  A_mpc_(SparseMat(N_ * linear_system_.n_x, N_ * linear_system_.n_u)),
+  B_mpc_(SparseMat(N_ * linear_system_.n_x, linear_system_.n_x)),
+  C_mpc_(SparseMat(N_ * linear_system_.n_y, N_ * linear_system_.n_x))
+{
+  if (N_ == 0) 
+    throw std::runtime_error("MpcBuilder: horizon needs to be > 0");
+  setupPredictionMatrices(linear_system_, N_, A_mpc_, B_mpc_, C_mpc_);
+}
+
+// parameters p = [x0; Y_d; u_prev]
+uint32_t LinMpcEigen::MpcBuilder::numberOfParameters() const 
+{
+  return linear_system_.n_x + N_ * linear_system_.n_y + linear_system_.n_u;
+}
+
+void LinMpcEigen::MpcBuilder::checkWeight(const SparseMat &weight, uint32_t cols, const char *name) const 
+{
+  std::ostringstream msg;
+  if ((uint32_t)weight.cols() != cols) 
+  {
+    msg << "MpcBuilder: Matrix '" << name << "' size error\n " << name << ".cols() = " << weight.cols() 
+        << ", needs to be = " << cols << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+// r = W_y * (C_mpc * (A_mpc * U + B_mpc * x0) - Y_d)
+LinMpcEigen::MpcBuilder &LinMpcEigen::MpcBuilder::addOutputTracking(const SparseMat &w_y) 
+{
+  checkWeight(w_y, linear_system_.n_y, "w_y");
+  SparseMat W_y = blockDiagonal(w_y, N_);
+  SparseMat T(W_y.rows(), numberOfParameters());
+  setSparseBlock(T, SparseMat(W_y * applyOutputMatrix(linear_system_, N_, B_mpc_)), 0, 0);
+  setSparseBlock(T, SparseMat(-W_y), 0, linear_system_.n_x);
+
+  residual_S_.push_back(W_y * applyOutputMatrix(linear_system_, N_, A_mpc_));
+  residual_T_.push_back(T);
+  return *this;
+}
+
+// r = W_u * U
+LinMpcEigen::MpcBuilder &LinMpcEigen::MpcBuilder::addInputEffort(const SparseMat &w_u) 
+{
+  checkWeight(w_u, linear_system_.n_u, "w_u");
+  SparseMat W_u = blockDiagonal(w_u, N_);
+  residual_S_.push_back(W_u);
+  residual_T_.push_back(SparseMat(W_u.rows(), numberOfParameters()));
+  return *this;
+}
+
+// r = W_x * (A_mpc * U + B_mpc * x0)
+LinMpcEigen::MpcBuilder &LinMpcEigen::MpcBuilder::addStatePenalty(const SparseMat &w_x) 
+{
+  checkWeight(w_x, linear_system_.n_x, "w_x");
+  SparseMat W_x = blockDiagonal(w_x, N_);
+  SparseMat T(W_x.rows(), numberOfParameters());
+  setSparseBlock(T, SparseMat(W_x * B_mpc_), 0, 0);
+
+  residual_S_.push_back(W_x * A_mpc_);
+  residual_T_.push_back(T);
+  return *this;
+}
+
+// r = W_du * (Delta * U - E_0 * u_prev), Delta - block difference matrix, E_0 selects the first block
+LinMpcEigen::MpcBuilder &LinMpcEigen::MpcBuilder::addInputRatePenalty(const SparseMat &w_du) 
+{
+  uint32_t n_u = linear_system_.n_u;
+  checkWeight(w_du, n_u, "w_du");
+  SparseMat W_du = blockDiagonal(w_du, N_);
+
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (uint32_t i = 0; i < N_ * n_u; i++) 
+  {
+    triplets.emplace_back(i, i, 1.0);
+    if (i >= n_u) 
+      triplets.emplace_back(i, i - n_u, -1.0);
+  }
+  SparseMat Delta(N_ * n_u, N_ * n_u);
+  Delta.setFromTriplets(triplets.begin(), triplets.end());
+
+  SparseMat T(W_du.rows(), numberOfParameters());
+  setSparseBlock(T, SparseMat(-w_du), 0, linear_system_.n_x + N_ * linear_system_.n_y);
+
+  residual_S_.push_back(W_du * Delta);
+  residual_T_.push_back(T);
+  return *this;
+}
+
+LinMpcEigen::MpcBuilder &LinMpcEigen::MpcBuilder::addInputBounds(const VecNd &u_lower_bound, const VecNd &u_upper_bound) 
+{
+  if ((uint32_t)u_lower_bound.rows() != linear_system_.n_u || (uint32_t)u_upper_bound.rows() != linear_system_.n_u) 
+    throw std::runtime_error("MpcBuilder: input bounds need to be of size n_u");
+  VecNd lower_bound = u_lower_bound.colwise().replicate(N_);
+  VecNd upper_bound = u_upper_bound.colwise().replicate(N_);
+  // repeated bounds are intersected
+  if (u_lower_bound_.rows() > 0) 
+  {
+    lower_bound = lower_bound.cwiseMax(u_lower_bound_);
+    upper_bound = upper_bound.cwiseMin(u_upper_bound_);
+  }
+  u_lower_bound_ = lower_bound;
+  u_upper_bound_ = upper_bound;
+  return *this;
+}
+
+// A_mpc * U + B_mpc * x0 - x_ub <= 0,  -A_mpc * U - B_mpc * x0 + x_lb <= 0
+LinMpcEigen::MpcBuilder &LinMpcEigen::MpcBuilder::addStateBounds(const VecNd &x_lower_bound, const VecNd &x_upper_bound) 
+{
+  uint32_t n_x = linear_system_.n_x;
+  if ((uint32_t)x_lower_bound.rows() != n_x || (uint32_t)x_upper_bound.rows() != n_x) 
+    throw std::runtime_error("MpcBuilder: state bounds need to be of size n_x");
+
+  std::vector<uint32_t> upper_rows, lower_rows;
+  for (uint32_t k = 0; k < N_; k++) 
+    for (uint32_t i = 0; i < n_x; i++) 
+    {
+      if (!std::isinf(x_upper_bound(i))) 
+        upper_rows.push_back(k * n_x + i);
+      if (!std::isinf(x_lower_bound(i))) 
+        lower_rows.push_back(k * n_x + i);
+    }
+
+  // signed selection of the bounded rows of X = A_mpc * U + B_mpc * x0, keeps A_ieq and H sparse
+  uint32_t n_rows = upper_rows.size() + lower_rows.size();
+  SparseMat selection(n_rows, A_mpc_.rows());
+  std::vector<Eigen::Triplet<double>> triplets;
+  VecNd h(n_rows);
+  uint32_t row = 0;
+  for (uint32_t i : upper_rows) 
+  {
+    triplets.emplace_back(row, i, 1.0);
+    h(row++) = -x_upper_bound(i % n_x);
+  }
+  for (uint32_t i : lower_rows) 
+  {
+    triplets.emplace_back(row, i, -1.0);
+    h(row++) = x_lower_bound(i % n_x);
+  }
+  selection.setFromTriplets(triplets.begin(), triplets.end());
+  SparseMat A_ieq = selection * A_mpc_;
+  SparseMat H = selection * B_mpc_;
+  constraint_A_.push_back(A_ieq);
+  constraint_H_.push_back(H);
+  constraint_h_.push_back(h);
+  return *this;
+}
+
+LinMpcEigen::MpcBuilder &LinMpcEigen::MpcBuilder::addInputConstraint(const SparseMat &G, const VecNd &h) 
+{
+  checkWeight(G, N_ * linear_system_.n_u, "G");
+  if (G.rows() != h.rows()) 
+    throw std::runtime_error("MpcBuilder: G and h need to have the same number of rows");
+  constraint_A_.push_back(G);
+  constraint_H_.push_back(SparseMat(G.rows(), linear_system_.n_x));
+  constraint_h_.push_back(h);
+  return *this;
+}
+
+LinMpcEigen::MpcBuilder &LinMpcEigen::MpcBuilder::setSolverSettings(const OsqpSettings &solver_settings, 
+                                                                    double solver_time_limit) 
+{
+  solver_settings_ = solver_settings;
+  solver_time_limit_ = solver_time_limit;
+  return *this;
+}
+
+std::unique_ptr<LinMpcEigen::ComposedMPC> LinMpcEigen::MpcBuilder::build(const VecNd &Y_d, const VecNd &x0, 
+                                                                        const VecNd &u_prev) const 
+{
+  if (residual_S_.empty()) 
+    throw std::runtime_error("MpcBuilder: no cost terms declared");
+
+  uint32_t n_var = N_ * linear_system_.n_u;
+  uint32_t n_x = linear_system_.n_x;
+  std::unique_ptr<ComposedMPC> mpc(new ComposedMPC(linear_system_, N_));
+  mpc->checkParameterDimensions(Y_d, x0, u_prev);
+  mpc->x0_ = x0;
+  mpc->A_mpc_ = A_mpc_;
+  mpc->B_mpc_ = B_mpc_;
+  mpc->C_mpc_ = C_mpc_;
+
+  // fused cost assembly
+  SparseMat S = stackMatrices(residual_S_, n_var);
+  SparseMat T = stackMatrices(residual_T_, numberOfParameters());
+  SparseMat S_T = S.transpose();
+  SparseMat A_qp = S_T * S;
+  SparseMat gradient_map = S_T * T;
+  gradient_map.prune(0.0);
+
+  mpc->gradient_x0_map_ = gradient_map.leftCols(n_x);
+  mpc->gradient_Y_d_map_ = gradient_map.middleCols(n_x, N_ * linear_system_.n_y);
+  mpc->gradient_u_prev_map_ = gradient_map.rightCols(linear_system_.n_u);
+
+  // constraints
+  SparseMat A_ieq = stackMatrices(constraint_A_, n_var);
+  mpc->constraint_x0_map_ = stackMatrices(constraint_H_, n_x);
+  mpc->constraint_x0_map_.prune(0.0);
+  mpc->constraint_offset_ = VecNd(A_ieq.rows());
+  uint32_t row = 0;
+  for (const auto &h : constraint_h_) 
+  {
+    mpc->constraint_offset_.segment(row, h.rows()) = h;
+    row += h.rows();
+  }
+
+  MpcUpdatePlan &plan = mpc->update_plan_;
+  plan.gradient_x0 = mpc->gradient_x0_map_.nonZeros() > 0;
+  plan.gradient_Y_d = mpc->gradient_Y_d_map_.nonZeros() > 0;
+  plan.gradient_u_prev = mpc->gradient_u_prev_map_.nonZeros() > 0;
+  plan.constraints_x0 = mpc->constraint_x0_map_.nonZeros() > 0;
+
+  VecNd b_qp = mpc->parameterGradient(Y_d, x0, u_prev);
+  VecNd b_ieq = mpc->constraint_x0_map_ * x0 + mpc->constraint_offset_;
+  SparseMat A_eq(0, n_var);
+  VecNd b_eq = VecNd::Zero(0);
+  if (u_lower_bound_.rows() > 0) 
+    mpc->qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq, 
+                                                         u_lower_bound_, u_upper_bound_);
+  else
+    mpc->qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq);
+
+  mpc->osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(*mpc->qp_problem_, solver_time_limit_, solver_settings_);
+  return mpc;
+}
@@ -0,0 +1,614 @@
+/**
+ * @file MpcService.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "MpcService.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+const char service_magic[4] = {'L', 'M', 'S', 'V'};
+const uint32_t service_version = 2;
+const size_t cache_line = 64;
+const size_t max_name_length = 63;
+
+enum SlotState : uint32_t { FREE = 0, CLAIMED, PENDING, SOLVING, DONE };
+
+// shared memory layout:
+//   ServiceHeader
+//   ControllerDescriptor[n_controllers]
+//   per controller: slots_per_controller * (SlotHeader, x0[n_x], Y_d[n_Y], U[n_U])
+struct alignas(64) ServiceHeader {
+  char magic[4];
+  uint32_t version;
+  std::atomic<uint32_t> running;
+  int32_t service_pid;
+  uint32_t n_controllers;
+  uint32_t slots_per_controller;
+};
+
+struct alignas(64) ControllerDescriptor {
+  char name[max_name_length + 1];
+  uint32_t n_x, n_Y, n_U;
+  std::atomic<uint32_t> doorbell; // incremented by every submit, futex of the serving thread
+  std::atomic<uint64_t> served;
+  uint64_t slots_offset;
+  uint64_t slot_stride;
+};
+
+struct alignas(64) SlotHeader {
+  std::atomic<uint32_t> state; // futex of the waiting client
+  int32_t status;
+  std::atomic<int32_t> owner; // pid of the claiming client, 0 while free or being released
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "MpcService: shared memory atomics need to be lock-free");
+
+size_t alignUp(size_t size)
+{
+  return (size + cache_line - 1) / cache_line * cache_line;
+}
+
+ServiceHeader *serviceHeader(char *segment)
+{
+  return reinterpret_cast<ServiceHeader *>(segment);
+}
+
+ControllerDescriptor *controllerDescriptor(char *segment, uint32_t controller_id)
+{
+  return reinterpret_cast<ControllerDescriptor *>(segment + sizeof(ServiceHeader)) + controller_id;
+}
+
+SlotHeader *slotHeader(char *segment, const ControllerDescriptor *descriptor, uint32_t slot)
+{
+  return reinterpret_cast<SlotHeader *>(segment + descriptor->slots_offset + slot * descriptor->slot_stride);
+}
+
+double *slotData(SlotHeader *slot)
+{
+  return reinterpret_cast<double *>(slot + 1); // x0, Y_d, U
+}
+
+// process-shared futex (no FUTEX_PRIVATE_FLAG), sleeps while *word == expected, at most timeout [s]
+void futexWait(std::atomic<uint32_t> *word, uint32_t expected, double timeout)
+{
+#ifdef __linux__
+  timespec time_spec;
+  time_spec.tv_sec = (time_t)timeout;
+  time_spec.tv_nsec = (long)((timeout - time_spec.tv_sec) * 1e9);
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected, &time_spec, nullptr, 0);
+#else
+  if (word->load(std::memory_order_acquire) == expected)
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+#endif
+}
+
+// EPERM: the process exists, but belongs to another user
+bool processAlive(int32_t pid)
+{
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+void futexWakeAll(std::atomic<uint32_t> *word)
+{
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+char *mapSegment(int fd, size_t size, const std::string &shm_name)
+{
+  void *segment = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (segment == MAP_FAILED)
+  {
+    std::ostringstream msg;
+    msg << "MpcService: mmap " << shm_name << " failed: " << std::strerror(errno);
+    close(fd);
+    throw std::runtime_error(msg.str());
+  }
+  close(fd);
+  return static_cast<char *>(segment);
+}
+
+} // namespace
+
+// -------------- MpcService -----------------
+
+LinMpcEigen::MpcService::MpcService(const std::string &shm_name, uint32_t slots_per_controller)
+  : shm_name_(shm_name), slots_per_controller_(slots_per_controller)
+{
+  if (shm_name_.size() < 2 || shm_name_[0] != '/' || shm_name_.find('/', 1) != std::string::npos)
+    throw std::runtime_error("MpcService: shm_name needs to be of the form \"/name\"");
+  if (slots_per_controller_ == 0)
+    throw std::runtime_error("MpcService: slots_per_controller needs to be > 0");
+}
+
+LinMpcEigen::MpcService::~MpcService()
+{
+  stop();
+  if (segment_)
+  {
+    munmap(segment_, segment_size_);
+    shm_unlink(shm_name_.c_str());
+  }
+}
+
+uint32_t LinMpcEigen::MpcService::addController(const std::string &name, std::unique_ptr<MPC> mpc,
+                                                const std::vector<int> &cpu_cores)
+{
+  if (segment_)
+    throw std::runtime_error("MpcService: addController() after start()");
+  if (!mpc)
+    throw std::runtime_error("MpcService: mpc is null");
+  if (name.empty() || name.size() > max_name_length)
+  {
+    std::ostringstream msg;
+    msg << "MpcService: controller name needs 1 to " << max_name_length << " characters";
+    throw std::runtime_error(msg.str());
+  }
+  for (const auto &controller : controllers_)
+    if (controller.name == name)
+      throw std::runtime_error("MpcService: controller " + name + " already added");
+
+  Controller controller;
+  controller.name = name;
+  controller.cpu_cores = cpu_cores;
+  const LinearSystem &linear_system = mpc->getLinearSystem();
+  controller.x0 = VecNd::Zero(linear_system.n_x);
+  controller.Y_d = VecNd::Zero(mpc->getHorizon() * linear_system.n_y);
+  controller.mpc = std::move(mpc);
+  controllers_.push_back(std::move(controller));
+  return controllers_.size() - 1;
+}
+
+void LinMpcEigen::MpcService::setRealTimeSettings(const RealTimeSettings &settings)
+{
+  if (isRunning())
+    throw std::runtime_error("MpcService: setRealTimeSettings() while the service is running");
+  real_time_ = true;
+  real_time_settings_ = settings;
+}
+
+void LinMpcEigen::MpcService::start()
+{
+  if (isRunning())
+    throw std::runtime_error("MpcService: already running");
+  if (controllers_.empty())
+    throw std::runtime_error("MpcService: no controllers");
+
+  if (!segment_)
+  {
+    // layout
+    size_t descriptors_size = controllers_.size() * sizeof(ControllerDescriptor);
+    size_t size = sizeof(ServiceHeader) + descriptors_size;
+    std::vector<size_t> slot_strides;
+    for (const auto &controller : controllers_)
+    {
+      size_t n_values = controller.x0.size() + controller.Y_d.size() +
+                        controller.mpc->getHorizon() * controller.mpc->getLinearSystem().n_u;
+      slot_strides.push_back(alignUp(sizeof(SlotHeader) + n_values * sizeof(double)));
+      size += slots_per_controller_ * slot_strides.back();
+    }
+
+    // a segment left behind by a crashed service is replaced
+    shm_unlink(shm_name_.c_str());
+    int fd = shm_open(shm_name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0 || ftruncate(fd, size) != 0)
+    {
+      std::ostringstream msg;
+      msg << "MpcService: cannot create " << shm_name_ << ": " << std::strerror(errno);
+      if (fd >= 0)
+      {
+        close(fd);
+        shm_unlink(shm_name_.c_str());
+      }
+      throw std::runtime_error(msg.str());
+    }
+    segment_ = mapSegment(fd, size, shm_name_);
+    segment_size_ = size;
+
+    ServiceHeader *header = new (segment_) ServiceHeader;
+    header->version = service_version;
+    header->running.store(0);
+    header->service_pid = getpid();
+    header->n_controllers = controllers_.size();
+    header->slots_per_controller = slots_per_controller_;
+    size_t slots_offset = sizeof(ServiceHeader) + descriptors_size;
+    for (uint32_t i = 0; i < controllers_.size(); i++)
+    {
+      const Controller &controller = controllers_[i];
+      ControllerDescriptor *descriptor = new (controllerDescriptor(segment_, i)) ControllerDescriptor;
+      std::memset(descriptor->name, 0, sizeof(descriptor->name));
+      std::memcpy(descriptor->name, controller.name.data(), controller.name.size());
+      descriptor->n_x = controller.x0.size();
+      descriptor->n_Y = controller.Y_d.size();
+      descriptor->n_U = controller.mpc->getHorizon() * controller.mpc->getLinearSystem().n_u;
+      descriptor->doorbell.store(0);
+      descriptor->served.store(0);
+      descriptor->slots_offset = slots_offset;
+      descriptor->slot_stride = slot_strides[i];
+      for (uint32_t slot = 0; slot < slots_per_controller_; slot++)
+      {
+        SlotHeader *slot_header = new (slotHeader(segment_, descriptor, slot)) SlotHeader;
+        slot_header->state.store(FREE);
+        slot_header->status = 0;
+        slot_header->owner.store(0);
+      }
+      slots_offset += slots_per_controller_ * slot_strides[i];
+    }
+    // clients accept the segment only after the magic is written
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, service_magic, sizeof(service_magic));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    real_time_report_ = RealTimeReport();
+  }
+  if (real_time_)
+  {
+    std::vector<MPC *> mpcs;
+    for (auto &controller : controllers_)
+      mpcs.push_back(controller.mpc.get());
+    RealTimeReport report = enableRealTimeMode(mpcs, real_time_settings_);
+    report.prefaulted_bytes += prefaultMemory(segment_, segment_size_);
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    real_time_report_.merge(report);
+  }
+
+  running_ = true;
+  serviceHeader(segment_)->running.store(1, std::memory_order_release);
+  for (uint32_t i = 0; i < controllers_.size(); i++)
+    controllers_[i].thread = std::thread(&MpcService::serveLoop, this, i);
+}
+
+void LinMpcEigen::MpcService::stop()
+{
+  if (!running_.exchange(false))
+    return;
+  serviceHeader(segment_)->running.store(0, std::memory_order_release);
+  for (uint32_t i = 0; i < controllers_.size(); i++)
+  {
+    ControllerDescriptor *descriptor = controllerDescriptor(segment_, i);
+    descriptor->doorbell.fetch_add(1, std::memory_order_release);
+    futexWakeAll(&descriptor->doorbell);
+  }
+  for (auto &controller : controllers_)
+    controller.thread.join();
+  // clients waiting on a request see that the service stopped
+  for (uint32_t i = 0; i < controllers_.size(); i++)
+  {
+    ControllerDescriptor *descriptor = controllerDescriptor(segment_, i);
+    for (uint32_t slot = 0; slot < slots_per_controller_; slot++)
+      futexWakeAll(&slotHeader(segment_, descriptor, slot)->state);
+  }
+}
+
+bool LinMpcEigen::MpcService::isRunning() const
+{
+  return running_;
+}
+
+uint32_t LinMpcEigen::MpcService::getNumControllers() const
+{
+  return controllers_.size();
+}
+
+uint64_t LinMpcEigen::MpcService::getServedRequests(uint32_t controller_id) const
+{
+  checkId(controller_id);
+  if (!segment_)
+    return 0;
+  return controllerDescriptor(segment_, controller_id)->served.load(std::memory_order_relaxed);
+}
+
+LinMpcEigen::RealTimeReport LinMpcEigen::MpcService::getRealTimeReport() const
+{
+  std::lock_guard<std::mutex> lock(report_mutex_);
+  return real_time_report_;
+}
+
+const LinMpcEigen::MPC &LinMpcEigen::MpcService::getController(uint32_t controller_id) const
+{
+  checkId(controller_id);
+  if (isRunning())
+    throw std::runtime_error("MpcService: getController() while the service is running");
+  return *controllers_[controller_id].mpc;
+}
+
+void LinMpcEigen::MpcService::serveLoop(uint32_t controller_id)
+{
+  Controller &controller = controllers_[controller_id];
+  std::vector<int> cpu_cores = controller.cpu_cores.empty() ? real_time_settings_.cpu_cores : controller.cpu_cores;
+  if (real_time_ || !controller.cpu_cores.empty())
+  {
+    RealTimeReport report;
+    if (real_time_)
+      configureServingThread(real_time_settings_, real_time_settings_.priority, cpu_cores, report);
+    else
+      configureCurrentThread(0, cpu_cores, report);
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    real_time_report_.merge(report);
+  }
+
+  ControllerDescriptor *descriptor = controllerDescriptor(segment_, controller_id);
+  auto next_reclaim = std::chrono::steady_clock::now();
+  while (running_.load(std::memory_order_acquire))
+  {
+    uint32_t doorbell = descriptor->doorbell.load(std::memory_order_acquire);
+    bool served = false;
+    for (uint32_t slot = 0; slot < slots_per_controller_; slot++)
+    {
+      SlotHeader *slot_header = slotHeader(segment_, descriptor, slot);
+      uint32_t state = PENDING;
+      if (!slot_header->state.compare_exchange_strong(state, SOLVING, std::memory_order_acq_rel))
+        continue;
+
+      double *data = slotData(slot_header);
+      controller.x0 = Eigen::Map<const VecNd>(data, descriptor->n_x);
+      controller.Y_d = Eigen::Map<const VecNd>(data + descriptor->n_x, descriptor->n_Y);
+      try
+      {
+        controller.mpc->updateSolver(controller.Y_d, controller.x0);
+        VecNd U = controller.mpc->solve();
+        std::copy(U.data(), U.data() + descriptor->n_U, data + descriptor->n_x + descriptor->n_Y);
+        slot_header->status = controller.mpc->getSolverStatus();
+      }
+      catch (const std::exception &)
+      {
+        slot_header->status = MPC_SERVICE_ERROR;
+      }
+      slot_header->state.store(DONE, std::memory_order_release);
+      futexWakeAll(&slot_header->state);
+      descriptor->served.fetch_add(1, std::memory_order_relaxed);
+      served = true;
+    }
+    if (!served && std::chrono::steady_clock::now() >= next_reclaim)
+    {
+      reclaimAbandonedSlots(controller_id);
+      next_reclaim = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    }
+    // a submit after the doorbell was read changes it, so the wait returns at once
+    if (!served)
+      futexWait(&descriptor->doorbell, doorbell, 0.1);
+  }
+}
+
+void LinMpcEigen::MpcService::reclaimAbandonedSlots(uint32_t controller_id)
+{
+  ControllerDescriptor *descriptor = controllerDescriptor(segment_, controller_id);
+  for (uint32_t slot = 0; slot < slots_per_controller_; slot++)
+  {
+    SlotHeader *slot_header = slotHeader(segment_, descriptor, slot);
+    uint32_t state = slot_header->state.load(std::memory_order_acquire);
+    if (state != CLAIMED && state != DONE)
+      continue;
+    // a dead owner can't change the slot anymore, requests it submitted are served first
+    int32_t owner = slot_header->owner.load(std::memory_order_acquire);
+    if (owner == 0 || processAlive(owner))
+      continue;
+    slot_header->owner.store(0, std::memory_order_relaxed);
+    slot_header->state.compare_exchange_strong(state, FREE, std::memory_order_acq_rel);
+  }
+}
+
+void LinMpcEigen::MpcService::checkId(uint32_t controller_id) const
+{
+  if (controller_id >= controllers_.size())
+  {
+    std::ostringstream msg;
+    msg << "MpcService: controller_id = " << controller_id << ", needs to be < " << controllers_.size() << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+// -------------- MpcServiceClient -----------------
+
+LinMpcEigen::MpcServiceClient::MpcServiceClient(const std::string &shm_name)
+{
+  int fd = shm_open(shm_name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+  {
+    std::ostringstream msg;
+    msg << "MpcServiceClient: cannot open " << shm_name << ": " << std::strerror(errno);
+    throw std::runtime_error(msg.str());
+  }
+  struct stat segment_stat;
+  if (fstat(fd, &segment_stat) != 0 || (size_t)segment_stat.st_size < sizeof(ServiceHeader))
+  {
+    close(fd);
+    throw std::runtime_error("MpcServiceClient: " + shm_name + " is not an MPC service (yet)");
+  }
+  segment_size_ = segment_stat.st_size;
+  segment_ = mapSegment(fd, segment_size_, shm_name);
+
+  const ServiceHeader *header = serviceHeader(segment_);
+  bool valid = std::memcmp(header->magic, service_magic, sizeof(service_magic)) == 0;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (!valid || header->version != service_version || header->running.load(std::memory_order_acquire) == 0)
+  {
+    munmap(segment_, segment_size_);
+    std::ostringstream msg;
+    msg << "MpcServiceClient: " << shm_name << " is not a running MPC service of version " << service_version;
+    throw std::runtime_error(msg.str());
+  }
+}
+
+LinMpcEigen::MpcServiceClient::~MpcServiceClient()
+{
+  munmap(segment_, segment_size_);
+}
+
+uint32_t LinMpcEigen::MpcServiceClient::findController(const std::string &name) const
+{
+  for (uint32_t i = 0; i < getNumControllers(); i++)
+    if (name == controllerDescriptor(segment_, i)->name)
+      return i;
+  throw std::runtime_error("MpcServiceClient: unknown controller " + name);
+}
+
+uint32_t LinMpcEigen::MpcServiceClient::getNumControllers() const
+{
+  return serviceHeader(segment_)->n_controllers;
+}
+
+uint32_t LinMpcEigen::MpcServiceClient::getStateSize(uint32_t controller_id) const
+{
+  return static_cast<const ControllerDescriptor *>(descriptor(controller_id))->n_x;
+}
+
+uint32_t LinMpcEigen::MpcServiceClient::getReferenceSize(uint32_t controller_id) const
+{
+  return static_cast<const ControllerDescriptor *>(descriptor(controller_id))->n_Y;
+}
+
+uint32_t LinMpcEigen::MpcServiceClient::getSolutionSize(uint32_t controller_id) const
+{
+  return static_cast<const ControllerDescriptor *>(descriptor(controller_id))->n_U;
+}
+
+bool LinMpcEigen::MpcServiceClient::isServiceRunning() const
+{
+  // a crashed service leaves running set
+  const ServiceHeader *header = serviceHeader(segment_);
+  return header->running.load(std::memory_order_acquire) != 0 && processAlive(header->service_pid);
+}
+
+LinMpcEigen::MpcServiceRequest LinMpcEigen::MpcServiceClient::acquire(uint32_t controller_id)
+{
+  ControllerDescriptor *controller = const_cast<ControllerDescriptor *>(
+    static_cast<const ControllerDescriptor *>(descriptor(controller_id)));
+  MpcServiceRequest request;
+  for (uint32_t slot = 0; slot < serviceHeader(segment_)->slots_per_controller; slot++)
+  {
+    SlotHeader *slot_header = slotHeader(segment_, controller, slot);
+    uint32_t state = FREE;
+    if (!slot_header->state.compare_exchange_strong(state, CLAIMED, std::memory_order_acq_rel))
+      continue;
+    slot_header->owner.store(getpid(), std::memory_order_release);
+    double *data = slotData(slot_header);
+    request.state_ = &slot_header->state;
+    request.owner_ = &slot_header->owner;
+    request.status_ = &slot_header->status;
+    request.doorbell_ = &controller->doorbell;
+    request.x0_ = data;
+    request.Y_d_ = data + controller->n_x;
+    request.U_ = data + controller->n_x + controller->n_Y;
+    request.n_x_ = controller->n_x;
+    request.n_Y_ = controller->n_Y;
+    request.n_U_ = controller->n_U;
+    break;
+  }
+  return request;
+}
+
+void LinMpcEigen::MpcServiceClient::submit(MpcServiceRequest &request)
+{
+  if (!request.valid())
+    throw std::runtime_error("MpcServiceClient: submit() of an invalid request");
+  request.state_->store(PENDING, std::memory_order_release);
+  request.doorbell_->fetch_add(1, std::memory_order_release);
+  futexWakeAll(request.doorbell_);
+}
+
+bool LinMpcEigen::MpcServiceClient::wait(MpcServiceRequest &request, double timeout)
+{
+  if (!request.valid())
+    throw std::runtime_error("MpcServiceClient: wait() on an invalid request");
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+  while (true)
+  {
+    uint32_t state = request.state_->load(std::memory_order_acquire);
+    if (state == DONE)
+      return true;
+    if (state != PENDING && state != SOLVING)
+      return false; // not submitted
+    double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0.0 || !isServiceRunning())
+      return false;
+    // bounded, so a service that died without waking the client is noticed
+    futexWait(request.state_, state, std::min(remaining, 0.1));
+  }
+}
+
+int LinMpcEigen::MpcServiceClient::status(const MpcServiceRequest &request) const
+{
+  if (!request.valid())
+    throw std::runtime_error("MpcServiceClient: status() of an invalid request");
+  return *request.status_;
+}
+
+void LinMpcEigen::MpcServiceClient::release(MpcServiceRequest &request)
+{
+  if (!request.valid())
+    return;
+  // cleared before the slot is free, so a new owner is never overwritten
+  request.owner_->store(0, std::memory_order_release);
+  // a request that is being solved is released when the service is done with it
+  uint32_t state = request.state_->load(std::memory_order_acquire);
+  while (!(state != SOLVING && request.state_->compare_exchange_weak(state, FREE, std::memory_order_acq_rel)))
+  {
+    if (state == SOLVING)
+    {
+      futexWait(request.state_, SOLVING, 0.01);
+      state = request.state_->load(std::memory_order_acquire);
+    }
+  }
+  request = MpcServiceRequest();
+}
+
+VecNd LinMpcEigen::MpcServiceClient::solve(uint32_t controller_id, const VecNd &x0, const VecNd &Y_d, double timeout)
+{
+  MpcServiceRequest request = acquire(controller_id);
+  if (!request.valid())
+    throw std::runtime_error("MpcServiceClient: no free request slot");
+  if (x0.size() != request.n_x_ || Y_d.size() != request.n_Y_)
+  {
+    std::ostringstream msg;
+    msg << "MpcServiceClient: x0 and Y_d need the sizes " << request.n_x_ << " and " << request.n_Y_;
+    release(request);
+    throw std::runtime_error(msg.str());
+  }
+  request.x0() = x0;
+  request.Y_d() = Y_d;
+  submit(request);
+  if (!wait(request, timeout))
+  {
+    release(request);
+    throw std::runtime_error("MpcServiceClient: request timed out");
+  }
+  VecNd U = request.U();
+  release(request);
+  return U;
+}
+
+const void *LinMpcEigen::MpcServiceClient::descriptor(uint32_t controller_id) const
+{
+  if (controller_id >= getNumControllers())
+  {
+    std::ostringstream msg;
+    msg << "MpcServiceClient: controller_id = " << controller_id << ", needs to be < " << getNumControllers() << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  return controllerDescriptor(segment_, controller_id);
+}
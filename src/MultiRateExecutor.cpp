@@ -0,0 +1,339 @@
+/**
+ * @file MultiRateExecutor.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "MultiRateExecutor.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+
+namespace {
+
+std::chrono::steady_clock::duration toDuration(double seconds)
+{
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(seconds));
+}
+
+double toSeconds(std::chrono::steady_clock::duration duration)
+{
+  return std::chrono::duration<double>(duration).count();
+}
+
+} // namespace
+
+LinMpcEigen::MultiRateExecutor::MultiRateExecutor(uint32_t n_workers)
+  : n_workers_(n_workers)
+{
+  if (n_workers_ == 0)
+    throw std::runtime_error("MultiRateExecutor: n_workers needs to be > 0");
+}
+
+LinMpcEigen::MultiRateExecutor::~MultiRateExecutor()
+{
+  try
+  {
+    stop();
+  }
+  catch (...) {}
+}
+
+uint32_t LinMpcEigen::MultiRateExecutor::addController(std::unique_ptr<MPC> mpc, const ControllerSpec &spec)
+{
+  if (isRunning())
+    throw std::runtime_error("MultiRateExecutor: controllers can only be added while the executor is stopped");
+  if (!mpc)
+    throw std::runtime_error("MultiRateExecutor: mpc is null");
+  if (spec.period <= 0.0 || spec.deadline < 0.0)
+  {
+    std::ostringstream msg;
+    msg << "MultiRateExecutor: controller '" << spec.name << "' period = " << spec.period
+        << ", deadline = " << spec.deadline << ", need to be period > 0, deadline >= 0\n";
+    throw std::runtime_error(msg.str());
+  }
+  if (!spec.update)
+    throw std::runtime_error("MultiRateExecutor: controller '" + spec.name + "' has no update callback");
+
+  Controller controller;
+  controller.mpc = std::move(mpc);
+  controller.spec = spec;
+  if (controller.spec.deadline == 0.0)
+    controller.spec.deadline = spec.period;
+  controllers_.push_back(std::move(controller));
+
+  // rate-monotonic priorities, ties broken by the deadline, then by the order of adding
+  std::vector<uint32_t> order(controllers_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    const ControllerSpec &spec_a = controllers_[a].spec;
+    const ControllerSpec &spec_b = controllers_[b].spec;
+    if (spec_a.period != spec_b.period)
+      return spec_a.period < spec_b.period;
+    return spec_a.deadline < spec_b.deadline;
+  });
+  for (uint32_t rank = 0; rank < order.size(); rank++)
+    controllers_[order[rank]].rank = rank;
+
+  return controllers_.size() - 1;
+}
+
+void LinMpcEigen::MultiRateExecutor::setRealTimeSettings(const RealTimeSettings &settings)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  real_time_ = true;
+  real_time_settings_ = settings;
+}
+
+void LinMpcEigen::MultiRateExecutor::disableRealTimeMode()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  real_time_ = false;
+}
+
+LinMpcEigen::RealTimeReport LinMpcEigen::MultiRateExecutor::getRealTimeReport() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return real_time_report_;
+}
+
+void LinMpcEigen::MultiRateExecutor::start()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_)
+    throw std::runtime_error("MultiRateExecutor: already running");
+  if (controllers_.empty())
+    throw std::runtime_error("MultiRateExecutor: no controllers");
+
+  real_time_report_ = RealTimeReport();
+  if (real_time_)
+  {
+    std::vector<MPC *> mpcs;
+    for (auto &controller : controllers_)
+      mpcs.push_back(controller.mpc.get());
+    real_time_report_.merge(enableRealTimeMode(mpcs, real_time_settings_));
+  }
+
+  start_time_ = Clock::now();
+  for (auto &controller : controllers_)
+  {
+    controller.stats = ControllerStats();
+    controller.execution_time = 0.0;
+    controller.pending = false;
+    controller.next_release = start_time_;
+  }
+  ready_.clear();
+  busy_workers_ = 0;
+  exception_ = nullptr;
+  running_ = true;
+
+  scheduler_ = std::thread(&MultiRateExecutor::schedulerLoop, this);
+  for (uint32_t i = 0; i < n_workers_; i++)
+    workers_.emplace_back(&MultiRateExecutor::workerLoop, this);
+}
+
+void LinMpcEigen::MultiRateExecutor::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_)
+      return;
+    running_ = false;
+  }
+  scheduler_cv_.notify_all();
+  work_cv_.notify_all();
+  scheduler_.join();
+  for (auto &worker : workers_)
+    worker.join();
+  workers_.clear();
+  stop_time_ = Clock::now(); // after the last running job
+
+  std::exception_ptr exception = exception_;
+  exception_ = nullptr;
+  if (exception)
+    std::rethrow_exception(exception);
+}
+
+bool LinMpcEigen::MultiRateExecutor::isRunning() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return running_;
+}
+
+uint32_t LinMpcEigen::MultiRateExecutor::size() const
+{
+  return controllers_.size();
+}
+
+uint32_t LinMpcEigen::MultiRateExecutor::getPriorityRank(uint32_t controller_id) const
+{
+  checkId(controller_id);
+  return controllers_[controller_id].rank;
+}
+
+LinMpcEigen::ControllerStats LinMpcEigen::MultiRateExecutor::getStats(uint32_t controller_id) const
+{
+  checkId(controller_id);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Controller &controller = controllers_[controller_id];
+  ControllerStats stats = controller.stats;
+  double elapsed_time = toSeconds((running_ ? Clock::now() : stop_time_) - start_time_);
+  if (elapsed_time > 0.0)
+    stats.utilization = controller.execution_time / elapsed_time;
+  return stats;
+}
+
+double LinMpcEigen::MultiRateExecutor::getTotalUtilization() const
+{
+  double utilization = 0.0;
+  for (uint32_t i = 0; i < controllers_.size(); i++)
+    utilization += getStats(i).utilization;
+  return utilization;
+}
+
+LinMpcEigen::MPC &LinMpcEigen::MultiRateExecutor::getController(uint32_t controller_id)
+{
+  checkId(controller_id);
+  if (isRunning())
+    throw std::runtime_error("MultiRateExecutor: getController() while the executor is running");
+  return *controllers_[controller_id].mpc;
+}
+
+void LinMpcEigen::MultiRateExecutor::checkId(uint32_t controller_id) const
+{
+  if (controller_id >= controllers_.size())
+  {
+    std::ostringstream msg;
+    msg << "MultiRateExecutor: controller_id = " << controller_id << ", needs to be < " << controllers_.size() << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+void LinMpcEigen::MultiRateExecutor::configureThread(int priority)
+{
+  if (!real_time_)
+    return;
+  RealTimeReport report;
+  configureServingThread(real_time_settings_, priority, real_time_settings_.cpu_cores, report);
+  std::lock_guard<std::mutex> lock(mutex_);
+  real_time_report_.merge(report);
+}
+
+int LinMpcEigen::MultiRateExecutor::jobPriority(const Controller &controller) const
+{
+  return real_time_settings_.priority + (controllers_.size() - 1 - controller.rank);
+}
+
+void LinMpcEigen::MultiRateExecutor::schedulerLoop()
+{
+  configureThread(real_time_settings_.priority + controllers_.size());
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_)
+  {
+    Clock::time_point now = Clock::now();
+    Clock::time_point next_release = Clock::time_point::max();
+    bool released = false;
+    for (uint32_t i = 0; i < controllers_.size(); i++)
+    {
+      Controller &controller = controllers_[i];
+      Clock::duration period = toDuration(controller.spec.period);
+      while (controller.next_release <= now)
+      {
+        controller.stats.releases++;
+        if (controller.pending)
+        {
+          controller.stats.skipped_releases++;
+          controller.stats.deadline_misses++;
+          controller.mpc->getMetrics().skipped_solves.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+          controller.pending = true;
+          controller.job_release = controller.next_release;
+          ready_.push_back(i);
+          released = true;
+        }
+        controller.next_release += period;
+      }
+      next_release = std::min(next_release, controller.next_release);
+    }
+    if (released)
+      work_cv_.notify_all();
+    scheduler_cv_.wait_until(lock, next_release);
+  }
+}
+
+int LinMpcEigen::MultiRateExecutor::selectJob() const
+{
+  if (ready_.empty())
+    return -1;
+  uint32_t job = *std::min_element(ready_.begin(), ready_.end(), [this](uint32_t a, uint32_t b) {
+    return controllers_[a].rank < controllers_[b].rank;
+  });
+  // workers kept in reserve for the higher priority controllers
+  uint32_t reserved_workers = std::min(controllers_[job].rank, n_workers_ - 1);
+  if (busy_workers_ + reserved_workers >= n_workers_)
+    return -1;
+  return job;
+}
+
+void LinMpcEigen::MultiRateExecutor::workerLoop()
+{
+  // idle workers wait at the highest job priority, so a released job preempts running lower priority jobs
+  int idle_priority = real_time_settings_.priority + controllers_.size() - 1;
+  configureThread(idle_priority);
+  RealTimeReport priority_report; // failures already reported by configureThread()
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    int job = -1;
+    work_cv_.wait(lock, [&] { return !running_ || (job = selectJob()) >= 0; });
+    if (!running_)
+      return;
+
+    ready_.erase(std::find(ready_.begin(), ready_.end(), (uint32_t)job));
+    busy_workers_++;
+    Controller &controller = controllers_[job];
+    lock.unlock();
+    if (real_time_)
+      setCurrentThreadPriority(jobPriority(controller), priority_report);
+
+    Clock::time_point start_time = Clock::now();
+    std::exception_ptr exception;
+    try
+    {
+      runJob(controller);
+    }
+    catch (...)
+    {
+      exception = std::current_exception();
+    }
+    Clock::time_point end_time = Clock::now();
+    if (real_time_)
+      setCurrentThreadPriority(idle_priority, priority_report);
+
+    lock.lock();
+    busy_workers_--;
+    controller.pending = false;
+    ControllerStats &stats = controller.stats;
+    double response_time = toSeconds(end_time - controller.job_release);
+    controller.execution_time += toSeconds(end_time - start_time);
+    stats.completions++;
+    stats.worst_response_time = std::max(stats.worst_response_time, response_time);
+    stats.mean_execution_time = controller.execution_time / stats.completions;
+    if (exception || response_time > controller.spec.deadline)
+      stats.deadline_misses++;
+    if (exception && !exception_)
+      exception_ = exception;
+    work_cv_.notify_all();
+  }
+}
+
+void LinMpcEigen::MultiRateExecutor::runJob(Controller &controller)
+{
+  controller.spec.update(*controller.mpc);
+  VecNd U = controller.mpc->solve();
+  if (controller.spec.apply)
+    controller.spec.apply(U);
+}
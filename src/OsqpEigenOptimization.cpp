@@ -7,6 +7,143 @@
 
 #include "OsqpEigenOptimization.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+// -------------- OsqpSettings -----------------
+OsqpSettings OsqpSettings::lowLatency()
+{
+  OsqpSettings settings;
+  settings.alpha = 1.6;
+  settings.absolute_tolerance = 1e-3;
+  settings.relative_tolerance = 1e-3;
+  settings.max_iteration = 4000;
+  settings.adaptive_rho_interval = 25;
+  settings.check_termination = 5;
+  return settings;
+}
+
+OsqpSettings OsqpSettings::highAccuracy()
+{
+  OsqpSettings settings;
+  settings.absolute_tolerance = 1e-9;
+  settings.relative_tolerance = 1e-9;
+  settings.max_iteration = 100000;
+  settings.polish = true;
+  settings.polish_refine_iter = 10;
+  return settings;
+}
+
+OsqpSettings OsqpSettings::embedded()
+{
+  OsqpSettings settings;
+  settings.alpha = 1.6;
+  settings.absolute_tolerance = 1e-3;
+  settings.relative_tolerance = 1e-3;
+  settings.max_iteration = 500;
+  settings.adaptive_rho = false; // no refactorizations during the solve
+  settings.scaling = 4;
+  settings.check_termination = 10;
+  return settings;
+}
+
+OsqpSettings OsqpSettings::fromProfile(const std::string &profile_name)
+{
+  if (profile_name == "default") 
+    return OsqpSettings();
+  if (profile_name == "low-latency") 
+    return lowLatency();
+  if (profile_name == "high-accuracy") 
+    return highAccuracy();
+  if (profile_name == "embedded") 
+    return embedded();
+  throw std::runtime_error("OsqpSettings: unknown settings profile '" + profile_name + "'");
+}
+
+void OsqpSettings::save(std::ostream &stream) const
+{
+  std::streamsize precision = stream.precision(17);
+  stream << "alpha = " << alpha << "\n";
+  stream << "rho = " << rho << "\n";
+  stream << "sigma = " << sigma << "\n";
+  stream << "absolute_tolerance = " << absolute_tolerance << "\n";
+  stream << "relative_tolerance = " << relative_tolerance << "\n";
+  stream << "max_iteration = " << max_iteration << "\n";
+  stream << "adaptive_rho = " << adaptive_rho << "\n";
+  stream << "adaptive_rho_interval = " << adaptive_rho_interval << "\n";
+  stream << "scaling = " << scaling << "\n";
+  stream << "polish = " << polish << "\n";
+  stream << "polish_refine_iter = " << polish_refine_iter << "\n";
+  stream << "check_termination = " << check_termination << "\n";
+  stream << "warm_start = " << warm_start << "\n";
+  stream << "linear_system_solver = " << (int)linear_system_solver << "\n";
+  stream << "verbosity = " << verbosity << "\n";
+  stream.precision(precision);
+}
+
+OsqpSettings OsqpSettings::load(std::istream &stream)
+{
+  OsqpSettings settings;
+  std::string line;
+  while (std::getline(stream, line)) 
+  {
+    size_t separator = line.find('=');
+    if (line.empty() || line[0] == '#' || separator == std::string::npos) 
+      continue;
+
+    std::istringstream key_stream(line.substr(0, separator));
+    std::istringstream value(line.substr(separator + 1));
+    std::string key;
+    key_stream >> key;
+    
+    int linear_system_solver = 0;
+    if (key == "alpha") value >> settings.alpha;
+    else if (key == "rho") value >> settings.rho;
+    else if (key == "sigma") value >> settings.sigma;
+    else if (key == "absolute_tolerance") value >> settings.absolute_tolerance;
+    else if (key == "relative_tolerance") value >> settings.relative_tolerance;
+    else if (key == "max_iteration") value >> settings.max_iteration;
+    else if (key == "adaptive_rho") value >> settings.adaptive_rho;
+    else if (key == "adaptive_rho_interval") value >> settings.adaptive_rho_interval;
+    else if (key == "scaling") value >> settings.scaling;
+    else if (key == "polish") value >> settings.polish;
+    else if (key == "polish_refine_iter") value >> settings.polish_refine_iter;
+    else if (key == "check_termination") value >> settings.check_termination;
+    else if (key == "warm_start") value >> settings.warm_start;
+    else if (key == "linear_system_solver") 
+    {
+      value >> linear_system_solver;
+      settings.linear_system_solver = (linsys_solver_type)linear_system_solver;
+    }
+    else if (key == "verbosity") value >> settings.verbosity;
+    else 
+      throw std::runtime_error("OsqpSettings: unknown setting '" + key + "'");
+
+    if (value.fail()) 
+      throw std::runtime_error("OsqpSettings: can't parse the value of '" + key + "'");
+  }
+  return settings;
+}
+
+void OsqpSettings::saveToFile(const std::string &file_path) const
+{
+  std::ofstream file(file_path);
+  if (!file) 
+    throw std::runtime_error("OsqpSettings: can't open '" + file_path + "'");
+  save(file);
+}
+
+OsqpSettings OsqpSettings::loadFromFile(const std::string &file_path)
+{
+  std::ifstream file(file_path);
+  if (!file) 
+    throw std::runtime_error("OsqpSettings: can't open '" + file_path + "'");
+  return load(file);
+}
+
+// -------------- OsqpEigenOpt -----------------
 OsqpEigenOpt::OsqpEigenOpt() 
 {
 }
@@ -21,21 +158,49 @@ OsqpEigenOpt::OsqpEigenOpt( const SparseQpProblem &qp_problem,
   initializeSolver(qp_problem, time_limit, verbosity);
 }
 
+OsqpEigenOpt::OsqpEigenOpt( const SparseQpProblem &qp_problem, 
+                            double time_limit, const OsqpSettings &settings ) 
+  : alpha_(settings.alpha),
+  n_(qp_problem.A_qp.rows()), 
+  m_(qp_problem.upper_bound.rows() + qp_problem.A_eq.rows() + qp_problem.A_ieq.rows()),
+  linearConstraintsMatrix_(m_, n_)
+{
+  initializeSolver(qp_problem, time_limit, settings);
+}
+
 void OsqpEigenOpt::initializeSolver(const SparseQpProblem &qp_problem, 
                                     double time_limit, bool verbosity ) 
 {
-  //Default solver settings
-  solver_.settings()->setVerbosity(verbosity);
-  solver_.settings()->setAlpha(1.0);
+  OsqpSettings settings;
+  settings.verbosity = verbosity;
+  initializeSolver(qp_problem, time_limit, settings);
+}
 
-  solver_.settings()->setAbsoluteTolerance(1e-6);
-  solver_.settings()->setRelativeTolerance(1e-6);
-  solver_.settings()->setWarmStart(true);
-  solver_.settings()->setMaxIteration(10000);
+void OsqpEigenOpt::initializeSolver(const SparseQpProblem &qp_problem, 
+                                    double time_limit, const OsqpSettings &settings ) 
+{
+  solver_.settings()->setVerbosity(settings.verbosity);
+  solver_.settings()->setAlpha(settings.alpha);
+  solver_.settings()->setRho(settings.rho);
+  solver_.settings()->setSigma(settings.sigma);
+
+  solver_.settings()->setAbsoluteTolerance(settings.absolute_tolerance);
+  solver_.settings()->setRelativeTolerance(settings.relative_tolerance);
+  solver_.settings()->setWarmStart(settings.warm_start);
+  solver_.settings()->setMaxIteration(settings.max_iteration);
   solver_.settings()->setTimeLimit(time_limit);
+  time_limit_ = time_limit;
+  absolute_tolerance_ = settings.absolute_tolerance;
+  relative_tolerance_ = settings.relative_tolerance;
+
+  solver_.settings()->setAdaptiveRho(settings.adaptive_rho);
+  solver_.settings()->setAdaptiveRhoInterval(settings.adaptive_rho_interval);
 
-  solver_.settings()->setAdaptiveRho(true);
-  solver_.settings()->setAdaptiveRhoInterval(5);
+  solver_.settings()->setScaling(settings.scaling);
+  solver_.settings()->setPolish(settings.polish);
+  solver_.settings()->setPolishRefineIter(settings.polish_refine_iter);
+  solver_.settings()->setCheckTermination(settings.check_termination);
+  solver_.settings()->setLinearSystemSolver(settings.linear_system_solver);
 
   solver_.data()->setNumberOfVariables(n_);
   solver_.data()->setNumberOfConstraints(m_);
@@ -80,6 +245,8 @@ void OsqpEigenOpt::initializeSolver(const SparseQpProblem &qp_problem,
 
   solver_.clearSolver();
   solver_.initSolver();
+  has_iterate_ = false;
+  warm_start_pending_ = false;
 }
 
 void OsqpEigenOpt::setGradientAndInit(VecNd &b_qp ) 
@@ -89,6 +256,8 @@ void OsqpEigenOpt::setGradientAndInit(VecNd &b_qp )
   solver_.data()->setLinearConstraintsMatrix(linearConstraintsMatrix_);
   solver_.clearSolver();
   solver_.initSolver();
+  has_iterate_ = false;
+  warm_start_pending_ = false;
 }
 
 void OsqpEigenOpt::setGradientIeqConstraintAndInit(VecNd &b_qp, VecNd &b_ieq) 
@@ -103,19 +272,157 @@ void OsqpEigenOpt::setGradientIeqConstraintAndInit(VecNd &b_qp, VecNd &b_ieq)
   solver_.data()->setLinearConstraintsMatrix(linearConstraintsMatrix_);
   solver_.clearSolver();
   solver_.initSolver();
+  has_iterate_ = false;
+  warm_start_pending_ = false;
+}
+
+void OsqpEigenOpt::updateGradient(const VecNd &b_qp) 
+{
+  b_qp_ = b_qp;
+  solver_.updateGradient(b_qp_);
+}
+
+void OsqpEigenOpt::updateGradientAndIeqConstraint(const VecNd &b_qp, const VecNd &b_ieq) 
+{
+  b_qp_ = b_qp;
+  solver_.updateGradient(b_qp_);
+  uint32_t bound_dim = upper_bound_.rows();
+  
+  upper_bound_.segment(bound_dim - b_ieq.rows(), b_ieq.rows()) = -b_ieq;
+  solver_.updateBounds(lower_bound_, upper_bound_);
+}
+
+void OsqpEigenOpt::setPrimalWarmStart(const VecNd &primal_variable) 
+{
+  solver_.setPrimalVariable(primal_variable);
+  has_iterate_ = true;
+  warm_start_primal_ = primal_variable;
+  warm_start_pending_ = true;
+}
+
+void OsqpEigenOpt::getIterate(VecNd &primal_variable, VecNd &dual_variable, double &rho) const
+{
+  OsqpEigen::Solver &solver = const_cast<OsqpEigen::Solver &>(solver_); // getters are not const
+  primal_variable = solver.getSolution();
+  dual_variable = solver.getDualSolution();
+  rho = solver_.workspace()->settings->rho;
+}
+
+void OsqpEigenOpt::setIterate(const VecNd &primal_variable, const VecNd &dual_variable, double rho)
+{
+  std::ostringstream msg;
+  if ((uint32_t)primal_variable.rows() != n_ || (uint32_t)dual_variable.rows() != m_) 
+  {
+    msg << "OsqpEigenOpt: iterate size error\n primal_variable.rows() = " << primal_variable.rows() 
+        << ", dual_variable.rows() = " << dual_variable.rows() << ", need to be = " << n_ << ", " << m_ << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  osqp_update_rho(solver_.workspace().get(), rho);
+  solver_.setWarmStart(primal_variable, dual_variable);
+  has_iterate_ = true;
+  warm_start_primal_ = primal_variable;
+  warm_start_pending_ = true;
 }
 
 VecNd OsqpEigenOpt::solveProblem()
 {
   solver_.solveProblem();
+  has_iterate_ = true;
+  warm_start_pending_ = false;
   return solver_.getSolution();
 }
 
+VecNd OsqpEigenOpt::solveProblemWithinBudget( double time_budget, OsqpSolveInfo &solve_info,
+                                              double initial_tolerance, double tightening_factor )
+{
+  if (tightening_factor <= 0.0 || tightening_factor >= 1.0) 
+    throw std::runtime_error("OsqpEigenOpt: tightening_factor needs to be in (0, 1)");
+
+  auto start_time = std::chrono::steady_clock::now();
+  OSQPWorkspace *workspace = solver_.workspace().get();
+  
+  solve_info = OsqpSolveInfo();
+  VecNd solution;
+  double target_tolerance = std::min(absolute_tolerance_, relative_tolerance_);
+  double tolerance = std::max(initial_tolerance, target_tolerance);
+  while (true) 
+  {
+    double remaining_time = time_budget - 
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    if (remaining_time <= 0.0) 
+      break;
+
+    osqp_update_time_limit(workspace, remaining_time);
+    osqp_update_eps_abs(workspace, std::max(tolerance, absolute_tolerance_));
+    osqp_update_eps_rel(workspace, std::max(tolerance, relative_tolerance_));
+    solver_.solveProblem();
+    has_iterate_ = true;
+    warm_start_pending_ = false;
+    solve_info.passes++;
+    solve_info.iterations += workspace->info->iter;
+
+    int status = getStatus();
+    bool converged = (status == OSQP_SOLVED);
+    // an unconverged pass only replaces the result if nothing has converged yet
+    if (converged || solve_info.tolerance == 0.0) 
+    {
+      solution = solver_.getSolution();
+      solve_info.primal_residual = workspace->info->pri_res;
+      solve_info.dual_residual = workspace->info->dua_res;
+      solve_info.status = status;
+    }
+    if (!converged) 
+      break;
+
+    solve_info.tolerance = tolerance;
+    if (tolerance <= target_tolerance) 
+      break;
+    tolerance = std::max(tolerance * tightening_factor, target_tolerance);
+  }
+  if (solve_info.tolerance > 0.0) 
+    solve_info.status = (solve_info.tolerance <= target_tolerance) ? OSQP_SOLVED : OSQP_SOLVED_INACCURATE;
+  else if (solve_info.passes == 0) 
+  {
+    // nothing solved in time, the iterate the next solve would start from is the best guess
+    solve_info.status = OSQP_TIME_LIMIT_REACHED;
+    if (warm_start_pending_) 
+      solution = warm_start_primal_;
+    else if (has_iterate_) 
+      solution = solver_.getSolution();
+    else
+      solution = VecNd::Zero(n_);
+  }
+
+  // restore the settings for solveProblem()
+  osqp_update_time_limit(workspace, time_limit_);
+  osqp_update_eps_abs(workspace, absolute_tolerance_);
+  osqp_update_eps_rel(workspace, relative_tolerance_);
+
+  solve_info.solve_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  return solution;
+}
+
 bool OsqpEigenOpt::checkFeasibility() //Call this after calling solve
 {
   return !( (int) solver_.getStatus() == OSQP_PRIMAL_INFEASIBLE );
 }
 
+int OsqpEigenOpt::getStatus() const
+{
+  return (int) solver_.getStatus();
+}
+
+uint32_t OsqpEigenOpt::getIterations() const
+{
+  return solver_.workspace()->info->iter;
+}
+
+bool OsqpEigenOpt::isWarmStarted() const
+{
+  // an explicit warm start also switches the OSQP warm_start setting on
+  return has_iterate_ && solver_.workspace()->settings->warm_start;
+}
+
 void OsqpEigenOpt::setSparseBlock( Eigen::SparseMatrix<double> &output_matrix, const Eigen::SparseMatrix<double> &input_block,
                                           uint32_t i, uint32_t j ) 
 {
@@ -0,0 +1,145 @@
+/**
+ * @file PerfCounters.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "PerfCounters.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char *counter_names[LinMpcEigen::PerfCounterValues::N_COUNTERS] = {
+  "cycles", "instructions", "cache-misses", "branch-misses"
+};
+
+#ifdef __linux__
+const uint64_t counter_configs[LinMpcEigen::PerfCounterValues::N_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// group_fd = -1 opens a new group with this counter as the leader, members count while the leader is enabled
+int openCounter(uint64_t config, int group_fd)
+{
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group_fd < 0 ? 1 : 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // calling thread, any CPU
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+} // namespace
+
+double LinMpcEigen::PerfCounterValues::ipc() const
+{
+  if (!available[CYCLES] || !available[INSTRUCTIONS] || values[CYCLES] == 0)
+    return 0.0;
+  return (double)values[INSTRUCTIONS] / values[CYCLES];
+}
+
+LinMpcEigen::PerfCounters::PerfCounters()
+{
+  fds_.fill(-1);
+#ifdef __linux__
+  // one group, so that all counters are scheduled together and count over the same window. A counter
+  // the PMU can't add to the group (too many counters) gets its own group
+  for (uint32_t i = 0; i < PerfCounterValues::N_COUNTERS; i++)
+  {
+    if (!groups_.empty())
+    {
+      fds_[i] = openCounter(counter_configs[i], fds_[groups_.front().front()]);
+      if (fds_[i] >= 0)
+      {
+        groups_.front().push_back(i);
+        continue;
+      }
+    }
+    fds_[i] = openCounter(counter_configs[i], -1);
+    if (fds_[i] >= 0)
+      groups_.push_back({i});
+    else
+      error_ += std::string(error_.empty() ? "" : ", ") + counter_names[i] + ": " + std::strerror(errno);
+  }
+#else
+  error_ = "hardware counters are only supported on Linux";
+#endif
+}
+
+LinMpcEigen::PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+  for (int fd : fds_)
+    if (fd >= 0)
+      close(fd);
+#endif
+}
+
+bool LinMpcEigen::PerfCounters::isAvailable(PerfCounterValues::Counter counter) const
+{
+  return fds_[counter] >= 0;
+}
+
+bool LinMpcEigen::PerfCounters::anyAvailable() const
+{
+  for (int fd : fds_)
+    if (fd >= 0)
+      return true;
+  return false;
+}
+
+const std::string &LinMpcEigen::PerfCounters::getError() const
+{
+  return error_;
+}
+
+void LinMpcEigen::PerfCounters::start()
+{
+#ifdef __linux__
+  for (const auto &group : groups_)
+  {
+    ioctl(fds_[group.front()], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds_[group.front()], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+}
+
+LinMpcEigen::PerfCounterValues LinMpcEigen::PerfCounters::stop()
+{
+  PerfCounterValues counter_values;
+#ifdef __linux__
+  for (const auto &group : groups_)
+    ioctl(fds_[group.front()], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  for (const auto &group : groups_)
+  {
+    // PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, value of every member in group order
+    uint64_t data[3 + PerfCounterValues::N_COUNTERS];
+    ssize_t size = (3 + group.size()) * sizeof(uint64_t);
+    if (read(fds_[group.front()], data, size) != size || data[0] != group.size() || data[2] == 0)
+      continue; // not scheduled at all
+    // the group was multiplexed with other events for time_enabled - time_running, 
+    // the counts are extrapolated to the enabled time
+    double scaling = (double)data[1] / data[2];
+    for (uint32_t j = 0; j < group.size(); j++)
+    {
+      counter_values.values[group[j]] = (uint64_t)(data[3 + j] * scaling + 0.5);
+      counter_values.available[group[j]] = true;
+    }
+  }
+#endif
+  return counter_values;
+}
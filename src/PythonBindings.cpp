@@ -0,0 +1,265 @@
+/**
+ * @file PythonBindings.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ *
+ *    Python module lin_mpc_eigen (pybind11, CMake option BUILD_PYTHON_BINDINGS)
+ *
+ *    Vectors and dense matrices are NumPy float64 arrays, sparse matrices
+ *    are scipy.sparse matrices (CSC). Arguments are copied into Eigen
+ *    objects, since the C++ API takes const VecNd / MatNd / SparseMat
+ *    references. Results returned by value are moved into the NumPy array
+ *    without a copy. Dense const references (gradient maps, vectors of the
+ *    QP problem) are returned as read-only views of the C++ data, sparse
+ *    matrices are always returned as scipy.sparse copies.
+ *    Solves and batch evaluations release the GIL, so parameter studies can
+ *    run one MPC per Python thread in parallel.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/eigen.h>
+#include <pybind11/stl.h>
+
+#include "LinMpcEigen.hpp"
+#include "OsqpEigenOptimization.hpp"
+
+namespace py = pybind11;
+
+namespace {
+
+// U of every column of Y_d_batch / x0_batch, one updateSolver() and solve() per column, warm started
+// from the previous column. Returns the solutions as columns and the OSQP status of every solve
+std::pair<MatNd, std::vector<int>> solveBatch(LinMpcEigen::MPC &mpc, const MatNd &Y_d_batch, const MatNd &x0_batch)
+{
+  if (Y_d_batch.cols() != x0_batch.cols())
+    throw std::runtime_error("solve_batch: Y_d_batch and x0_batch need the same number of columns");
+  const LinMpcEigen::LinearSystem &linear_system = mpc.getLinearSystem();
+  MatNd U_batch(mpc.getHorizon() * linear_system.n_u, Y_d_batch.cols());
+  std::vector<int> status(Y_d_batch.cols());
+  for (Eigen::Index i = 0; i < Y_d_batch.cols(); i++)
+  {
+    mpc.updateSolver(Y_d_batch.col(i), x0_batch.col(i));
+    U_batch.col(i) = mpc.solve();
+    status[i] = mpc.getSolverStatus();
+  }
+  return std::make_pair(std::move(U_batch), std::move(status));
+}
+
+} // namespace
+
+PYBIND11_MODULE(lin_mpc_eigen, m)
+{
+  m.doc() = "Linear MPC with Eigen and OSQP";
+
+  // -------------- QP problem and solver -----------------
+
+  py::enum_<linsys_solver_type>(m, "LinsysSolver")
+    .value("QDLDL_SOLVER", QDLDL_SOLVER)
+    .value("MKL_PARDISO_SOLVER", MKL_PARDISO_SOLVER);
+
+  py::class_<OsqpSettings>(m, "OsqpSettings")
+    .def(py::init<>())
+    .def_readwrite("alpha", &OsqpSettings::alpha)
+    .def_readwrite("rho", &OsqpSettings::rho)
+    .def_readwrite("sigma", &OsqpSettings::sigma)
+    .def_readwrite("absolute_tolerance", &OsqpSettings::absolute_tolerance)
+    .def_readwrite("relative_tolerance", &OsqpSettings::relative_tolerance)
+    .def_readwrite("max_iteration", &OsqpSettings::max_iteration)
+    .def_readwrite("adaptive_rho", &OsqpSettings::adaptive_rho)
+    .def_readwrite("adaptive_rho_interval", &OsqpSettings::adaptive_rho_interval)
+    .def_readwrite("scaling", &OsqpSettings::scaling)
+    .def_readwrite("polish", &OsqpSettings::polish)
+    .def_readwrite("polish_refine_iter", &OsqpSettings::polish_refine_iter)
+    .def_readwrite("check_termination", &OsqpSettings::check_termination)
+    .def_readwrite("warm_start", &OsqpSettings::warm_start)
+    .def_readwrite("linear_system_solver", &OsqpSettings::linear_system_solver)
+    .def_readwrite("verbosity", &OsqpSettings::verbosity)
+    .def_static("low_latency", &OsqpSettings::lowLatency)
+    .def_static("high_accuracy", &OsqpSettings::highAccuracy)
+    .def_static("embedded", &OsqpSettings::embedded)
+    .def_static("from_profile", &OsqpSettings::fromProfile, py::arg("profile_name"))
+    .def("save_to_file", &OsqpSettings::saveToFile, py::arg("file_path"))
+    .def_static("load_from_file", &OsqpSettings::loadFromFile, py::arg("file_path"));
+
+  py::class_<OsqpSolveInfo>(m, "OsqpSolveInfo")
+    .def(py::init<>())
+    .def_readonly("status", &OsqpSolveInfo::status)
+    .def_readonly("tolerance", &OsqpSolveInfo::tolerance)
+    .def_readonly("primal_residual", &OsqpSolveInfo::primal_residual)
+    .def_readonly("dual_residual", &OsqpSolveInfo::dual_residual)
+    .def_readonly("iterations", &OsqpSolveInfo::iterations)
+    .def_readonly("passes", &OsqpSolveInfo::passes)
+    .def_readonly("solve_time", &OsqpSolveInfo::solve_time);
+
+  py::class_<SparseQpProblem>(m, "SparseQpProblem")
+    .def(py::init<SparseMat, VecNd, SparseMat, VecNd, SparseMat, VecNd>(),
+         py::arg("A_qp"), py::arg("b_qp"), py::arg("A_eq"), py::arg("b_eq"), py::arg("A_ieq"), py::arg("b_ieq"))
+    .def(py::init<SparseMat, VecNd, SparseMat, VecNd, SparseMat, VecNd, VecNd, VecNd>(),
+         py::arg("A_qp"), py::arg("b_qp"), py::arg("A_eq"), py::arg("b_eq"), py::arg("A_ieq"), py::arg("b_ieq"),
+         py::arg("lower_bound"), py::arg("upper_bound"))
+    .def_readonly("A_qp", &SparseQpProblem::A_qp)
+    .def_readonly("A_eq", &SparseQpProblem::A_eq)
+    .def_readonly("A_ieq", &SparseQpProblem::A_ieq)
+    .def_readonly("b_qp", &SparseQpProblem::b_qp)
+    .def_readonly("b_eq", &SparseQpProblem::b_eq)
+    .def_readonly("b_ieq", &SparseQpProblem::b_ieq)
+    .def_readonly("lower_bound", &SparseQpProblem::lower_bound)
+    .def_readonly("upper_bound", &SparseQpProblem::upper_bound);
+
+  py::class_<OsqpEigenOpt>(m, "OsqpEigenOpt")
+    .def(py::init<>())
+    .def(py::init<const SparseQpProblem &, double, const OsqpSettings &>(),
+         py::arg("sparse_qp_problem"), py::arg("time_limit") = 0.0, py::arg("settings") = OsqpSettings())
+    .def("initialize_solver",
+         py::overload_cast<const SparseQpProblem &, double, const OsqpSettings &>(&OsqpEigenOpt::initializeSolver),
+         py::arg("sparse_qp_problem"), py::arg("time_limit") = 0.0, py::arg("settings") = OsqpSettings())
+    .def("update_gradient", &OsqpEigenOpt::updateGradient, py::arg("b_qp"))
+    .def("update_gradient_and_ieq_constraint", &OsqpEigenOpt::updateGradientAndIeqConstraint,
+         py::arg("b_qp"), py::arg("b_ieq"))
+    .def("set_primal_warm_start", &OsqpEigenOpt::setPrimalWarmStart, py::arg("primal_variable"))
+    .def("get_iterate", [](const OsqpEigenOpt &solver) {
+        VecNd primal_variable, dual_variable;
+        double rho = 0.0;
+        solver.getIterate(primal_variable, dual_variable, rho);
+        return py::make_tuple(std::move(primal_variable), std::move(dual_variable), rho);
+      })
+    .def("set_iterate", &OsqpEigenOpt::setIterate,
+         py::arg("primal_variable"), py::arg("dual_variable"), py::arg("rho"))
+    .def("solve_problem", &OsqpEigenOpt::solveProblem, py::call_guard<py::gil_scoped_release>())
+    .def("solve_problem_within_budget", [](OsqpEigenOpt &solver, double time_budget,
+                                           double initial_tolerance, double tightening_factor) {
+        OsqpSolveInfo solve_info;
+        VecNd x;
+        {
+          py::gil_scoped_release release;
+          x = solver.solveProblemWithinBudget(time_budget, solve_info, initial_tolerance, tightening_factor);
+        }
+        return py::make_tuple(std::move(x), solve_info);
+      }, py::arg("time_budget"), py::arg("initial_tolerance") = 1e-2, py::arg("tightening_factor") = 0.1)
+    .def("check_feasibility", &OsqpEigenOpt::checkFeasibility)
+    .def("get_status", &OsqpEigenOpt::getStatus)
+    .def("get_iterations", &OsqpEigenOpt::getIterations);
+
+  // -------------- Linear system and MPC -----------------
+
+  py::class_<LinMpcEigen::LinearSystem>(m, "LinearSystem")
+    .def(py::init<const SparseMat &, const SparseMat &, const SparseMat &, const SparseMat &>(),
+         py::arg("A"), py::arg("B"), py::arg("C"), py::arg("D"))
+    .def_readonly("A", &LinMpcEigen::LinearSystem::A)
+    .def_readonly("B", &LinMpcEigen::LinearSystem::B)
+    .def_readonly("C", &LinMpcEigen::LinearSystem::C)
+    .def_readonly("D", &LinMpcEigen::LinearSystem::D)
+    .def_readonly("n_x", &LinMpcEigen::LinearSystem::n_x)
+    .def_readonly("n_u", &LinMpcEigen::LinearSystem::n_u)
+    .def_readonly("n_y", &LinMpcEigen::LinearSystem::n_y)
+    .def("check_matrix_dimensions", &LinMpcEigen::LinearSystem::checkMatrixDimensions)
+    .def("step_state", &LinMpcEigen::LinearSystem::stepState, py::arg("x"), py::arg("u"))
+    .def("output", &LinMpcEigen::LinearSystem::output, py::arg("x"));
+
+  m.def("setup_prediction_matrices", [](const LinMpcEigen::LinearSystem &linear_system, uint32_t horizon) {
+      SparseMat A_mpc(horizon * linear_system.n_x, horizon * linear_system.n_u);
+      SparseMat B_mpc(horizon * linear_system.n_x, linear_system.n_x);
+      SparseMat C_mpc(horizon * linear_system.n_y, horizon * linear_system.n_x);
+      LinMpcEigen::setupPredictionMatrices(linear_system, horizon, A_mpc, B_mpc, C_mpc);
+      return py::make_tuple(A_mpc, B_mpc, C_mpc);
+    }, py::arg("linear_system"), py::arg("horizon"),
+    "X = A_mpc @ U + B_mpc @ x0, Y = C_mpc @ X, returns (A_mpc, B_mpc, C_mpc)");
+
+  py::enum_<LinMpcEigen::QpBackend>(m, "QpBackend")
+    .value("OSQP", LinMpcEigen::QpBackend::OSQP)
+    .value("MIXED_PRECISION", LinMpcEigen::QpBackend::MIXED_PRECISION)
+    .value("RICCATI", LinMpcEigen::QpBackend::RICCATI);
+
+  py::class_<LinMpcEigen::MpcSensitivities>(m, "MpcSensitivities")
+    .def_readonly("dU_dweights", &LinMpcEigen::MpcSensitivities::dU_dweights)
+    .def_readonly("weight_names", &LinMpcEigen::MpcSensitivities::weight_names)
+    .def_readonly("dU_du_lower_bound", &LinMpcEigen::MpcSensitivities::dU_du_lower_bound)
+    .def_readonly("dU_du_upper_bound", &LinMpcEigen::MpcSensitivities::dU_du_upper_bound)
+    .def_readonly("dU_dx_lower_bound", &LinMpcEigen::MpcSensitivities::dU_dx_lower_bound)
+    .def_readonly("dU_dx_upper_bound", &LinMpcEigen::MpcSensitivities::dU_dx_upper_bound)
+    .def_readonly("dU_dx0", &LinMpcEigen::MpcSensitivities::dU_dx0)
+    .def_readonly("dU_dY_d", &LinMpcEigen::MpcSensitivities::dU_dY_d)
+    .def_readonly("n_active_bounds", &LinMpcEigen::MpcSensitivities::n_active_bounds)
+    .def_readonly("n_active_constraints", &LinMpcEigen::MpcSensitivities::n_active_constraints);
+
+  using LinMpcEigen::MPC;
+  py::class_<MPC>(m, "MPC")
+    .def(py::init<const LinMpcEigen::LinearSystem &, uint32_t, const VecNd &, const VecNd &, double, double,
+                  double, const OsqpSettings &>(),
+         py::arg("linear_system"), py::arg("horizon"), py::arg("Y_d"), py::arg("x0"), py::arg("Q"), py::arg("R"),
+         py::arg("solver_time_limit") = 0.0, py::arg("solver_settings") = OsqpSettings())
+    .def(py::init<const LinMpcEigen::LinearSystem &, uint32_t, const VecNd &, const VecNd &, double, double,
+                  const VecNd &, const VecNd &, double, const OsqpSettings &>(),
+         py::arg("linear_system"), py::arg("horizon"), py::arg("Y_d"), py::arg("x0"), py::arg("Q"), py::arg("R"),
+         py::arg("u_lower_bound"), py::arg("u_upper_bound"),
+         py::arg("solver_time_limit") = 0.0, py::arg("solver_settings") = OsqpSettings())
+    .def(py::init<const LinMpcEigen::LinearSystem &, uint32_t, const VecNd &, const VecNd &, double,
+                  const SparseMat &, const SparseMat &, double, const OsqpSettings &>(),
+         py::arg("linear_system"), py::arg("horizon"), py::arg("Y_d"), py::arg("x0"), py::arg("W_y"),
+         py::arg("w_u"), py::arg("w_x"),
+         py::arg("solver_time_limit") = 0.0, py::arg("solver_settings") = OsqpSettings())
+    .def(py::init<const LinMpcEigen::LinearSystem &, uint32_t, const VecNd &, const VecNd &, double,
+                  const SparseMat &, const SparseMat &, const VecNd &, const VecNd &, double, const OsqpSettings &>(),
+         py::arg("linear_system"), py::arg("horizon"), py::arg("Y_d"), py::arg("x0"), py::arg("W_y"),
+         py::arg("w_u"), py::arg("w_x"), py::arg("u_lower_bound"), py::arg("u_upper_bound"),
+         py::arg("solver_time_limit") = 0.0, py::arg("solver_settings") = OsqpSettings())
+    .def(py::init<const LinMpcEigen::LinearSystem &, uint32_t, const VecNd &, const VecNd &, double,
+                  const SparseMat &, const SparseMat &, const VecNd &, const VecNd &, const VecNd &, const VecNd &,
+                  double, const OsqpSettings &>(),
+         py::arg("linear_system"), py::arg("horizon"), py::arg("Y_d"), py::arg("x0"), py::arg("W_y"),
+         py::arg("w_u"), py::arg("w_x"), py::arg("u_lower_bound"), py::arg("u_upper_bound"),
+         py::arg("x_lower_bound"), py::arg("x_upper_bound"),
+         py::arg("solver_time_limit") = 0.0, py::arg("solver_settings") = OsqpSettings())
+    .def("set_Y_d", &MPC::setYd, py::arg("Y_d"))
+    .def("set_solver_settings", &MPC::setSolverSettings, py::arg("solver_settings"))
+    .def("get_solver_settings", &MPC::getSolverSettings)
+    .def("set_structured_scaling", &MPC::setStructuredScaling, py::arg("enable"))
+    .def("set_qp_backend", &MPC::setQpBackend, py::arg("qp_backend"))
+    .def("set_proximal_term", &MPC::setProximalTerm, py::arg("E"), py::arg("rho"))
+    .def("initialize_solver", &MPC::initializeSolver, py::call_guard<py::gil_scoped_release>())
+    .def("update_solver", &MPC::updateSolver, py::arg("Y_d"), py::arg("x0"))
+    .def("update_gradient_offset", &MPC::updateGradientOffset, py::arg("gradient_offset"))
+    .def("set_warm_start", &MPC::setWarmStart, py::arg("U_warm_start"))
+    .def("solve", &MPC::solve, py::call_guard<py::gil_scoped_release>())
+    .def("solve_within_budget", [](const MPC &mpc, double time_budget) {
+        OsqpSolveInfo solve_info;
+        VecNd U;
+        {
+          py::gil_scoped_release release;
+          U = mpc.solveWithinBudget(time_budget, solve_info);
+        }
+        return py::make_tuple(std::move(U), solve_info);
+      }, py::arg("time_budget"))
+    .def("get_solver_status", &MPC::getSolverStatus)
+    .def("get_solver_iterations", &MPC::getSolverIterations)
+    .def("calculate_X", py::overload_cast<const VecNd &>(&MPC::calculateX, py::const_), py::arg("U"))
+    .def("calculate_Y", &MPC::calculateY, py::arg("U"))
+    .def("get_horizon", &MPC::getHorizon)
+    .def("get_linear_system", &MPC::getLinearSystem, py::return_value_policy::reference_internal)
+    .def("get_qp_problem", &MPC::getQpProblem, py::return_value_policy::reference_internal)
+    .def("get_gradient_x0_map", &MPC::getGradientX0Map, py::return_value_policy::reference_internal)
+    .def("get_gradient_Y_d_map", &MPC::getGradientYdMap, py::return_value_policy::reference_internal)
+    .def("get_prediction_matrices", [](const MPC &mpc) {
+        SparseMat A_mpc, B_mpc, C_mpc;
+        mpc.getPredictionMatrices(A_mpc, B_mpc, C_mpc);
+        return py::make_tuple(A_mpc, B_mpc, C_mpc);
+      })
+    .def("checkpoint", [](const MPC &mpc) { return py::bytes(mpc.checkpoint()); })
+    .def_static("restore", [](const std::string &checkpoint) { return MPC::restore(checkpoint); },
+                py::arg("checkpoint"))
+    .def("checkpoint_to_file", &MPC::checkpointToFile, py::arg("file_path"))
+    .def_static("restore_from_file", &MPC::restoreFromFile, py::arg("file_path"))
+    // batch evaluation, one scenario per column
+    .def("calculate_gradient_batch", &MPC::calculateGradientBatch, py::arg("Y_d_batch"), py::arg("x0_batch"),
+         py::call_guard<py::gil_scoped_release>())
+    .def("solve_unconstrained_batch", &MPC::solveUnconstrainedBatch, py::arg("Y_d_batch"), py::arg("x0_batch"),
+         py::call_guard<py::gil_scoped_release>())
+    .def("calculate_X_batch", &MPC::calculateXBatch, py::arg("U_batch"), py::arg("x0_batch"),
+         py::call_guard<py::gil_scoped_release>())
+    .def("calculate_Y_batch", &MPC::calculateYBatch, py::arg("U_batch"), py::arg("x0_batch"),
+         py::call_guard<py::gil_scoped_release>())
+    .def("solve_batch", &solveBatch, py::arg("Y_d_batch"), py::arg("x0_batch"),
+         py::call_guard<py::gil_scoped_release>(),
+         "constrained solve of every column, returns (U_batch, status list)")
+    .def("calculate_sensitivities", &MPC::calculateSensitivities, py::arg("U"), py::arg("active_tolerance") = 1e-5,
+         py::call_guard<py::gil_scoped_release>());
+}
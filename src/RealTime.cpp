@@ -0,0 +1,160 @@
+/**
+ * @file RealTime.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "RealTime.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#ifdef __linux__
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+size_t pageSize()
+{
+#ifdef __linux__
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size > 0)
+    return page_size;
+#endif
+  return 4096;
+}
+
+std::string errorText(const std::string &what, int error)
+{
+  std::ostringstream msg;
+  msg << what << ": " << std::strerror(error);
+  return msg.str();
+}
+
+} // namespace
+
+void LinMpcEigen::RealTimeReport::merge(const RealTimeReport &other)
+{
+  failures.insert(failures.end(), other.failures.begin(), other.failures.end());
+  prefaulted_bytes += other.prefaulted_bytes;
+  memory_locked = memory_locked || other.memory_locked;
+}
+
+size_t LinMpcEigen::prefaultMemory(const void *data, size_t bytes)
+{
+  if (data == nullptr || bytes == 0)
+    return 0;
+  // reading is enough for memory that has already been written, volatile keeps the loads
+  const volatile char *begin = static_cast<const volatile char *>(data);
+  size_t page_size = pageSize();
+  for (size_t offset = 0; offset < bytes; offset += page_size)
+    (void)begin[offset];
+  (void)begin[bytes - 1];
+  return bytes;
+}
+
+void LinMpcEigen::prefaultStack(size_t bytes)
+{
+  if (bytes == 0)
+    return;
+  volatile char *stack = static_cast<volatile char *>(alloca(bytes));
+  size_t page_size = pageSize();
+  for (size_t offset = 0; offset < bytes; offset += page_size)
+    stack[offset] = 0;
+}
+
+LinMpcEigen::RealTimeReport LinMpcEigen::configureProcessMemory(const RealTimeSettings &settings)
+{
+  RealTimeReport report;
+#ifdef __linux__
+  // keep freed memory mapped, large blocks from the (prefaulted) heap instead of fresh mmaps
+  bool trimming_disabled = mallopt(M_TRIM_THRESHOLD, -1) != 0;
+  bool mmap_disabled = mallopt(M_MMAP_MAX, 0) != 0;
+  if (!trimming_disabled)
+    report.failures.push_back("mallopt: could not disable heap trimming");
+  if (!mmap_disabled)
+    report.failures.push_back("mallopt: could not disable mmap allocations");
+
+  if (settings.lock_memory)
+  {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+      report.memory_locked = true;
+    else
+      report.failures.push_back(errorText("mlockall", errno));
+  }
+
+  if (settings.heap_reserve_size > 0)
+  {
+    char *reserve = static_cast<char *>(std::malloc(settings.heap_reserve_size));
+    if (reserve == nullptr)
+      report.failures.push_back("heap reserve: malloc failed");
+    else
+    {
+      size_t page_size = pageSize();
+      for (size_t offset = 0; offset < settings.heap_reserve_size; offset += page_size)
+        reserve[offset] = 0;
+      std::free(reserve); // not returned to the system, trimming is disabled
+      report.prefaulted_bytes += settings.heap_reserve_size;
+    }
+  }
+#else
+  report.failures.push_back("memory locking is only supported on Linux");
+#endif
+  prefaultStack(settings.stack_prefault_size);
+  report.prefaulted_bytes += settings.stack_prefault_size;
+  return report;
+}
+
+void LinMpcEigen::setCurrentThreadPriority(int priority, RealTimeReport &report)
+{
+  if (priority <= 0)
+    return;
+#ifdef __linux__
+  sched_param param;
+  param.sched_priority = std::min(priority, sched_get_priority_max(SCHED_FIFO));
+  int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (error != 0)
+  {
+    std::ostringstream what;
+    what << "SCHED_FIFO priority " << priority;
+    report.failures.push_back(errorText(what.str(), error));
+  }
+#else
+  report.failures.push_back("SCHED_FIFO is only supported on Linux");
+#endif
+}
+
+void LinMpcEigen::configureCurrentThread(int priority, const std::vector<int> &cpu_cores, RealTimeReport &report)
+{
+#ifdef __linux__
+  if (!cpu_cores.empty())
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int core : cpu_cores)
+      CPU_SET(core, &cpu_set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (error != 0)
+      report.failures.push_back(errorText("pthread_setaffinity_np", error));
+  }
+#else
+  if (!cpu_cores.empty())
+    report.failures.push_back("thread pinning is only supported on Linux");
+#endif
+  setCurrentThreadPriority(priority, report);
+}
+
+void LinMpcEigen::configureServingThread(const RealTimeSettings &settings, int priority, 
+                                         const std::vector<int> &cpu_cores, RealTimeReport &report)
+{
+  prefaultStack(settings.stack_prefault_size);
+  configureCurrentThread(priority, cpu_cores, report);
+}
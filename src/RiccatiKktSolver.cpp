@@ -0,0 +1,85 @@
+/**
+ * @file RiccatiKktSolver.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "RiccatiKktSolver.hpp"
+
+#include <sstream>
+
+// -------------- RiccatiKktSolver -----------------
+RiccatiKktSolver::RiccatiKktSolver( const MatNd &A, const MatNd &B, uint32_t horizon, 
+                                    const MatNd &state_weight, const MatNd &input_weight,
+                                    const VecNd &input_scaling ) 
+  : A_(A), B_(B), N_(horizon), n_x_(A.rows()), n_u_(B.cols()),
+  state_weight_(state_weight), input_weight_(input_weight), 
+  input_scaling_(input_scaling.rows() > 0 ? input_scaling : VecNd(VecNd::Ones(horizon * B.cols()))),
+  feedback_gains_(horizon), input_hessian_llt_(horizon)
+{
+  std::ostringstream msg;
+  if ( (uint32_t)A_.cols() != n_x_ || (uint32_t)B_.rows() != n_x_ || 
+       (uint32_t)state_weight_.rows() != n_x_ || (uint32_t)state_weight_.cols() != n_x_ ||
+       (uint32_t)input_weight_.rows() != n_u_ || (uint32_t)input_weight_.cols() != n_u_ ||
+       (uint32_t)input_scaling_.rows() != N_ * n_u_ ) 
+  {
+    msg << "RiccatiKktSolver: dimensions mismatch, n_x = " << n_x_ << ", n_u = " << n_u_ 
+        << ", horizon = " << N_ << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+/*
+  Backward Riccati recursion of the cost-to-go Hessian P_k, P_N = state_weight:
+    H_uu = input_weight + diag(shift_k / d_k^2) + B^T * P_k+1 * B
+    K_k = -H_uu^(-1) * B^T * P_k+1 * A
+    P_k = A^T * P_k+1 * A + (B^T * P_k+1 * A)^T * K_k + state_weight   (no state weight on x_0)
+*/
+void RiccatiKktSolver::factorize(const VecNd &diagonal_shift) 
+{
+  if ((uint32_t)diagonal_shift.rows() != N_ * n_u_) 
+    throw std::runtime_error("RiccatiKktSolver: diagonal_shift size error");
+
+  MatNd P = state_weight_;
+  for (int k = N_ - 1; k >= 0; k--) 
+  {
+    VecNd scaling = input_scaling_.segment(k * n_u_, n_u_);
+    MatNd PB = P * B_;
+    MatNd H_uu = input_weight_ + B_.transpose() * PB;
+    H_uu.diagonal() += diagonal_shift.segment(k * n_u_, n_u_).cwiseQuotient(scaling.cwiseAbs2());
+    MatNd H_ux = PB.transpose() * A_;
+
+    input_hessian_llt_[k].compute(H_uu);
+    if (input_hessian_llt_[k].info() != Eigen::Success) 
+      throw std::runtime_error("RiccatiKktSolver: stage Hessian is not positive definite");
+    feedback_gains_[k] = -input_hessian_llt_[k].solve(H_ux);
+
+    P = A_.transpose() * P * A_ + H_ux.transpose() * feedback_gains_[k];
+    if (k > 0) 
+      P += state_weight_;
+  }
+}
+
+VecNd RiccatiKktSolver::solve(const VecNd &rhs) const 
+{
+  VecNd f = rhs.cwiseQuotient(input_scaling_);
+
+  // backward sweep of the cost-to-go gradient p_k
+  std::vector<VecNd> feedforward(N_);
+  VecNd p = VecNd::Zero(n_x_);
+  for (int k = N_ - 1; k >= 0; k--) 
+  {
+    VecNd h_u = B_.transpose() * p - f.segment(k * n_u_, n_u_);
+    feedforward[k] = -input_hessian_llt_[k].solve(h_u);
+    p = A_.transpose() * p + feedback_gains_[k].transpose() * h_u;
+  }
+
+  // forward sweep from x_0 = 0
+  VecNd u(N_ * n_u_);
+  VecNd x = VecNd::Zero(n_x_);
+  for (uint32_t k = 0; k < N_; k++) 
+  {
+    u.segment(k * n_u_, n_u_) = feedback_gains_[k] * x + feedforward[k];
+    x = A_ * x + B_ * u.segment(k * n_u_, n_u_);
+  }
+  return u.cwiseQuotient(input_scaling_);
+}
@@ -0,0 +1,217 @@
+/**
+ * @file ScenarioMpc.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "ScenarioMpc.hpp"
+#include "PolicyMpc.hpp"
+#include "ThreadPool.hpp"
+
+LinMpcEigen::ScenarioMPC::ScenarioMPC(const std::vector<LinearSystem> &scenario_systems, uint32_t horizon,
+                                      const VecNd &Y_d, const VecNd &x0, double Q, double R,
+                                      double solver_time_limit, uint32_t n_threads,
+                                      const OsqpSettings &solver_settings)
+: scenario_systems_(scenario_systems), N_(horizon), Y_d_(Y_d), x0_(x0), Q_(Q), R_(R),
+  solver_time_limit_(solver_time_limit), n_threads_(n_threads), solver_settings_(solver_settings)
+{
+  checkScenarioDimensions();
+  checkMatrixDimensions();
+}
+
+LinMpcEigen::ScenarioMPC::ScenarioMPC(const std::vector<LinearSystem> &scenario_systems, uint32_t horizon,
+                                      const VecNd &Y_d, const VecNd &x0, double Q, double R,
+                                      const VecNd &u_lower_bound, const VecNd &u_upper_bound,
+                                      double solver_time_limit, uint32_t n_threads,
+                                      const OsqpSettings &solver_settings)
+: scenario_systems_(scenario_systems), N_(horizon), Y_d_(Y_d), x0_(x0), Q_(Q), R_(R),
+  bound_constrained_(true), u_lower_bound_(u_lower_bound), u_upper_bound_(u_upper_bound),
+  solver_time_limit_(solver_time_limit), n_threads_(n_threads), solver_settings_(solver_settings)
+{
+  checkScenarioDimensions();
+  checkMatrixDimensions();
+  checkBoundsDimensions();
+}
+
+void LinMpcEigen::ScenarioMPC::checkScenarioDimensions() const
+{
+  std::ostringstream msg;
+  if (scenario_systems_.empty()) 
+    throw std::runtime_error("ScenarioMPC: at least one scenario system is needed");
+
+  const LinearSystem &first = scenario_systems_[0];
+  for (uint32_t i = 1; i < scenario_systems_.size(); i++) 
+  {
+    const LinearSystem &system = scenario_systems_[i];
+    if (system.n_x != first.n_x || system.n_u != first.n_u || system.n_y != first.n_y) 
+    {
+      msg << "ScenarioMPC: scenario " << i << " dimensions (n_x, n_u, n_y) = (" << system.n_x << ", " 
+          << system.n_u << ", " << system.n_y << ") differ from scenario 0 (" << first.n_x << ", " 
+          << first.n_u << ", " << first.n_y << ")";
+      throw std::runtime_error(msg.str());
+    }
+    // the output equation is shared, Y_d is tracked with the same C and D in every scenario
+    if ((SparseMat(system.C - first.C)).norm() != 0.0 || (SparseMat(system.D - first.D)).norm() != 0.0) 
+    {
+      msg << "ScenarioMPC: scenario " << i << " has different C or D matrices than scenario 0, "
+          << "only A and B can differ between scenarios";
+      throw std::runtime_error(msg.str());
+    }
+  }
+}
+
+void LinMpcEigen::ScenarioMPC::checkMatrixDimensions() const 
+{
+  std::ostringstream msg;
+  const LinearSystem &system = scenario_systems_[0];
+
+  if ((uint32_t)Y_d_.rows() != N_ * system.n_y) 
+  {
+    msg << "ScenarioMPC: Vector 'Y_d' size error\n Y_d_.rows() = " << Y_d_.rows() 
+        << ", needs to be = " << N_ * system.n_y << "\n";
+    throw std::runtime_error(msg.str());
+  }
+  if ((uint32_t)x0_.rows() != system.n_x) 
+  {
+    msg << "ScenarioMPC: Vector 'x0' size error\n x0.rows() = " << x0_.rows() 
+        << ", needs to be = " << system.n_x << "\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+void LinMpcEigen::ScenarioMPC::checkBoundsDimensions() const 
+{
+  std::ostringstream msg;
+  uint32_t n_u = scenario_systems_[0].n_u;
+
+  if ((uint32_t)u_lower_bound_.rows() != n_u || (uint32_t)u_upper_bound_.rows() != n_u) 
+  {
+    msg << "ScenarioMPC: Vectors 'u_lower_bound' and 'u_upper_bound' need to be of size " << n_u 
+        << ", (" << u_lower_bound_.rows() << ", " << u_upper_bound_.rows() << ") given\n";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+void LinMpcEigen::ScenarioMPC::setupScenarioBlocks()
+{
+  n_x_ = scenario_systems_[0].n_x;
+  n_u_ = scenario_systems_[0].n_u;
+  n_y_ = scenario_systems_[0].n_y;
+
+  uint32_t n_scenarios = scenario_systems_.size();
+  double scenario_weight = 1.0 / n_scenarios;
+  scenario_blocks_.clear();
+  scenario_blocks_.resize(n_scenarios);
+
+  ThreadPool thread_pool(std::min(n_threads_ == 0 ? std::thread::hardware_concurrency() : n_threads_, 
+                                  n_scenarios));
+  thread_pool.parallelFor(n_scenarios, [&](uint32_t i, uint32_t)
+  {
+    ScenarioBlocks &blocks = scenario_blocks_[i];
+    blocks.A_mpc = SparseMat(N_ * n_x_, N_ * n_u_);
+    blocks.B_mpc = SparseMat(N_ * n_x_, n_x_);
+    blocks.C_mpc = SparseMat(N_ * n_y_, N_ * n_x_);
+    setupPredictionMatrices(scenario_systems_[i], N_, blocks.A_mpc, blocks.B_mpc, blocks.C_mpc);
+
+    OutputTrackingCost cost(Q_, R_);
+    cost.setup(scenario_systems_[i], N_, blocks.A_mpc, blocks.B_mpc);
+    blocks.A_qp = scenario_weight * cost.hessian();
+    blocks.gradient_x0_map = scenario_weight * cost.gradientX0Map();
+    blocks.gradient_Y_d_map = scenario_weight * cost.gradientYdMap();
+  });
+}
+
+VecNd LinMpcEigen::ScenarioMPC::calculateGradient() const
+{
+  uint32_t n_block = N_ * n_u_;
+  VecNd b_qp(scenario_blocks_.size() * n_block);
+  for (uint32_t i = 0; i < scenario_blocks_.size(); i++) 
+  {
+    b_qp.segment(i * n_block, n_block) = scenario_blocks_[i].gradient_x0_map * x0_ 
+                                         + scenario_blocks_[i].gradient_Y_d_map * Y_d_;
+  }
+  return b_qp;
+}
+
+void LinMpcEigen::ScenarioMPC::initializeSolver()
+{
+  setupScenarioBlocks();
+
+  uint32_t n_scenarios = scenario_blocks_.size();
+  uint32_t n_block = N_ * n_u_;
+  uint32_t n_var = n_scenarios * n_block;
+
+  SparseMat A_qp(n_var, n_var);
+  for (uint32_t i = 0; i < n_scenarios; i++) 
+    setSparseBlock(A_qp, scenario_blocks_[i].A_qp, i * n_block, i * n_block);
+  VecNd b_qp = calculateGradient();
+
+  // non-anticipativity, u_i(0) - u_1(0) = 0
+  SparseMat A_eq((n_scenarios - 1) * n_u_, n_var);
+  for (uint32_t i = 1; i < n_scenarios; i++) 
+  {
+    for (uint32_t j = 0; j < n_u_; j++) 
+    {
+      A_eq.insert((i - 1) * n_u_ + j, j) = -1.0;
+      A_eq.insert((i - 1) * n_u_ + j, i * n_block + j) = 1.0;
+    }
+  }
+  VecNd b_eq = VecNd::Zero((n_scenarios - 1) * n_u_);
+  SparseMat A_ieq(0, n_var);
+  VecNd b_ieq = VecNd::Zero(0);
+
+  if (bound_constrained_) 
+  {
+    qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq, 
+                                                    u_lower_bound_.colwise().replicate(N_ * n_scenarios), 
+                                                    u_upper_bound_.colwise().replicate(N_ * n_scenarios));
+  }
+  else 
+  {
+    qp_problem_ = std::make_unique<SparseQpProblem>(A_qp, b_qp, A_eq, b_eq, A_ieq, b_ieq);
+  }
+  osqp_eigen_opt_ = std::make_unique<OsqpEigenOpt>(*qp_problem_, solver_time_limit_, solver_settings_);
+}
+
+void LinMpcEigen::ScenarioMPC::updateSolver(const VecNd &Y_d_in, const VecNd &x0)
+{
+  Y_d_ = Y_d_in;
+  x0_ = x0;
+  checkMatrixDimensions();
+
+  VecNd b_qp = calculateGradient();
+  qp_problem_->b_qp = b_qp;
+  osqp_eigen_opt_->updateGradient(b_qp);
+}
+
+VecNd LinMpcEigen::ScenarioMPC::solve() const 
+{
+  return osqp_eigen_opt_->solveProblem();
+}
+
+int LinMpcEigen::ScenarioMPC::getSolverStatus() const 
+{
+  return osqp_eigen_opt_->getStatus();
+}
+
+uint32_t LinMpcEigen::ScenarioMPC::getNumberOfScenarios() const 
+{
+  return scenario_systems_.size();
+}
+
+VecNd LinMpcEigen::ScenarioMPC::extractScenarioU(const VecNd &U_stacked, uint32_t scenario) const
+{
+  if (scenario >= scenario_blocks_.size()) 
+    throw std::runtime_error("ScenarioMPC: scenario index out of range");
+  return U_stacked.segment(scenario * N_ * n_u_, N_ * n_u_);
+}
+
+VecNd LinMpcEigen::ScenarioMPC::calculateScenarioX(const VecNd &U_stacked, uint32_t scenario) const
+{
+  VecNd U = extractScenarioU(U_stacked, scenario);
+  return rolloutStates(scenario_systems_[scenario], U, x0_);
+}
+
+VecNd LinMpcEigen::ScenarioMPC::calculateScenarioY(const VecNd &U_stacked, uint32_t scenario) const
+{
+  return outputSequence(scenario_systems_[scenario], calculateScenarioX(U_stacked, scenario));
+}
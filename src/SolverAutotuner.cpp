@@ -0,0 +1,152 @@
+/**
+ * @file SolverAutotuner.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "SolverAutotuner.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+LinMpcEigen::SolverAutotuner::SolverAutotuner(const LinearSystem &linear_system, const MpcFactory &mpc_factory, 
+                                              const std::vector<WorkloadTick> &workload)
+  : linear_system_(linear_system), mpc_factory_(mpc_factory), workload_(workload)
+{
+  if (workload_.empty()) 
+    throw std::runtime_error("SolverAutotuner: the workload needs at least one tick");
+}
+
+std::vector<OsqpSettings> LinMpcEigen::SolverAutotuner::makeCandidates( const AutotuneGrid &grid, 
+                                                                        uint32_t max_candidates, 
+                                                                        uint64_t seed ) const
+{
+  std::vector<OsqpSettings> candidates;
+  for (double rho : grid.rho) 
+    for (double alpha : grid.alpha) 
+      for (uint32_t scaling : grid.scaling) 
+        for (double tolerance : grid.tolerance) 
+          for (uint32_t check_termination : grid.check_termination) 
+            for (bool adaptive_rho : grid.adaptive_rho) 
+            {
+              OsqpSettings settings;
+              settings.rho = rho;
+              settings.alpha = alpha;
+              settings.scaling = scaling;
+              settings.absolute_tolerance = tolerance;
+              settings.relative_tolerance = tolerance;
+              settings.check_termination = check_termination;
+              settings.adaptive_rho = adaptive_rho;
+              candidates.push_back(settings);
+            }
+
+  if (candidates.size() > max_candidates) 
+  {
+    std::mt19937_64 rng(seed);
+    std::shuffle(candidates.begin(), candidates.end(), rng);
+    candidates.resize(max_candidates);
+  }
+  return candidates;
+}
+
+std::vector<VecNd> LinMpcEigen::SolverAutotuner::solveReference() const
+{
+  std::unique_ptr<MPC> mpc = mpc_factory_(linear_system_, workload_[0].Y_d, workload_[0].x0);
+  mpc->setSolverSettings(OsqpSettings::highAccuracy());
+  mpc->initializeSolver();
+
+  std::vector<VecNd> reference;
+  for (uint32_t k = 0; k < workload_.size(); k++) 
+  {
+    mpc->updateSolver(workload_[k].Y_d, workload_[k].x0);
+    reference.push_back(mpc->solve());
+    // candidates can't be judged against an unsolved reference
+    int status = mpc->getSolverStatus();
+    if (status != OSQP_SOLVED) 
+    {
+      std::ostringstream msg;
+      msg << "SolverAutotuner: the reference solve of workload tick " << k << " ended with OSQP status " 
+          << status << "\n";
+      throw std::runtime_error(msg.str());
+    }
+  }
+  return reference;
+}
+
+LinMpcEigen::AutotuneCandidate LinMpcEigen::SolverAutotuner::evaluate( const OsqpSettings &settings, 
+                                                                       const std::vector<VecNd> &reference,
+                                                                       double accuracy_bound, 
+                                                                       uint32_t repetitions ) const
+{
+  AutotuneCandidate candidate;
+  candidate.settings = settings;
+
+  std::unique_ptr<MPC> mpc = mpc_factory_(linear_system_, workload_[0].Y_d, workload_[0].x0);
+  mpc->setSolverSettings(settings);
+  mpc->initializeSolver();
+
+  std::vector<double> tick_times;
+  tick_times.reserve(repetitions * workload_.size());
+  for (uint32_t r = 0; r < std::max(1u, repetitions); r++) 
+  {
+    for (uint32_t k = 0; k < workload_.size(); k++) 
+    {
+      const auto start = std::chrono::steady_clock::now();
+      mpc->updateSolver(workload_[k].Y_d, workload_[k].x0);
+      VecNd U = mpc->solve();
+      const auto end = std::chrono::steady_clock::now();
+      tick_times.push_back(std::chrono::duration<double>(end - start).count());
+
+      int status = mpc->getSolverStatus();
+      if (status != OSQP_SOLVED && status != OSQP_SOLVED_INACCURATE) 
+        candidate.n_failures++;
+
+      double scale = std::max(1.0, reference[k].lpNorm<Eigen::Infinity>());
+      candidate.max_error = std::max(candidate.max_error, (U - reference[k]).lpNorm<Eigen::Infinity>() / scale);
+    }
+  }
+
+  std::sort(tick_times.begin(), tick_times.end());
+  double time_sum = 0.0;
+  for (double t : tick_times) 
+    time_sum += t;
+  candidate.tick_time_mean = time_sum / tick_times.size();
+  size_t p99_index = (size_t)std::ceil(0.99 * tick_times.size());
+  candidate.tick_time_p99 = tick_times[std::max<size_t>(p99_index, 1) - 1];
+
+  candidate.feasible = candidate.n_failures == 0 && candidate.max_error <= accuracy_bound;
+  return candidate;
+}
+
+LinMpcEigen::AutotuneResult LinMpcEigen::SolverAutotuner::run( const AutotuneGrid &grid, double accuracy_bound,
+                                                               uint32_t repetitions, uint32_t max_candidates,
+                                                               uint64_t seed, uint32_t n_threads ) const
+{
+  std::vector<VecNd> reference = solveReference();
+  std::vector<OsqpSettings> settings = makeCandidates(grid, max_candidates, seed);
+
+  AutotuneResult result;
+  result.candidates.resize(settings.size());
+
+  ThreadPool thread_pool(n_threads);
+  thread_pool.parallelFor(settings.size(), [&](uint32_t i, uint32_t)
+  {
+    result.candidates[i] = evaluate(settings[i], reference, accuracy_bound, repetitions);
+  });
+
+  for (const auto &candidate : result.candidates) 
+  {
+    if (!candidate.feasible) 
+      continue;
+    if ( !result.found || candidate.tick_time_p99 < result.best.tick_time_p99 ||
+         (candidate.tick_time_p99 == result.best.tick_time_p99 && 
+          candidate.tick_time_mean < result.best.tick_time_mean) ) 
+    {
+      result.best = candidate;
+      result.found = true;
+    }
+  }
+  return result;
+}
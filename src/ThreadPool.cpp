@@ -0,0 +1,89 @@
+/**
+ * @file ThreadPool.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+LinMpcEigen::ThreadPool::ThreadPool(uint32_t n_threads) 
+{
+  if (n_threads == 0) 
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (uint32_t i = 0; i < n_threads; i++) 
+    workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+LinMpcEigen::ThreadPool::~ThreadPool() 
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto &worker : workers_) 
+    worker.join();
+}
+
+uint32_t LinMpcEigen::ThreadPool::size() const 
+{
+  return workers_.size();
+}
+
+void LinMpcEigen::ThreadPool::parallelFor(uint32_t n, 
+                                          const std::function<void(uint32_t, uint32_t)> &task) 
+{
+  if (n == 0) 
+    return;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_ = &task;
+  n_tasks_ = n;
+  next_index_ = 0;
+  exception_ = nullptr;
+  busy_workers_ = workers_.size();
+  generation_++;
+  work_cv_.notify_all();
+
+  done_cv_.wait(lock, [this] { return busy_workers_ == 0; });
+  task_ = nullptr;
+
+  if (exception_) 
+    std::rethrow_exception(exception_);
+}
+
+void LinMpcEigen::ThreadPool::workerLoop(uint32_t worker_id) 
+{
+  uint64_t last_generation = 0;
+  while (true) 
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [&] { return stop_ || generation_ != last_generation; });
+      if (stop_) 
+        return;
+      last_generation = generation_;
+    }
+
+    for (uint32_t i = next_index_++; i < n_tasks_; i = next_index_++) 
+    {
+      try 
+      {
+        (*task_)(i, worker_id);
+      }
+      catch (...) 
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!exception_) 
+          exception_ = std::current_exception();
+        next_index_ = n_tasks_; // skip remaining tasks
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--busy_workers_ == 0) 
+      done_cv_.notify_one();
+  }
+}
@@ -0,0 +1,411 @@
+/**
+ * @file TrajectoryLogger.cpp
+ * @copyright Released under the terms of the BSD 3-Clause License
+ */
+
+#include "TrajectoryLogger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char log_magic[4] = {'L', 'M', 'T', 'L'};
+const uint32_t log_version = 1;
+const size_t column_alignment = 64;
+
+enum ColumnIndex { TICK_COLUMN = 0, TIME_COLUMN, U_COLUMN, X_COLUMN, Y_COLUMN };
+
+size_t alignUp(size_t size)
+{
+  return (size + column_alignment - 1) / column_alignment * column_alignment;
+}
+
+// fills the column offsets, returns the chunk file size
+size_t columnLayout(LinMpcEigen::TrajectoryLogHeader &header)
+{
+  size_t capacity = header.capacity;
+  size_t offset = alignUp(sizeof(LinMpcEigen::TrajectoryLogHeader));
+  auto addColumn = [&](ColumnIndex column, size_t row_size) {
+    header.column_offsets[column] = offset;
+    offset = alignUp(offset + capacity * row_size);
+  };
+  std::fill(header.column_offsets, header.column_offsets + 5, 0);
+  addColumn(TICK_COLUMN, sizeof(uint64_t));
+  addColumn(TIME_COLUMN, sizeof(int64_t));
+  if (header.columns & LinMpcEigen::LOG_U)
+    addColumn(U_COLUMN, sizeof(double) * header.horizon * header.n_u);
+  if (header.columns & LinMpcEigen::LOG_X)
+    addColumn(X_COLUMN, sizeof(double) * header.horizon * header.n_x);
+  if (header.columns & LinMpcEigen::LOG_Y)
+    addColumn(Y_COLUMN, sizeof(double) * header.horizon * header.n_y);
+  return offset;
+}
+
+void copyRow(char *data, const LinMpcEigen::TrajectoryLogHeader &header, ColumnIndex column,
+             uint32_t row_length, uint64_t row, const VecNd &values)
+{
+  if (header.column_offsets[column] == 0)
+    return;
+  if (values.size() != row_length)
+  {
+    std::ostringstream msg;
+    msg << "TrajectoryLogger: wrong vector size " << values.size() << ", expected " << row_length;
+    throw std::runtime_error(msg.str());
+  }
+  std::memcpy(data + header.column_offsets[column] + row * row_length * sizeof(double),
+              values.data(), row_length * sizeof(double));
+}
+
+} // namespace
+
+// -------------- TrajectoryLogger -----------------
+
+LinMpcEigen::TrajectoryLogger::TrajectoryLogger(const std::string &path_prefix, uint32_t n_u, uint32_t n_x,
+                                                uint32_t n_y, uint32_t horizon, uint32_t ticks_per_chunk,
+                                                uint32_t columns)
+  : path_prefix_(path_prefix), X_(VecNd::Zero(horizon * n_x)), Y_(VecNd::Zero(horizon * n_y))
+{
+  if (ticks_per_chunk == 0 || horizon == 0)
+    throw std::runtime_error("TrajectoryLogger: ticks_per_chunk and horizon need to be > 0");
+  if ((columns & ~(uint32_t)LOG_ALL) != 0)
+    throw std::runtime_error("TrajectoryLogger: unknown columns");
+
+  std::memset(&layout_, 0, sizeof(layout_));
+  std::memcpy(layout_.magic, log_magic, sizeof(log_magic));
+  layout_.version = log_version;
+  layout_.n_u = n_u;
+  layout_.n_x = n_x;
+  layout_.n_y = n_y;
+  layout_.horizon = horizon;
+  layout_.capacity = ticks_per_chunk;
+  layout_.columns = columns;
+  chunk_size_ = columnLayout(layout_);
+
+  current_ = createChunk(0);
+  chunk_thread_ = std::thread(&TrajectoryLogger::chunkLoop, this);
+}
+
+LinMpcEigen::TrajectoryLogger::TrajectoryLogger(const std::string &path_prefix, const MPC &mpc,
+                                                uint32_t ticks_per_chunk, uint32_t columns)
+  : TrajectoryLogger(path_prefix, mpc.getLinearSystem().n_u, mpc.getLinearSystem().n_x,
+                     mpc.getLinearSystem().n_y, mpc.getHorizon(), ticks_per_chunk, columns)
+{
+}
+
+LinMpcEigen::TrajectoryLogger::~TrajectoryLogger()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  chunk_cv_.notify_one();
+  chunk_thread_.join();
+
+  closeChunk(retired_.exchange(nullptr));
+  Chunk *prepared = prepared_.exchange(nullptr);
+  if (prepared)
+  {
+    // never written, do not leave an empty chunk behind
+    std::string path = chunkPath(path_prefix_, prepared->index);
+    closeChunk(prepared);
+#ifdef __linux__
+    unlink(path.c_str());
+#endif
+  }
+  closeChunk(current_);
+}
+
+bool LinMpcEigen::TrajectoryLogger::log(const VecNd &U, const VecNd &X, const VecNd &Y)
+{
+  if (current_ticks_ == layout_.capacity)
+  {
+    // hand the full chunk to the background thread and continue in the prepared one,
+    // drop the tick if it is not ready yet
+    if (retired_.load(std::memory_order_acquire) != nullptr)
+    {
+      dropped_ticks_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    Chunk *next = prepared_.exchange(nullptr, std::memory_order_acq_rel);
+    if (next == nullptr)
+    {
+      dropped_ticks_.fetch_add(1, std::memory_order_relaxed);
+      chunk_cv_.notify_one();
+      return false;
+    }
+    retired_.store(current_, std::memory_order_release);
+    current_ = next;
+    current_ticks_ = 0;
+    chunk_cv_.notify_one();
+  }
+
+  TrajectoryLogHeader &chunk_header = header(current_);
+  char *data = current_->data;
+  uint64_t tick = tick_count_.load(std::memory_order_relaxed);
+  int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+  std::memcpy(data + layout_.column_offsets[TICK_COLUMN] + current_ticks_ * sizeof(uint64_t),
+              &tick, sizeof(tick));
+  std::memcpy(data + layout_.column_offsets[TIME_COLUMN] + current_ticks_ * sizeof(int64_t),
+              &time, sizeof(time));
+  copyRow(data, layout_, U_COLUMN, layout_.horizon * layout_.n_u, current_ticks_, U);
+  copyRow(data, layout_, X_COLUMN, layout_.horizon * layout_.n_x, current_ticks_, X);
+  copyRow(data, layout_, Y_COLUMN, layout_.horizon * layout_.n_y, current_ticks_, Y);
+
+  current_ticks_++;
+  // readers of a chunk that is being written see only complete ticks
+  __atomic_store_n(&chunk_header.n_ticks, current_ticks_, __ATOMIC_RELEASE);
+  tick_count_.store(tick + 1, std::memory_order_relaxed);
+  return true;
+}
+
+bool LinMpcEigen::TrajectoryLogger::log(const MPC &mpc, const VecNd &U)
+{
+  if ((uint32_t)U.rows() != layout_.horizon * layout_.n_u || mpc.getHorizon() != layout_.horizon ||
+      mpc.getLinearSystem().n_x != layout_.n_x || mpc.getLinearSystem().n_y != layout_.n_y)
+    throw std::runtime_error("TrajectoryLogger: MPC dimensions differ from the log layout");
+  if (layout_.columns & (LOG_X | LOG_Y))
+    mpc.calculateX(U, X_);
+  if (layout_.columns & LOG_Y)
+    outputSequence(mpc.getLinearSystem(), X_, Y_);
+  return log(U, X_, Y_);
+}
+
+uint64_t LinMpcEigen::TrajectoryLogger::getTickCount() const
+{
+  return tick_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LinMpcEigen::TrajectoryLogger::getDroppedTicks() const
+{
+  return dropped_ticks_.load(std::memory_order_relaxed);
+}
+
+std::string LinMpcEigen::TrajectoryLogger::getError() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return error_;
+}
+
+std::string LinMpcEigen::TrajectoryLogger::chunkPath(const std::string &path_prefix, uint64_t chunk_index)
+{
+  std::ostringstream path;
+  path << path_prefix << "_" << chunk_index << ".lmtl";
+  return path.str();
+}
+
+LinMpcEigen::TrajectoryLogger::Chunk *LinMpcEigen::TrajectoryLogger::createChunk(uint64_t chunk_index) const
+{
+#ifdef __linux__
+  std::string path = chunkPath(path_prefix_, chunk_index);
+  auto fail = [&](const char *operation, int fd) {
+    std::ostringstream msg;
+    msg << "TrajectoryLogger: " << operation << " " << path << " failed: " << std::strerror(errno);
+    if (fd >= 0)
+      close(fd);
+    throw std::runtime_error(msg.str());
+  };
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    fail("open", fd);
+  if (ftruncate(fd, chunk_size_) != 0)
+    fail("ftruncate", fd);
+  void *data = mmap(nullptr, chunk_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    fail("mmap", fd);
+
+  Chunk *chunk = new Chunk;
+  chunk->fd = fd;
+  chunk->data = static_cast<char *>(data);
+  chunk->size = chunk_size_;
+  chunk->index = chunk_index;
+
+  // allocate the file pages now, not on the first write of the control loop
+  long page_size = sysconf(_SC_PAGESIZE);
+  for (size_t offset = 0; offset < chunk_size_; offset += page_size)
+    chunk->data[offset] = 0;
+
+  TrajectoryLogHeader &chunk_header = header(chunk);
+  chunk_header = layout_;
+  chunk_header.chunk_index = chunk_index;
+  chunk_header.n_ticks = 0;
+  return chunk;
+#else
+  (void)chunk_index;
+  throw std::runtime_error("TrajectoryLogger: memory-mapped chunk files are only supported on Linux");
+#endif
+}
+
+void LinMpcEigen::TrajectoryLogger::closeChunk(Chunk *chunk)
+{
+  if (chunk == nullptr)
+    return;
+#ifdef __linux__
+  munmap(chunk->data, chunk->size);
+  close(chunk->fd);
+#endif
+  delete chunk;
+}
+
+LinMpcEigen::TrajectoryLogHeader &LinMpcEigen::TrajectoryLogger::header(Chunk *chunk) const
+{
+  return *reinterpret_cast<TrajectoryLogHeader *>(chunk->data);
+}
+
+void LinMpcEigen::TrajectoryLogger::chunkLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_)
+  {
+    closeChunk(retired_.exchange(nullptr, std::memory_order_acq_rel));
+    if (prepared_.load(std::memory_order_acquire) == nullptr)
+    {
+      uint64_t chunk_index = next_chunk_index_;
+      lock.unlock();
+      Chunk *chunk = nullptr;
+      std::string error;
+      try
+      {
+        chunk = createChunk(chunk_index);
+      }
+      catch (const std::exception &e)
+      {
+        error = e.what();
+      }
+      lock.lock();
+      if (chunk)
+      {
+        next_chunk_index_++;
+        prepared_.store(chunk, std::memory_order_release);
+      }
+      else
+        error_ = error;
+    }
+    // log() notifies without the lock, the timeout covers a missed wakeup
+    chunk_cv_.wait_for(lock, std::chrono::milliseconds(10));
+  }
+}
+
+// -------------- TrajectoryLogReader -----------------
+
+LinMpcEigen::TrajectoryLogReader::TrajectoryLogReader(const std::string &file_path)
+{
+#ifdef __linux__
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::ostringstream msg;
+    msg << "TrajectoryLogReader: cannot open " << file_path << ": " << std::strerror(errno);
+    throw std::runtime_error(msg.str());
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(TrajectoryLogHeader))
+  {
+    close(fd);
+    throw std::runtime_error("TrajectoryLogReader: " + file_path + " is not a trajectory log");
+  }
+  size_ = file_stat.st_size;
+  void *data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("TrajectoryLogReader: mmap " + file_path + " failed: " + std::strerror(errno));
+  data_ = static_cast<const char *>(data);
+  header_ = reinterpret_cast<const TrajectoryLogHeader *>(data_);
+
+  TrajectoryLogHeader layout = *header_;
+  bool valid = std::memcmp(header_->magic, log_magic, sizeof(log_magic)) == 0 &&
+               header_->version == log_version &&
+               columnLayout(layout) <= size_ &&
+               std::equal(layout.column_offsets, layout.column_offsets + 5, header_->column_offsets);
+  if (!valid)
+  {
+    munmap(const_cast<char *>(data_), size_);
+    std::ostringstream msg;
+    msg << "TrajectoryLogReader: " << file_path << " is not a trajectory log of version " << log_version;
+    throw std::runtime_error(msg.str());
+  }
+#else
+  throw std::runtime_error("TrajectoryLogReader: can't map " + file_path + 
+                           ", memory-mapped chunk files are only supported on Linux");
+#endif
+}
+
+LinMpcEigen::TrajectoryLogReader::~TrajectoryLogReader()
+{
+#ifdef __linux__
+  munmap(const_cast<char *>(data_), size_);
+#endif
+}
+
+const LinMpcEigen::TrajectoryLogHeader &LinMpcEigen::TrajectoryLogReader::getHeader() const
+{
+  return *header_;
+}
+
+uint64_t LinMpcEigen::TrajectoryLogReader::size() const
+{
+  return std::min<uint64_t>(__atomic_load_n(&header_->n_ticks, __ATOMIC_ACQUIRE), header_->capacity);
+}
+
+uint64_t LinMpcEigen::TrajectoryLogReader::getTick(uint64_t i) const
+{
+  checkIndex(i);
+  uint64_t tick;
+  std::memcpy(&tick, data_ + header_->column_offsets[TICK_COLUMN] + i * sizeof(uint64_t), sizeof(tick));
+  return tick;
+}
+
+int64_t LinMpcEigen::TrajectoryLogReader::getTime(uint64_t i) const
+{
+  checkIndex(i);
+  int64_t time;
+  std::memcpy(&time, data_ + header_->column_offsets[TIME_COLUMN] + i * sizeof(int64_t), sizeof(time));
+  return time;
+}
+
+Eigen::Map<const VecNd> LinMpcEigen::TrajectoryLogReader::getU(uint64_t i) const
+{
+  return getColumn(U_COLUMN, header_->horizon * header_->n_u, i);
+}
+
+Eigen::Map<const VecNd> LinMpcEigen::TrajectoryLogReader::getX(uint64_t i) const
+{
+  return getColumn(X_COLUMN, header_->horizon * header_->n_x, i);
+}
+
+Eigen::Map<const VecNd> LinMpcEigen::TrajectoryLogReader::getY(uint64_t i) const
+{
+  return getColumn(Y_COLUMN, header_->horizon * header_->n_y, i);
+}
+
+Eigen::Map<const VecNd> LinMpcEigen::TrajectoryLogReader::getColumn(uint32_t column, uint32_t rows, uint64_t i) const
+{
+  if (header_->column_offsets[column] == 0)
+    throw std::runtime_error("TrajectoryLogReader: column is not logged");
+  checkIndex(i);
+  // columns are 64 byte aligned, rows are multiples of sizeof(double)
+  const double *row = reinterpret_cast<const double *>(data_ + header_->column_offsets[column]) + i * rows;
+  return Eigen::Map<const VecNd>(row, rows);
+}
+
+void LinMpcEigen::TrajectoryLogReader::checkIndex(uint64_t i) const
+{
+  if (i >= size())
+  {
+    std::ostringstream msg;
+    msg << "TrajectoryLogReader: tick index " << i << " out of range, chunk holds " << size() << " ticks";
+    throw std::runtime_error(msg.str());
+  }
+}
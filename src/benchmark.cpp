@@ -0,0 +1,183 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "LinMpcEigen.hpp"
+#include "PerfCounters.hpp"
+
+/**
+ *    Benchmark of the library phases
+ *
+ *    usage: benchmark [--perf] [--horizon N] [--axes K] [--repeats R]
+ *
+ *      --perf     also collect cycles, instructions, cache misses and branch misses
+ *                 (perf_event_open), reports IPC and counts per operation next to the timing
+ *      --horizon  MPC horizon (default 40)
+ *      --axes     number of independent double integrators, n_x = 2 * K (default 3)
+ *      --repeats  operations per phase (default 200)
+ */
+
+struct BenchmarkOptions {
+  bool perf = false;
+  uint32_t horizon = 40;
+  uint32_t axes = 3;
+  uint32_t repeats = 200;
+};
+
+BenchmarkOptions parseOptions(int argc, char **argv);
+LinMpcEigen::LinearSystem doubleIntegrators(uint32_t axes, double T);
+void runPhase(const std::string &name, uint32_t repeats, const std::function<void()> &operation,
+              LinMpcEigen::PerfCounters *perf_counters);
+
+int main(int argc, char **argv)
+{
+  BenchmarkOptions options = parseOptions(argc, argv);
+
+  LinMpcEigen::LinearSystem system = doubleIntegrators(options.axes, 0.05);
+  uint32_t N = options.horizon;
+  VecNd Y_d = VecNd::Ones(N * system.n_y);
+  VecNd x0 = VecNd::Zero(system.n_x);
+  VecNd u_lower_bound = VecNd::Constant(system.n_u, -7.0);
+  VecNd u_upper_bound = VecNd::Constant(system.n_u, 7.0);
+
+  std::unique_ptr<LinMpcEigen::PerfCounters> perf_counters;
+  if (options.perf)
+  {
+    perf_counters = std::make_unique<LinMpcEigen::PerfCounters>();
+    if (!perf_counters->getError().empty())
+      std::cout << "Hardware counters not available (" << perf_counters->getError() << ")\n";
+    if (!perf_counters->anyAvailable())
+      perf_counters.reset(); // timing only
+  }
+
+  std::cout << "n_x = " << system.n_x << ", n_u = " << system.n_u << ", horizon = " << N
+            << ", repeats = " << options.repeats << "\n\n";
+  std::cout << std::left << std::setw(26) << "phase" << std::right << std::setw(14) << "time [us]";
+  if (perf_counters)
+    std::cout << std::setw(14) << "cycles" << std::setw(8) << "IPC"
+              << std::setw(14) << "cache-miss" << std::setw(14) << "branch-miss";
+  std::cout << "\n";
+
+  runPhase("setupPredictionMatrices", options.repeats, [&] {
+    SparseMat A_mpc(N * system.n_x, N * system.n_u), B_mpc(N * system.n_x, system.n_x),
+              C_mpc(N * system.n_y, N * system.n_x);
+    LinMpcEigen::setupPredictionMatrices(system, N, A_mpc, B_mpc, C_mpc);
+  }, perf_counters.get());
+
+  runPhase("MPC constructor", options.repeats, [&] {
+    LinMpcEigen::MPC mpc(system, N, Y_d, x0, 10000.0, 1.0, u_lower_bound, u_upper_bound);
+  }, perf_counters.get());
+
+  LinMpcEigen::MPC mpc(system, N, Y_d, x0, 10000.0, 1.0, u_lower_bound, u_upper_bound);
+  runPhase("initializeSolver", options.repeats, [&] {
+    mpc.initializeSolver();
+  }, perf_counters.get());
+
+  uint32_t step = 0;
+  runPhase("updateSolver (gradient)", options.repeats, [&] {
+    x0(0) = 0.001 * (step++ % 100);
+    mpc.updateSolver(Y_d, x0);
+  }, perf_counters.get());
+
+  VecNd U;
+  runPhase("solve", options.repeats, [&] {
+    U = mpc.solve();
+  }, perf_counters.get());
+
+  runPhase("calculateY", options.repeats, [&] {
+    VecNd Y = mpc.calculateY(U);
+  }, perf_counters.get());
+
+  return 0;
+}
+
+BenchmarkOptions parseOptions(int argc, char **argv)
+{
+  BenchmarkOptions options;
+  for (int i = 1; i < argc; i++)
+  {
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--perf") == 0)
+      options.perf = true;
+    else if (std::strcmp(argv[i], "--horizon") == 0 && has_value)
+      options.horizon = std::atoi(argv[++i]);
+    else if (std::strcmp(argv[i], "--axes") == 0 && has_value)
+      options.axes = std::atoi(argv[++i]);
+    else if (std::strcmp(argv[i], "--repeats") == 0 && has_value)
+      options.repeats = std::atoi(argv[++i]);
+    else
+    {
+      std::cout << "usage: benchmark [--perf] [--horizon N] [--axes K] [--repeats R]\n";
+      std::exit(1);
+    }
+  }
+  if (options.horizon == 0 || options.axes == 0 || options.repeats == 0)
+  {
+    std::cout << "horizon, axes and repeats need to be > 0\n";
+    std::exit(1);
+  }
+  return options;
+}
+
+// x = [p_1, dp_1, ..., p_K, dp_K]^T, u = [ddp_1, ..., ddp_K]^T, y = [p_1, ..., p_K]^T
+LinMpcEigen::LinearSystem doubleIntegrators(uint32_t axes, double T)
+{
+  Eigen::MatrixXd A = Eigen::MatrixXd::Zero(2 * axes, 2 * axes);
+  Eigen::MatrixXd B = Eigen::MatrixXd::Zero(2 * axes, axes);
+  Eigen::MatrixXd C = Eigen::MatrixXd::Zero(axes, 2 * axes);
+  for (uint32_t i = 0; i < axes; i++)
+  {
+    A.block(2 * i, 2 * i, 2, 2) << 1, T,
+                                   0, 1;
+    B.block(2 * i, i, 2, 1) << T*T/2.0,
+                               T;
+    C(i, 2 * i) = 1;
+  }
+  Eigen::MatrixXd D = Eigen::MatrixXd::Zero(axes, axes);
+  return LinMpcEigen::LinearSystem(A.sparseView(), B.sparseView(), C.sparseView(), D.sparseView());
+}
+
+void runPhase(const std::string &name, uint32_t repeats, const std::function<void()> &operation,
+              LinMpcEigen::PerfCounters *perf_counters)
+{
+  operation(); // warm-up
+
+  LinMpcEigen::PerfCounterValues counters;
+  if (perf_counters)
+    perf_counters->start();
+  auto start_time = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < repeats; i++)
+    operation();
+  auto end_time = std::chrono::steady_clock::now();
+  if (perf_counters)
+    counters = perf_counters->stop();
+
+  double time_per_op = std::chrono::duration<double, std::micro>(end_time - start_time).count() / repeats;
+  std::cout << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(14) << time_per_op;
+  if (perf_counters)
+  {
+    using Counter = LinMpcEigen::PerfCounterValues;
+    auto per_op = [&](Counter::Counter counter) {
+      std::ostringstream text;
+      if (counters.available[counter])
+        text << std::fixed << std::setprecision(0) << (double)counters.values[counter] / repeats;
+      else
+        text << "n/a";
+      return text.str();
+    };
+    std::ostringstream ipc;
+    if (counters.ipc() > 0.0)
+      ipc << std::fixed << std::setprecision(2) << counters.ipc();
+    else
+      ipc << "n/a";
+    std::cout << std::setw(14) << per_op(Counter::CYCLES) << std::setw(8) << ipc.str()
+              << std::setw(14) << per_op(Counter::CACHE_MISSES) << std::setw(14) << per_op(Counter::BRANCH_MISSES);
+  }
+  std::cout << "\n";
+}
@@ -0,0 +1,50 @@
+"""
+Smoke test of the lin_mpc_eigen Python module (CMake target test_python_bindings)
+
+Imports the module, solves the input-bounded MPC I of a double integrator once and checks the
+solver status, the input bounds and the prediction of the solution. Exits with 1 on a failure.
+"""
+import sys
+
+import numpy as np
+import scipy.sparse as sp
+
+import lin_mpc_eigen as lme
+
+T = 0.05
+horizon = 20
+
+A = np.array([[1.0, T], [0.0, 1.0]])
+B = np.array([[T * T / 2.0], [T]])
+C = np.array([[1.0, 0.0]])
+D = np.zeros((1, 1))
+system = lme.LinearSystem(sp.csc_matrix(A), sp.csc_matrix(B), sp.csc_matrix(C), sp.csc_matrix(D))
+
+Y_d = np.ones(horizon)
+x0 = np.zeros(2)
+u_bound = np.array([0.3])
+mpc = lme.MPC(system, horizon, Y_d, x0, 100.0, 1.0, -u_bound, u_bound)
+mpc.initialize_solver()
+U = mpc.solve()
+
+failures = []
+if mpc.get_solver_status() != 1:
+    failures.append("solver status %d, needs to be 1 (OSQP_SOLVED)" % mpc.get_solver_status())
+if U.shape != (horizon,):
+    failures.append("U has the shape %s, needs to be (%d,)" % (U.shape, horizon))
+elif np.max(np.abs(U)) > u_bound[0] + 1e-4:
+    failures.append("U violates the input bounds, max |u| = %g" % np.max(np.abs(U)))
+else:
+    Y = mpc.calculate_Y(U)
+    if not 0.0 < Y[-1] <= 1.0 + 1e-3:
+        failures.append("the predicted output does not approach Y_d, y(N) = %g" % Y[-1])
+
+qp_problem = mpc.get_qp_problem()
+if qp_problem.A_qp.shape != (horizon, horizon):
+    failures.append("A_qp has the shape %s, needs to be (%d, %d)" % (qp_problem.A_qp.shape, horizon, horizon))
+
+for failure in failures:
+    print("FAILED: " + failure)
+if failures:
+    sys.exit(1)
+print("lin_mpc_eigen: one solve, U(0) = %g, %d iterations" % (U[0], mpc.get_solver_iterations()))
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "LinMpcEigen.hpp"
+#include "RiccatiKktSolver.hpp"
+
+/**
+ *    Accuracy check of the ADMM QP backends
+ *
+ *    The RiccatiKktSolver solutions of (D * A_qp * D + diag(shift)) * x = rhs are compared against a dense
+ *    LDLT solve of the same system, with A_qp taken from the MPC, for MPC I and MPC II, with and without
+ *    an input scaling D.
+ *
+ *    The MIXED_PRECISION and RICCATI solutions of the input-bounded MPC I of a double integrator
+ *    (N = 50, |u| <= 0.3, R = 1, Q = 100 and Q = 10000) are compared against the exact solution of
+ *    the same QP, computed with a primal-dual active set method and dense LDLT solves. Both backends
+ *    run with the default OsqpSettings, with and without the structured scaling.
+ *    Returns EXIT_FAILURE if a backend does not converge or its relative error exceeds the tolerance.
+ */
+
+static constexpr uint32_t horizon = 50;
+static constexpr double tolerance = 1e-3;  // relative error tolerance, the ADMM tolerances are 1e-6
+static constexpr double kkt_tolerance = 1e-9; // relative error tolerance of the KKT solves
+
+LinMpcEigen::LinearSystem doubleIntegrator(double T);
+Eigen::VectorXd boxConstrainedQpSolution(const Eigen::MatrixXd &H, const Eigen::VectorXd &g,
+                                         const Eigen::VectorXd &lower_bound, const Eigen::VectorXd &upper_bound);
+bool checkRiccatiSolve(const std::string &name, const LinMpcEigen::MPC &mpc, 
+                       const Eigen::MatrixXd &state_weight, const Eigen::MatrixXd &input_weight,
+                       const Eigen::VectorXd &input_scaling);
+bool checkBackend(const std::string &name, LinMpcEigen::MPC &mpc, const Eigen::VectorXd &U_exact);
+
+int main()
+{
+  LinMpcEigen::LinearSystem system = doubleIntegrator(0.05);
+  Eigen::VectorXd x0 = Eigen::VectorXd::Zero(2);
+  Eigen::VectorXd Y_d = Eigen::VectorXd::Ones(horizon);
+  Eigen::VectorXd u_lb = Eigen::VectorXd::Constant(1, -0.3);
+  Eigen::VectorXd u_ub = Eigen::VectorXd::Constant(1, 0.3);
+  bool passed = true;
+
+  // -------------- Riccati KKT solves against LDLT -----------------
+  {
+    std::cout << "RiccatiKktSolver against LDLT\n";
+    Eigen::MatrixXd C = Eigen::MatrixXd(system.C);
+    double Q = 10000.0, R = 1.0;
+    LinMpcEigen::MPC mpc1(system, horizon, Y_d, x0, Q, R, u_lb, u_ub);
+    mpc1.initializeSolver();
+    Eigen::VectorXd input_scaling = Eigen::VectorXd::LinSpaced(horizon, 0.01, 0.1);
+    for (const Eigen::VectorXd &scaling : {Eigen::VectorXd(), input_scaling})
+      passed &= checkRiccatiSolve(scaling.rows() > 0 ? "MPC I, scaled" : "MPC I", mpc1, 
+                                  Q * C.transpose() * C, R * Eigen::MatrixXd::Identity(1, 1), scaling);
+
+    double W_y = 100.0;
+    Eigen::MatrixXd w_u = Eigen::MatrixXd::Constant(1, 1, 0.5);
+    Eigen::MatrixXd w_x = Eigen::Vector2d(1.0, 3.0).asDiagonal();
+    LinMpcEigen::MPC mpc2(system, horizon, Y_d, x0, W_y, w_u.sparseView(), w_x.sparseView(), u_lb, u_ub);
+    mpc2.initializeSolver();
+    for (const Eigen::VectorXd &scaling : {Eigen::VectorXd(), input_scaling})
+      passed &= checkRiccatiSolve(scaling.rows() > 0 ? "MPC II, scaled" : "MPC II", mpc2, 
+                                  W_y * C.transpose() * C + w_x.transpose() * w_x, w_u.transpose() * w_u, 
+                                  scaling);
+  }
+
+  // -------------- backend solutions against the exact solution -----------------
+  for (double Q : {100.0, 10000.0})
+  {
+    LinMpcEigen::MPC reference(system, horizon, Y_d, x0, Q, 1.0, u_lb, u_ub);
+    reference.initializeSolver();
+    const SparseQpProblem &qp_problem = reference.getQpProblem();
+    Eigen::VectorXd U_exact = boxConstrainedQpSolution(Eigen::MatrixXd(qp_problem.A_qp), qp_problem.b_qp,
+                                                       qp_problem.lower_bound, qp_problem.upper_bound);
+    std::cout << "MPC I, Q = " << Q << "\n";
+
+    for (bool structured_scaling : {false, true})
+    {
+      for (LinMpcEigen::QpBackend qp_backend : {LinMpcEigen::QpBackend::MIXED_PRECISION,
+                                                LinMpcEigen::QpBackend::RICCATI})
+      {
+        LinMpcEigen::MPC mpc(system, horizon, Y_d, x0, Q, 1.0, u_lb, u_ub);
+        mpc.setQpBackend(qp_backend);
+        mpc.setStructuredScaling(structured_scaling);
+        mpc.initializeSolver();
+        std::string name = qp_backend == LinMpcEigen::QpBackend::RICCATI ? "RICCATI" : "MIXED_PRECISION";
+        if (structured_scaling)
+          name += ", scaled";
+        passed &= checkBackend(name, mpc, U_exact);
+      }
+    }
+  }
+
+  std::cout << (passed ? "the QP backends match the exact solutions\n"
+                       : "the QP backends do not match the exact solutions\n");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**                   Double integrator
+ * x = [px, dpx]^T
+ * u = [ddpx]^T
+ *
+ * y = [px]^T
+ */
+LinMpcEigen::LinearSystem doubleIntegrator(double T)
+{
+  Eigen::MatrixXd A(2, 2);
+  A <<  1, T,
+        0, 1;
+  Eigen::MatrixXd B(2, 1);
+  B <<  T*T/2.0,
+        T;
+  Eigen::MatrixXd C(1, 2);
+  C <<  1, 0;
+  Eigen::MatrixXd D = Eigen::MatrixXd::Zero(1, 1);
+  return LinMpcEigen::LinearSystem(A.sparseView(), B.sparseView(), C.sparseView(), D.sparseView());
+}
+
+/*
+  min 1/2 * u^T * H * u + g^T * u  s.t. lower_bound <= u <= upper_bound
+  Primal-dual active set method: the bounds with lambda + (u - bound) pointing outside are fixed,
+  the free entries solve their reduced system, until the active set does not change
+*/
+Eigen::VectorXd boxConstrainedQpSolution(const Eigen::MatrixXd &H, const Eigen::VectorXd &g,
+                                         const Eigen::VectorXd &lower_bound, const Eigen::VectorXd &upper_bound)
+{
+  uint32_t n = H.rows();
+  Eigen::VectorXd u = Eigen::VectorXd::Zero(n);
+  Eigen::VectorXd lambda = Eigen::VectorXd::Zero(n);
+  std::vector<int> active(n, 2); // -1 lower bound, 1 upper bound, 0 free
+  for (uint32_t iteration = 0; iteration < 100; iteration++)
+  {
+    std::vector<int> next_active(n, 0);
+    for (uint32_t i = 0; i < n; i++)
+    {
+      if (lambda(i) + u(i) - upper_bound(i) > 0.0)
+        next_active[i] = 1;
+      else if (lambda(i) + u(i) - lower_bound(i) < 0.0)
+        next_active[i] = -1;
+    }
+    if (next_active == active)
+      break;
+    active = next_active;
+
+    std::vector<uint32_t> free;
+    for (uint32_t i = 0; i < n; i++)
+    {
+      if (active[i] == 0)
+        free.push_back(i);
+      else
+        u(i) = active[i] > 0 ? upper_bound(i) : lower_bound(i);
+    }
+    Eigen::VectorXd gradient = g;
+    for (uint32_t i = 0; i < n; i++)
+      if (active[i] != 0)
+        gradient += H.col(i) * u(i);
+    Eigen::MatrixXd H_free(free.size(), free.size());
+    Eigen::VectorXd rhs(free.size());
+    for (uint32_t i = 0; i < free.size(); i++)
+    {
+      rhs(i) = -gradient(free[i]);
+      for (uint32_t j = 0; j < free.size(); j++)
+        H_free(i, j) = H(free[i], free[j]);
+    }
+    Eigen::VectorXd u_free = H_free.ldlt().solve(rhs);
+    for (uint32_t i = 0; i < free.size(); i++)
+      u(free[i]) = u_free(i);
+
+    lambda = -(H * u + g);
+    for (uint32_t i : free)
+      lambda(i) = 0.0;
+  }
+  return u;
+}
+
+// the same solver is factorized for two shifts, as after an adaptive rho step
+bool checkRiccatiSolve(const std::string &name, const LinMpcEigen::MPC &mpc, 
+                       const Eigen::MatrixXd &state_weight, const Eigen::MatrixXd &input_weight,
+                       const Eigen::VectorXd &input_scaling)
+{
+  const LinMpcEigen::LinearSystem &system = mpc.getLinearSystem();
+  uint32_t n = horizon * system.n_u;
+  RiccatiKktSolver kkt_solver(Eigen::MatrixXd(system.A), Eigen::MatrixXd(system.B), horizon, 
+                              state_weight, input_weight, input_scaling);
+  Eigen::VectorXd scaling = input_scaling.rows() > 0 ? input_scaling : Eigen::VectorXd(Eigen::VectorXd::Ones(n));
+  Eigen::VectorXd rhs = Eigen::VectorXd::LinSpaced(n, -1.0, 2.0).array().sin();
+  Eigen::MatrixXd A_qp = Eigen::MatrixXd(mpc.getQpProblem().A_qp);
+
+  double error = 0.0;
+  for (double rho : {0.1, 1e3})
+  {
+    Eigen::VectorXd diagonal_shift = Eigen::VectorXd::Constant(n, 1e-6 + rho);
+    kkt_solver.factorize(diagonal_shift);
+    Eigen::MatrixXd kkt_matrix = scaling.asDiagonal() * A_qp * scaling.asDiagonal();
+    kkt_matrix.diagonal() += diagonal_shift;
+    Eigen::VectorXd x_direct = kkt_matrix.ldlt().solve(rhs);
+    error = std::max(error, (kkt_solver.solve(rhs) - x_direct).norm() / x_direct.norm());
+  }
+  bool passed = error <= kkt_tolerance;
+  std::cout << "  " << std::left << std::setw(24) << name << " relative error = " << error 
+            << (passed ? "" : "  FAILED") << "\n";
+  return passed;
+}
+
+bool checkBackend(const std::string &name, LinMpcEigen::MPC &mpc, const Eigen::VectorXd &U_exact)
+{
+  Eigen::VectorXd U = mpc.solve();
+  double error = (U - U_exact).norm() / U_exact.norm();
+  bool passed = mpc.getSolverStatus() == OSQP_SOLVED && error <= tolerance;
+  std::cout << "  " << std::left << std::setw(24) << name << " status = " << std::setw(3) << mpc.getSolverStatus()
+            << " iterations = " << std::setw(6) << mpc.getSolverIterations()
+            << " relative error = " << error << (passed ? "" : "  FAILED") << "\n";
+  return passed;
+}
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "LinMpcEigen.hpp"
+
+/**
+ *    Finite difference check of MPC::calculateSensitivities()
+ *
+ *    Every derivative dU/dp is compared against the central difference (U(p + h) - U(p - h)) / (2 * h)
+ *    of two perturbed re-solves. Checked are MPC I with active input bounds (Q, R, u_upper_bound, x0, Y_d)
+ *    and MPC II with active state constraints on x[1] (W_y, w_u, w_x, x_upper_bound, x0).
+ *    Returns EXIT_FAILURE if a relative error exceeds the tolerance.
+ */
+
+using ParametrizedSolve = std::function<Eigen::VectorXd(double)>; // solution U for parameter offset h
+
+static constexpr uint32_t horizon = 20;
+static constexpr double step = 1e-4;       // finite difference step, relative for the weights
+static constexpr double tolerance = 1e-5;  // relative error tolerance
+
+LinMpcEigen::LinearSystem doubleIntegrator(double T);
+OsqpSettings accurateSettings();
+bool checkDerivative(const std::string &name, const Eigen::VectorXd &dU_dp,
+                     const ParametrizedSolve &solve, double h);
+
+int main()
+{
+  LinMpcEigen::LinearSystem system = doubleIntegrator(0.1);
+  Eigen::VectorXd x0 = Eigen::VectorXd::Zero(2);
+  Eigen::VectorXd Y_d = Eigen::VectorXd::Ones(horizon);
+  bool passed = true;
+
+  // -------------- MPC I, input bounds active -----------------
+  double Q = 1000.0, R = 1.0;
+  Eigen::VectorXd u_lb = Eigen::VectorXd::Constant(1, -5.0);
+  Eigen::VectorXd u_ub = Eigen::VectorXd::Constant(1, 5.0);
+  auto solveMpc1 = [&](double Q_in, double R_in, const Eigen::VectorXd &u_ub_in,
+                       const Eigen::VectorXd &x0_in, const Eigen::VectorXd &Y_d_in) {
+    LinMpcEigen::MPC mpc(system, horizon, Y_d_in, x0_in, Q_in, R_in, u_lb, u_ub_in, 0.0, accurateSettings());
+    mpc.initializeSolver();
+    return Eigen::VectorXd(mpc.solve());
+  };
+  {
+    LinMpcEigen::MPC mpc(system, horizon, Y_d, x0, Q, R, u_lb, u_ub, 0.0, accurateSettings());
+    mpc.initializeSolver();
+    LinMpcEigen::MpcSensitivities sensitivities = mpc.calculateSensitivities(mpc.solve());
+    std::cout << "MPC I: " << sensitivities.n_active_bounds << " active input bounds\n";
+
+    Eigen::VectorXd e_x0 = Eigen::VectorXd::Unit(2, 1);
+    Eigen::VectorXd e_Y_d = Eigen::VectorXd::Unit(horizon, 5);
+    passed &= checkDerivative("Q", sensitivities.dU_dweights.col(0),
+                              [&](double h) { return solveMpc1(Q + h, R, u_ub, x0, Y_d); }, step * Q);
+    passed &= checkDerivative("R", sensitivities.dU_dweights.col(1),
+                              [&](double h) { return solveMpc1(Q, R + h, u_ub, x0, Y_d); }, step * R);
+    passed &= checkDerivative("u_upper_bound", sensitivities.dU_du_upper_bound.col(0),
+                              [&](double h) { 
+                                return solveMpc1(Q, R, (u_ub.array() + h).matrix(), x0, Y_d); 
+                              }, step);
+    passed &= checkDerivative("x0(1)", sensitivities.dU_dx0.col(1),
+                              [&](double h) { return solveMpc1(Q, R, u_ub, x0 + h * e_x0, Y_d); }, step);
+    passed &= checkDerivative("Y_d(5)", sensitivities.dU_dY_d.col(5),
+                              [&](double h) { return solveMpc1(Q, R, u_ub, x0, Y_d + h * e_Y_d); }, step);
+  }
+
+  // -------------- MPC II, state constraints on x[1] active -----------------
+  double W_y = 1000.0;
+  Eigen::MatrixXd w_u = Eigen::MatrixXd::Constant(1, 1, 1.0);
+  Eigen::MatrixXd w_x = Eigen::Vector2d(0.5, 2.0).asDiagonal();
+  Eigen::VectorXd x_lb = Eigen::VectorXd::Constant(2, -10.0);
+  Eigen::VectorXd x_ub = Eigen::VectorXd::Constant(2, 1.5);
+  auto solveMpc2 = [&](double W_y_in, const Eigen::MatrixXd &w_u_in, const Eigen::MatrixXd &w_x_in,
+                       const Eigen::VectorXd &x_ub_in, const Eigen::VectorXd &x0_in) {
+    LinMpcEigen::MPC mpc(system, horizon, Y_d, x0_in, W_y_in, w_u_in.sparseView(), w_x_in.sparseView(),
+                         Eigen::VectorXd::Constant(1, -50.0), Eigen::VectorXd::Constant(1, 50.0),
+                         x_lb, x_ub_in, 0.0, accurateSettings());
+    mpc.initializeSolver();
+    return Eigen::VectorXd(mpc.solve());
+  };
+  {
+    LinMpcEigen::MPC mpc(system, horizon, Y_d, x0, W_y, w_u.sparseView(), w_x.sparseView(),
+                         Eigen::VectorXd::Constant(1, -50.0), Eigen::VectorXd::Constant(1, 50.0),
+                         x_lb, x_ub, 0.0, accurateSettings());
+    mpc.initializeSolver();
+    LinMpcEigen::MpcSensitivities sensitivities = mpc.calculateSensitivities(mpc.solve());
+    std::cout << "MPC II: " << sensitivities.n_active_constraints << " active state constraints\n";
+
+    // weights in the order of sensitivities.weight_names: W_y, w_u(0,0), w_x(0,0), w_x(1,1)
+    passed &= checkDerivative("W_y", sensitivities.dU_dweights.col(0),
+                              [&](double h) { return solveMpc2(W_y + h, w_u, w_x, x_ub, x0); }, step * W_y);
+    passed &= checkDerivative("w_u(0,0)", sensitivities.dU_dweights.col(1),
+                              [&](double h) { 
+                                return solveMpc2(W_y, (w_u.array() + h).matrix(), w_x, x_ub, x0); 
+                              }, step);
+    for (uint32_t i = 0; i < 2; i++)
+    {
+      auto solveWx = [&, i](double h) {
+        Eigen::MatrixXd w_x_perturbed = w_x;
+        w_x_perturbed(i, i) += h;
+        return solveMpc2(W_y, w_u, w_x_perturbed, x_ub, x0);
+      };
+      passed &= checkDerivative(sensitivities.weight_names[2 + i], sensitivities.dU_dweights.col(2 + i),
+                                solveWx, step);
+    }
+    Eigen::VectorXd e_1 = Eigen::VectorXd::Unit(2, 1);
+    passed &= checkDerivative("x_upper_bound(1)", sensitivities.dU_dx_upper_bound.col(1),
+                              [&](double h) { return solveMpc2(W_y, w_u, w_x, x_ub + h * e_1, x0); }, step);
+    passed &= checkDerivative("x0(1)", sensitivities.dU_dx0.col(1),
+                              [&](double h) { return solveMpc2(W_y, w_u, w_x, x_ub, x0 + h * e_1); }, step);
+  }
+
+  std::cout << (passed ? "sensitivities match the finite differences\n"
+                       : "sensitivities do not match the finite differences\n");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**                   Double integrator
+ * x = [px, dpx]^T
+ * u = [ddpx]^T
+ *
+ * y = [px]^T
+ */
+LinMpcEigen::LinearSystem doubleIntegrator(double T)
+{
+  Eigen::MatrixXd A(2, 2);
+  A <<  1, T,
+        0, 1;
+  Eigen::MatrixXd B(2, 1);
+  B <<  T*T/2.0,
+        T;
+  Eigen::MatrixXd C(1, 2);
+  C <<  1, 0;
+  Eigen::MatrixXd D = Eigen::MatrixXd::Zero(1, 1);
+  return LinMpcEigen::LinearSystem(A.sparseView(), B.sparseView(), C.sparseView(), D.sparseView());
+}
+
+// polished solutions, the finite differences need the exact active set solution
+OsqpSettings accurateSettings()
+{
+  OsqpSettings settings = OsqpSettings::highAccuracy();
+  settings.polish = true;
+  settings.absolute_tolerance = 1e-10;
+  settings.relative_tolerance = 1e-10;
+  settings.max_iteration = 200000;
+  return settings;
+}
+
+bool checkDerivative(const std::string &name, const Eigen::VectorXd &dU_dp,
+                     const ParametrizedSolve &solve, double h)
+{
+  Eigen::VectorXd finite_difference = (solve(h) - solve(-h)) / (2.0 * h);
+  double error = (dU_dp - finite_difference).norm() / std::max(1.0, finite_difference.norm());
+  bool passed = error <= tolerance;
+  std::cout << "  " << std::left << std::setw(18) << name << " |dU/dp| = " << std::setw(12) << dU_dp.norm()
+            << " relative error = " << error << (passed ? "" : "  FAILED") << "\n";
+  return passed;
+}
@@ -0,0 +1,94 @@
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "TrajectoryLogger.hpp"
+
+/**
+ *    Reader of TrajectoryLogger chunk files
+ *
+ *    usage: trajectory_log_reader <chunk file> [--column U|X|Y] [--first I] [--count C]
+ *
+ *      without --column the header and the tick range of the chunk are printed
+ *      --column  print the column as CSV, one tick per line: tick, time [ns], values
+ *      --first   first tick index in the chunk (default 0)
+ *      --count   number of ticks (default all)
+ */
+
+void printUsage()
+{
+  std::cout << "usage: trajectory_log_reader <chunk file> [--column U|X|Y] [--first I] [--count C]\n";
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printUsage();
+    return 1;
+  }
+  std::string column;
+  uint64_t first = 0;
+  uint64_t count = UINT64_MAX;
+  for (int i = 2; i < argc; i++)
+  {
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--column") == 0 && has_value)
+      column = argv[++i];
+    else if (std::strcmp(argv[i], "--first") == 0 && has_value)
+      first = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(argv[i], "--count") == 0 && has_value)
+      count = std::strtoull(argv[++i], nullptr, 10);
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+  if (!column.empty() && column != "U" && column != "X" && column != "Y")
+  {
+    printUsage();
+    return 1;
+  }
+
+  try
+  {
+    LinMpcEigen::TrajectoryLogReader reader(argv[1]);
+    const LinMpcEigen::TrajectoryLogHeader &header = reader.getHeader();
+    uint64_t n_ticks = reader.size();
+
+    if (column.empty())
+    {
+      std::cout << "chunk " << header.chunk_index << ": " << n_ticks << " / " << header.capacity << " ticks\n"
+                << "n_u = " << header.n_u << ", n_x = " << header.n_x << ", n_y = " << header.n_y
+                << ", horizon = " << header.horizon << "\n"
+                << "columns:" << (header.columns & LinMpcEigen::LOG_U ? " U" : "")
+                << (header.columns & LinMpcEigen::LOG_X ? " X" : "")
+                << (header.columns & LinMpcEigen::LOG_Y ? " Y" : "") << "\n";
+      if (n_ticks > 0)
+        std::cout << "ticks " << reader.getTick(0) << " - " << reader.getTick(n_ticks - 1) << ", "
+                  << (reader.getTime(n_ticks - 1) - reader.getTime(0)) * 1e-9 << " s\n";
+      return 0;
+    }
+
+    uint64_t last = first + std::min(count, n_ticks > first ? n_ticks - first : 0);
+    std::cout << std::setprecision(17);
+    for (uint64_t i = first; i < last; i++)
+    {
+      std::cout << reader.getTick(i) << "," << reader.getTime(i);
+      Eigen::Map<const VecNd> values = column == "U" ? reader.getU(i) :
+                                       column == "X" ? reader.getX(i) : reader.getY(i);
+      for (Eigen::Index j = 0; j < values.size(); j++)
+        std::cout << "," << values(j);
+      std::cout << "\n";
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}